@@ -1,6 +1,7 @@
 ﻿#ifndef CAFFE_BLOB_HPP_
 #define CAFFE_BLOB_HPP_
 
+#include <stdint.h>
 #include <algorithm>
 #include <string>
 #include <vector>
@@ -24,7 +25,8 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), channel_block_(1),
+         storage_(BlobProto_Storage_FLOAT) {}
 
   /*以下几种方法时对blob进行构造或者说初始化的几种方法，本质是相同的，即对num， channel， height， width，data进行赋值*/
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
@@ -229,6 +231,7 @@ class Blob {
   /* 内联获取data与diff的数据，使用内联的原因是获取的函数简单，单纯函数调用成本太高，内联编译之后省去函数调用*/
   inline const shared_ptr<SyncedMemory>& data() const {
     CHECK(data_);
+    ExpandHalfData();
     return data_;
   }
 
@@ -286,16 +289,66 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);		//引用其他blob的diff作为该blob的data指针指向，所以要使用share_ptr
+  /**
+   * @brief Set the data_ shared_ptr to point to memory, which must hold at
+   *        least count() elements and may be shared with other Blob%s.
+   *
+   * Used by Net to let blobs with disjoint lifetimes share one buffer. A later
+   * Reshape to more than count() elements gives this Blob its own memory
+   * again.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& memory);
+  /// @brief Like ShareDataMemory, for the diff_ shared_ptr.
+  void ShareDiffMemory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other); //与google的protobuf中编译出来的blob是否相同
 
+  /**
+   * @brief The channel block size b of a blob that holds an N x C x H x W
+   *        tensor in the blocked NCHW[b]c layout, i.e. with the shape
+   *        N x (C / b) x H x W x b; 1 for blobs in any other layout.
+   *
+   * The blocked layout keeps b consecutive channels of a pixel contiguous, so
+   * that CPU kernels can vectorize across channels. It is runtime metadata
+   * set by the layers producing the blob (see ReorderLayer) and carried over
+   * by ReshapeLike; it is not serialized.
+   */
+  inline int channel_block() const { return channel_block_; }
+  inline void set_channel_block(int channel_block) {
+    CHECK_GE(channel_block, 1);
+    channel_block_ = channel_block;
+  }
+
+  /**
+   * @brief The format the data is held in: FLOAT for Dtype, or one of the
+   *        16-bit formats of BlobProto.Storage.
+   *
+   * A blob in a 16-bit format releases its Dtype data and keeps only
+   * half_data(), which layers that support it compute from directly. Any
+   * access to the data as Dtype (cpu_data(), mutable_cpu_data(), gpu_data(),
+   * ...) converts it back and returns the blob to FLOAT. ToProto writes the
+   * data in the blob's format.
+   */
+  inline BlobProto_Storage storage() const { return storage_; }
+  void set_storage(BlobProto_Storage storage);
+  const uint16_t* half_data() const;
+
  protected:
+  /// @brief Converts the data back to Dtype if it is held in a 16-bit format.
+  void ExpandHalfData() const;
+  /// @brief Writes the 16-bit data to proto, for ToProto.
+  void WriteHalfData(BlobProto* proto) const;
+
   shared_ptr<SyncedMemory> data_;			//当前layer的计算结果
   shared_ptr<SyncedMemory> diff_;			//当前layer的计算结果与expected value之间的差值， 即用来表示梯度
   shared_ptr<SyncedMemory> shape_data_;     //使用syncmemory存储shape，因为其本质上是1维的tensor
   vector<int> shape_;						//记录tensor的各个维度的size
   int count_;								//总共占用数据位
   int capacity_;							//所能包含的最大容量		
+  int channel_block_;
+  // Changed by ExpandHalfData from const accessors.
+  mutable BlobProto_Storage storage_;
+  mutable shared_ptr<SyncedMemory> half_data_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
@@ -78,6 +78,8 @@ namespace cv { class Mat; }
 
 namespace caffe {
 
+class ThreadPool;
+
 // We will use the boost shared_ptr instead of the new C++11 one mainly
 // because cuda does not work (at least now) well with C++11 features.
 using boost::shared_ptr;
@@ -167,6 +169,19 @@ class Caffe {
   inline static void set_solver_count(int val) { Get().solver_count_ = val; }
   inline static bool root_solver() { return Get().root_solver_; }
   inline static void set_root_solver(bool val) { Get().root_solver_ = val; }
+  // Multi-process training info: the number of processes training together
+  // and the index of this one among them (see RingSync).
+  inline static int world_size() { return Get().world_size_; }
+  inline static void set_world_size(int val) { Get().world_size_ = val; }
+  inline static int world_rank() { return Get().world_rank_; }
+  inline static void set_world_rank(int val) { Get().world_rank_ = val; }
+  // Intra-op parallelism: the number of threads the CPU paths of layers
+  // split their work across. Like the rest of this class it is per thread.
+  inline static int cpu_threads() { return Get().cpu_threads_; }
+  // Sets the number of intra-op threads; 0 uses all physical cores.
+  static void set_cpu_threads(int val);
+  // Returns the intra-op thread pool, creating it on first use.
+  static ThreadPool& thread_pool();
 
  protected:
 #ifndef CPU_ONLY
@@ -178,6 +193,10 @@ class Caffe {
   Brew mode_;
   int solver_count_;
   bool root_solver_;
+  int world_size_;
+  int world_rank_;
+  int cpu_threads_;
+  shared_ptr<ThreadPool> thread_pool_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
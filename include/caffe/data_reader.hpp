@@ -1,6 +1,7 @@
 ﻿#ifndef CAFFE_DATA_READER_HPP_
 #define CAFFE_DATA_READER_HPP_
 
+#include <stdint.h>
 #include <map>
 #include <string>
 #include <vector>
@@ -9,6 +10,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -65,11 +67,57 @@ class DataReader
     virtual ~Body();
 
    protected:
+    // The keys of the source, read when it is opened with shuffle on or
+    // with several reader_threads.
+    class KeyIndex;
+    // Walks a cursor over the records of the stream: the source, or a range
+    // of its keys, in key order, wrapping around at the end, or with
+    // shuffle, every epoch in a new order. In multi-process training a rank
+    // only reads every world_size-th record of the source, starting at its
+    // world_rank, or its own ranges of it when read by shards.
+    class RecordStream;
+
     void InternalThreadEntry();								//起读数据的线程的入口
-    void read_one(db::Cursor* cursor, QueuePair* qp);       //读取数据
+    void read_one(RecordStream* stream, QueuePair* qp);     //读取数据
+    // Parses the record data, of size bytes, into datum.
+    void ParseRecord(const char* data, size_t size, Datum* datum) const;
+    // Fills datum with the record at cursor, parsed where the cursor holds it.
+    void ReadRecord(db::Cursor* cursor, Datum* datum) const;
+    // Fills datum with the decoded image of the record of key, from the
+    // cache, or parsing and decoding data and adding it to the cache.
+    void ReadCached(const string& key, const char* data, size_t size,
+        Datum* datum) const;
+    // Reads db with one thread per shard, each starting at the given record
+    // of its shard's stream. Returns when interrupted.
+    void ReadShards(db::DB* db, const vector<int64_t>& first_records,
+        const vector<shared_ptr<QueuePair> >& qps);
+    // The loop of one of the threads of ReadShards, which reads the stream of
+    // shard with a cursor of its own, starting at its given record.
+    void ShardEntry(db::DB* db, int shard, int64_t record,
+        const vector<shared_ptr<QueuePair> >& qps);
+    // The stream of shard, or of the whole source when not read by shards.
+    RecordStream* NewStream(db::Cursor* cursor, int shard) const;
+    // The index of the first key of the range of shard of this rank.
+    int ShardBegin(int shard) const;
 
     const LayerParameter param_;							
     BlockingQueue<shared_ptr<QueuePair> > new_queue_pairs_;
+    // With deterministic_read, makes the shards pass on their records in
+    // the order of the stream.
+    class sync;
+    shared_ptr<sync> sync_;
+    // Set with shuffle or reader_threads; the shards seek their ranges in
+    // the index, and derive the seeds of their orders from shuffle_seed_.
+    shared_ptr<KeyIndex> key_index_;
+    unsigned int shuffle_seed_;
+    // The number of shards, each a range of keys read by a thread of its own.
+    int num_shards_;
+    // Set with cache_mb; the decoded images, keyed by database key.
+    shared_ptr<ImageCache> cache_;
+    // The rank of the process, and the number of ranks the stream is split
+    // between: Caffe::world_size() when training, 1 for test nets.
+    const int world_rank_;
+    const int world_size_;
 
     friend class DataReader;
 
@@ -77,9 +125,12 @@ class DataReader
   };
 
   // A source is uniquely identified by its layer name + path, in case
-  // the same database is read from two different locations in the net.
-  static inline string source_key(const LayerParameter& param) {
-    return param.name() + ":" + param.data_param().source();
+  // the same database is read from two different locations in the net, and
+  // by the rank reading it, in case ranks share a process as in tests.
+  static inline string source_key(const LayerParameter& param, int rank) {
+    ostringstream key;
+    key << param.name() << ":" << param.data_param().source() << "@" << rank;
+    return key.str();
   }
 
   const shared_ptr<QueuePair> queue_pair_;
@@ -9,6 +9,18 @@
 
 namespace caffe {
 
+/**
+ * @brief The crop and mirror DataTransformer::CropRaw drew for an item, and
+ *    the size of the datum it was cropped from.
+ */
+struct RawCrop {
+  int h_off;
+  int w_off;
+  bool mirror;
+  int datum_height;
+  int datum_width;
+};
+
 /**
  * @brief Applies common transformations to the input data, such as
  * scaling, mirroring, substracting the image mean...
@@ -27,6 +39,14 @@ class DataTransformer {
    */
   void InitRand();
 
+  /**
+   * @brief Restarts the random number generator, if the transformation uses
+   *    one, from seed. This makes the transformation of a datum independent
+   *    of those before it. Unlike InitRand, it does not draw from the Caffe
+   *    random number generator.
+   */
+  void SeedRand(unsigned int seed);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to the data.
@@ -92,6 +112,29 @@ class DataTransformer {
    */
   void Transform(Blob<Dtype>* input_blob, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Crops the uint8 pixels of datum into raw, drawing the same crop
+   *    and mirror as Transform, and leaves the rest of the transformation to
+   *    TransformRaw.
+   *
+   * @param datum
+   *    Datum with uint8 data, not encoded.
+   * @param raw
+   *    Destination, with room for the pixels of the transformed datum.
+   * @param crop
+   *    Set to the crop and mirror drawn, to pass to TransformRaw.
+   */
+  void CropRaw(const Datum& datum, uint8_t* raw, RawCrop* crop);
+
+  /**
+   * @brief Finishes the transformation of the pixels CropRaw produced:
+   *    converts them to Dtype, mirrors them, subtracts the mean and scales
+   *    them, in a single pass over every row. The result is the same as
+   *    Transform's.
+   */
+  void TransformRaw(const uint8_t* raw, const RawCrop& crop, int channels,
+      int height, int width, Dtype* transformed_data);
+
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -46,7 +46,7 @@ class InternalThread {
 
  private:
   void entry(int device, Caffe::Brew mode, int rand_seed, int solver_count,
-      bool root_solver);
+      bool root_solver, int world_size, int world_rank);
 
   shared_ptr<boost::thread> thread_;
 };
@@ -317,6 +317,36 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward may be run again on the same bottoms
+   *        before Backward (see NetParameter.recompute_segments).
+   *
+   * Layers whose Forward draws random numbers or updates internal state
+   * (e.g. running statistics) should return false, as rerunning them would
+   * change their outputs or their state.
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
+  /**
+   * @brief Return whether Forward makes the tops share the data of
+   *        bottom[0] (e.g. Split), or Backward makes bottom[0] share the
+   *        diff of a top (e.g. Flatten).
+   *
+   * Blobs sharing memory this way are handled as one blob when the net
+   * reuses blob memory (see NetParameter.reuse_blobs), as the sharing is
+   * not visible yet when the net plans it.
+   */
+  virtual inline bool SharesBottomMemory() const { return false; }
+
+  /**
+   * @brief Return whether Forward writes to the blobs of the layer (e.g. the
+   *        running statistics of BatchNorm), rather than only reading them.
+   *
+   * Replicas training on threads of one process (see ThreadSync) keep their
+   * own copy of such blobs instead of sharing them.
+   */
+  virtual inline bool ForwardUpdatesBlobs() const { return false; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -1,6 +1,7 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -30,16 +31,46 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input. The CPU
+  // helpers use col_buffer_ unless another column buffer is given, so that
+  // several images can be processed at once.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, Dtype* col_buffer = NULL);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, Dtype* col_buffer = NULL);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, Dtype* col_buffer = NULL);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // forward_cpu_gemm in 8-bit integer arithmetic: the columns are quantized
+  // with input_scale into quantized_col, multiplied with the int8 weights
+  // into quantized_output, and scaled back by weight_scales per output
+  // channel. The weights of each group are packed transposed by
+  // caffe_cpu_gemm_s8_pack, one after the other. The quantized buffers have
+  // the size of a column buffer and of an output image.
+  void forward_cpu_gemm_s8(const Dtype* input, const int16_t* weights,
+      const Dtype* weight_scales, const Dtype input_scale, Dtype* output,
+      Dtype* col_buffer, int8_t* quantized_col, int32_t* quantized_output);
+
+  // Batch-parallel CPU support: the batch is cut into contiguous slices that
+  // are processed concurrently, each with its own column buffer.
+  /// @brief The number of slices to cut the batch into on the CPU.
+  int cpu_batch_slices();
+  /// @brief The images [begin, end) making up slice of num_slices.
+  inline void cpu_batch_slice(int slice, int num_slices, int* begin,
+      int* end) {
+    *begin = num_ * slice / num_slices;
+    *end = num_ * (slice + 1) / num_slices;
+  }
+  /// @brief One column buffer per slice; slice 0 uses col_buffer_.
+  void cpu_slice_col_buffers(int num_slices, vector<Dtype*>* col_buffers);
+  /// @brief One zeroed weight gradient per slice; slice 0 accumulates
+  ///        straight into weight_diff.
+  void cpu_slice_weight_diffs(int num_slices, Dtype* weight_diff,
+      vector<Dtype*>* weight_diffs);
+  /// @brief Adds the weight gradients of slices 1.. into slice 0.
+  void cpu_reduce_weight_diffs(const vector<Dtype*>& weight_diffs);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -92,6 +123,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  bool batch_parallel_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -167,6 +199,9 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+  // Extra column buffers and weight gradients for batch slices 1..
+  Blob<Dtype> slice_col_buffer_;
+  Blob<Dtype> slice_weight_diff_;
 };
 
 }  // namespace caffe
@@ -8,6 +8,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -80,6 +81,13 @@ template <typename Dtype>
 class Batch {
  public:
   Blob<Dtype> data_, label_;
+  // The tops after the first two, for layers that have more.
+  vector<shared_ptr<Blob<Dtype> > > extra_;
+  // Raw batches hold the cropped uint8 pixels of their items and the crop
+  // of each, instead of the contents of data_, which only gives the shape.
+  // The layer transforms them when it outputs the batch.
+  vector<uint8_t> raw_data_;
+  vector<RawCrop> raw_crops_;
 };
 
 template <typename Dtype>
@@ -100,18 +108,33 @@ class BasePrefetchingDataLayer :
       const vector<Blob<Dtype>*>& top);
 
   //读取数据肯定是cpu先去读取，根据是否有gpu去做同步，预读取的过程只需要数据异步同步即可
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  // Prefetches data_param().prefetch() batches (asynchronously if to GPU
+  // memory), or more with adaptive_prefetch.
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Pops the next loaded batch; the caller pushes it back to prefetch_free_.
+  Batch<Dtype>* NextBatch();
+  // With adaptive_prefetch, adds a batch shaped like batch to the queue if
+  // the net has been waiting for data.
+  void TunePrefetch(const Batch<Dtype>& batch);
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];					//读取解析好的数据（data和label都有）存放空间
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;				//读取解析好的数据（data和label都有）存放空间
   BlockingQueue<Batch<Dtype>*> prefetch_free_;				//提供batch的容器放在free里，初始化时分配好空间，每读取一条记录丢弃一个
   BlockingQueue<Batch<Dtype>*> prefetch_full_;				//预读取的数据的数据放在full里
 
   Blob<Dtype> transformed_data_;							//转换后的参数？？？？
+
+  // The state of adaptive_prefetch: the time spent waiting for batches and
+  // in whole iterations since the last adjustment.
+  bool tune_prefetch_;
+  CPUTimer wait_timer_;
+  CPUTimer iteration_timer_;
+  float wait_time_;
+  float iteration_time_;
+  int tune_iterations_;
+  float last_wait_fraction_;
 };
 
 }  // namespace caffe
@@ -49,6 +49,11 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// Without global stats, each forward pass updates the running averages.
+  virtual inline bool AllowRecompute() const { return use_global_stats_; }
+  virtual inline bool ForwardUpdatesBlobs() const {
+    return !use_global_stats_;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -59,6 +64,16 @@ class BatchNormLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Subtracts the channel means from the (num x channels) planes
+  ///        [begin, end), squaring the result into temp_data if given.
+  void CenterRange_cpu(const Dtype* bottom_data, const Dtype* mean_data,
+      Dtype* top_data, Dtype* temp_data, int spatial_dim, int begin, int end);
+  /// @brief Divides the (num x channels) planes [begin, end) by the channel
+  ///        standard deviations, caching them in temp_ and the result in
+  ///        x_norm_.
+  void NormalizeRange_cpu(const Dtype* std_data, Dtype* top_data,
+      Dtype* temp_data, Dtype* x_norm_data, int spatial_dim, int begin,
+      int end);
 
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
   bool use_global_stats_;
@@ -1,6 +1,7 @@
 #ifndef CAFFE_CONV_LAYER_HPP_
 #define CAFFE_CONV_LAYER_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -58,11 +59,31 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - engine: convolution has CAFFE (matrix multiplication), CUDNN (library
+   *    kernels + stream parallelism) and WINOGRAD (CPU Winograd transforms for
+   *    3x3 kernels and direct loops for depthwise convolution) engines.
+   *  - batch_parallel (\b optional, default true). Whether the CPU path splits
+   *    the batch across the intra-op threads, with one column buffer per
+   *    thread.
+   *  - fusion_param (\b optional). Set by NetParameter.fuse_layers; with a
+   *    relu_param, a ReLU is applied to the output as it is computed.
+   *  - quantization_param (\b optional). Set by `caffe quantize`; the CPU
+   *    forward pass then runs in 8-bit integer arithmetic. The weights are
+   *    quantized when it first runs and again after they change; with
+   *    release_float_weights only the int8 copy is kept, for deployment.
+   *
+   *  On the CPU, 2D convolutions without groups also accept input in the
+   *  channel-blocked layout (see Blob::channel_block()) when num_output is a
+   *  multiple of the channel block, and produce output in the same layout.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), channel_block_(1),
+        fused_relu_(false), relu_negative_slope_(0), quantized_(false),
+        bottom_scale_(0), quantized_version_(0) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
 
@@ -75,8 +96,67 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Backward_cpu of plain-layout tops and bottoms.
+  void PlainBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  /// @brief Forward_cpu over the batch slices [begin, end).
+  void ForwardSlices_cpu(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, const vector<Dtype*>& col_buffers,
+      int begin, int end);
+  /// @brief Backward_cpu over the batch slices [begin, end), accumulating the
+  ///        weight gradient of each slice into its own buffer.
+  void BackwardSlices_cpu(const Dtype* top_diff, const Dtype* bottom_data,
+      const Dtype* weight, Dtype* bottom_diff,
+      const vector<Dtype*>& col_buffers,
+      const vector<Dtype*>& weight_diffs, int begin, int end);
+
+  /// @brief Forward_cpu over the batch slices [begin, end) in 8-bit integer
+  ///        arithmetic, with one int8 column and int32 output buffer per
+  ///        slice.
+  void QuantizedForwardSlices_cpu(const Dtype* bottom_data, const Dtype* bias,
+      Dtype* top_data, const vector<Dtype*>& col_buffers, int begin, int end);
+  /// @brief Fills packed_weight_ and weight_scale_ from the filters, and
+  ///        releases them if the QuantizationParameter asks to.
+  void QuantizeWeights_cpu();
+
+  /// @brief Shapes the plain-layout views of blocked bottoms.
+  void ReshapePlainBottoms(const vector<Blob<Dtype>*>& bottom);
+  /// @brief Forward_cpu of blocked input over the (num x output channel
+  ///        blocks) planes [begin, end) by direct convolution, keeping the
+  ///        channel block in the innermost loops.
+  void BlockedForwardRange_cpu(const Dtype* bottom_data,
+      const Dtype* blocked_weight, const Dtype* bias, Dtype* top_data,
+      int begin, int end);
+
+  /// @brief The channel block of the input, 1 for the plain layout.
+  int channel_block_;
+  /// @brief Plain-layout views of blocked bottoms and tops; the convolution
+  ///        geometry is set up on these and the backward pass runs on them.
+  vector<shared_ptr<Blob<Dtype> > > plain_bottom_, plain_top_;
+  vector<Blob<Dtype>*> plain_bottom_vec_, plain_top_vec_;
+  /// @brief The filters as (num_output / b) x (channels / b) x kernel_h x
+  ///        kernel_w x b (input) x b (output) for blocked input.
+  Blob<Dtype> blocked_weight_;
+  /// @brief Whether a fused ReLU follows (see FusionParameter), and its slope.
+  bool fused_relu_;
+  Dtype relu_negative_slope_;
+  /// @brief Whether the CPU forward pass runs in 8 bits (see
+  ///        QuantizationParameter), and the scale mapping inputs to int8.
+  bool quantized_;
+  Dtype bottom_scale_;
+  /// @brief The int8 filters of each group, packed for caffe_cpu_gemm_s8,
+  ///        and the scale mapping each output channel back. They were
+  ///        quantized from the data quantized_memory_ of blobs_[0] at
+  ///        quantized_version_.
+  shared_ptr<SyncedMemory> quantized_memory_;
+  size_t quantized_version_;
+  vector<int16_t> packed_weight_;
+  vector<Dtype> weight_scale_;
+  vector<int8_t> quantized_col_;
+  vector<int32_t> quantized_output_;
 };
 
 }  // namespace caffe
@@ -11,6 +11,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -29,10 +30,32 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype>
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
 
+  // With raw_batch, these finish the transformation of each batch.
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  // Transforms the items of the batch that fall to worker, into top_data,
+  // or with raw_batch, into batch's raw data.
+  void TransformItems(int worker, const vector<Datum*>& datums,
+      const vector<unsigned int>& seeds, Batch<Dtype>* batch,
+      Dtype* top_data, Dtype* top_label);
+  void TransformWorkers(int begin, int end, const vector<Datum*>& datums,
+      const vector<unsigned int>& seeds, Batch<Dtype>* batch,
+      Dtype* top_data, Dtype* top_label);
 
   DataReader reader_;
+  const bool raw_batch_;
+  // With transform_threads > 1: the pool the items of a batch are
+  // transformed on, and a transformer, destination blob and timer for each
+  // worker.
+  shared_ptr<ThreadPool> transform_pool_;
+  vector<shared_ptr<DataTransformer<Dtype> > > worker_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > worker_transformed_data_;
+  vector<double> worker_trans_time_;
 };
 
 }  // namespace caffe
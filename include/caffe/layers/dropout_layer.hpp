@@ -39,6 +39,10 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  /// A recomputed forward pass would draw a different mask.
+  virtual inline bool AllowRecompute() const {
+    return this->phase_ != TRAIN;
+  }
 
  protected:
   /**
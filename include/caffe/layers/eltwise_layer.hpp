@@ -38,6 +38,13 @@ class EltwiseLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Forward_cpu over the element range [begin, end).
+  void ForwardRange_cpu(const vector<const Dtype*>& bottom_data,
+      Dtype* top_data, int* mask, int begin, int end);
+  /// @brief Backward_cpu over the element range [begin, end).
+  void BackwardRange_cpu(const vector<const Dtype*>& bottom_data,
+      const vector<Dtype*>& bottom_diff, const Dtype* top_data,
+      const Dtype* top_diff, const int* mask, int begin, int end);
 
   EltwiseParameter_EltwiseOp op_;
   vector<Dtype> coeffs_;
@@ -11,6 +11,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
 
 namespace caffe {
 
@@ -36,9 +37,14 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Returns the decoded image of filename from the cache, reading it into
+  // the cache on a miss.
+  shared_ptr<const Datum> ReadCachedImage(const string& filename);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Set with cache_mb.
+  shared_ptr<ImageCache> cache_;
 };
 
 
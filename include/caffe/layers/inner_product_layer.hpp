@@ -1,6 +1,7 @@
 #ifndef CAFFE_INNER_PRODUCT_LAYER_HPP_
 #define CAFFE_INNER_PRODUCT_LAYER_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -19,7 +20,7 @@ template <typename Dtype>
 class InnerProductLayer : public Layer<Dtype> {
  public:
   explicit InnerProductLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), quantized_version_(0) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -38,6 +39,9 @@ class InnerProductLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// Fills packed_weight_ and weight_scale_ from the weights, and releases
+  /// them if the QuantizationParameter asks to.
+  void QuantizeWeights_cpu();
 
   int M_;
   int K_;
@@ -45,6 +49,22 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// Whether a fused ReLU follows (see FusionParameter), and its slope.
+  bool fused_relu_;
+  Dtype relu_negative_slope_;
+  /// Whether the CPU forward pass runs in 8 bits (see QuantizationParameter),
+  /// and the scale mapping inputs to int8.
+  bool quantized_;
+  Dtype bottom_scale_;
+  /// The int8 weights packed for caffe_cpu_gemm_s8, and the scale mapping
+  /// each output back. They were quantized from the data quantized_memory_
+  /// of blobs_[0] at quantized_version_.
+  shared_ptr<SyncedMemory> quantized_memory_;
+  size_t quantized_version_;
+  vector<int16_t> packed_weight_;
+  vector<Dtype> weight_scale_;
+  vector<int8_t> quantized_bottom_;
+  vector<int32_t> quantized_top_;
 };
 
 }  // namespace caffe
@@ -55,6 +55,13 @@ class LRNLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief CrossChannelForward_cpu over the images [begin, end).
+  void CrossChannelForwardRange_cpu(const Dtype* bottom_data,
+      Dtype* scale_data, Dtype* top_data, int begin, int end);
+  /// @brief CrossChannelBackward_cpu over the images [begin, end).
+  void CrossChannelBackwardRange_cpu(const Dtype* top_diff,
+      const Dtype* top_data, const Dtype* bottom_data,
+      const Dtype* scale_data, Dtype* bottom_diff, int begin, int end);
 
   int size_;
   int pre_pad_;
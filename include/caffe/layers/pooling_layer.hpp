@@ -13,6 +13,9 @@ namespace caffe {
  * @brief Pools the input image by taking the max, average, etc. within regions.
  *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
+ *
+ * MAX and AVE pooling also accept input in the channel-blocked layout (see
+ * Blob::channel_block()) and then produce output in the same layout.
  */
 template <typename Dtype>
 class PoolingLayer : public Layer<Dtype> {
@@ -43,11 +46,27 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Forward_cpu over the (num x channels) planes [begin, end).
+  void ForwardRange_cpu(const Dtype* bottom_data, Dtype* top_data,
+      int* mask, Dtype* top_mask, int begin, int end);
+  /// @brief Backward_cpu over the (num x channels) planes [begin, end).
+  void BackwardRange_cpu(const Dtype* top_diff, const int* mask,
+      const Dtype* top_mask, Dtype* bottom_diff, int begin, int end);
+  /// @brief Forward_cpu of blocked input over the (num x channel blocks)
+  ///        planes [begin, end).
+  void BlockedForwardRange_cpu(const Dtype* bottom_data, Dtype* top_data,
+      int* mask, int begin, int end);
+  /// @brief Backward_cpu of blocked input over the (num x channel blocks)
+  ///        planes [begin, end).
+  void BlockedBackwardRange_cpu(const Dtype* top_diff, const int* mask,
+      Dtype* bottom_diff, int begin, int end);
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
   int channels_;
+  // The channel block of the input, 1 for the plain layout.
+  int channel_block_;
   int height_, width_;
   int pooled_height_, pooled_width_;
   bool global_pooling_;
@@ -38,6 +38,8 @@ class PythonLayer : public Layer<Dtype> {
     return this->layer_param_.python_param().share_in_parallel();
   }
 
+  /// The Python code may keep state across forward passes.
+  virtual inline bool AllowRecompute() const { return false; }
   virtual inline const char* type() const { return "Python"; }
 
  protected:
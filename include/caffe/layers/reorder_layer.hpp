@@ -0,0 +1,56 @@
+#ifndef CAFFE_REORDER_LAYER_HPP_
+#define CAFFE_REORDER_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Converts activations between the plain N x C x H x W layout and the
+ *        channel-blocked N x (C / b) x H x W x b layout (see
+ *        Blob::channel_block()).
+ *
+ * Net inserts these layers at the boundaries between layers that run in the
+ * blocked layout and those that do not when NetParameter channel_block is
+ * set; see InsertReorders.
+ */
+template <typename Dtype>
+class ReorderLayer : public Layer<Dtype> {
+ public:
+  /**
+   * @param param provides ReorderParameter reorder_param,
+   *     with ReorderLayer options:
+   *   - channel_block (\b optional, default 1). The channel block b of the
+   *     output; b > 1 blocks a plain input, 1 unblocks a blocked input.
+   */
+  explicit ReorderLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Reorder"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  // The plain tensor being (un)blocked, as num x channels x spatial_dim.
+  int num_;
+  int channels_;
+  int spatial_dim_;
+  int channel_block_;
+  // Whether the layer blocks its input (as opposed to unblocking it).
+  bool to_blocked_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_REORDER_LAYER_HPP_
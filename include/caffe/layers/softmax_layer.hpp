@@ -35,6 +35,12 @@ class SoftmaxLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  /// @brief Forward_cpu over the outer indices [begin, end).
+  void ForwardRange_cpu(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* scale_data, int begin, int end);
+  /// @brief Backward_cpu over the outer indices [begin, end).
+  void BackwardRange_cpu(const Dtype* top_diff, const Dtype* top_data,
+      Dtype* bottom_diff, Dtype* scale_data, int begin, int end);
 
   int outer_num_;
   int inner_num_;
@@ -0,0 +1,76 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/*
+ * @brief CPU convolution engine for small kernels that avoids im2col.
+ *        Falls back to ConvolutionLayer where no special path applies.
+ *
+ * Dense 2D 3x3 convolutions with stride 1 and no dilation are computed with
+ * Winograd's minimal filtering algorithm F(2x2, 3x3): every 4x4 input tile
+ * and 3x3 filter is transformed so that a 2x2 output tile takes 16
+ * multiplications instead of 36, and the products over input channels become
+ * 16 small GEMMs. The transformed input is 16/4 = 4 times the input size
+ * rather than the 9 times of the im2col buffer.
+ *
+ * Grouped 2D convolutions with few input channels per group (e.g. depthwise
+ * convolution) are computed by direct loops over the filter taps, where
+ * im2col + GEMM would degenerate into many tiny matrix products.
+ *
+ * Only the forward pass is specialized; the backward pass and the GPU paths
+ * are those of ConvolutionLayer.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), algorithm_(GEMM) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Whether conv_param describes a convolution that the Winograd or
+  ///        the direct path can handle, judging from the parameters alone.
+  static bool IsSupported(const ConvolutionParameter& conv_param);
+
+  /// @brief The input channels per group up to which the direct path is used.
+  static const int kMaxDirectGroupChannels = 4;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Computes the 16 transformed filter matrices U (K x C each).
+  void TransformWeights_cpu(const Dtype* weight);
+  /// @brief Winograd forward pass over the batch slices [begin, end); each
+  ///        slice uses its part of input_tiles and output_tiles.
+  void WinogradSlices_cpu(const Dtype* bottom_data,
+      const Dtype* transformed_weight, const Dtype* bias, Dtype* top_data,
+      Dtype* input_tiles, Dtype* output_tiles, int begin, int end);
+  /// @brief Direct forward pass over the output planes [begin, end) of the
+  ///        whole batch.
+  void DirectRange_cpu(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int begin, int end);
+
+  enum Algorithm { GEMM, WINOGRAD, DIRECT };
+  Algorithm algorithm_;
+  int tiles_h_, tiles_w_;
+  /// @brief The filters in the Winograd domain, 16 x K x C.
+  Blob<Dtype> transformed_weight_;
+  /// @brief Per-slice input tiles in the Winograd domain, 16 x C x tiles.
+  Blob<Dtype> transformed_input_;
+  /// @brief Per-slice output tiles in the Winograd domain, 16 x K x tiles.
+  Blob<Dtype> transformed_output_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
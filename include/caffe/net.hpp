@@ -178,6 +178,24 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /// @brief Whether the data and diffs of learnable_params() are slices of
+  ///        two contiguous buffers (see NetParameter.flat_params).
+  inline bool flat_params() const { return flat_param_data_ != NULL; }
+  /// @brief The number of elements of the flat param buffers.
+  inline size_t flat_param_count() const { return flat_param_count_; }
+  /**
+   * @brief The host buffer holding the data of all learnable_params() back to
+   *        back, if flat_params().
+   *
+   * The CPU data of every param is brought up to date first. A param that
+   * was reshaped to a larger size, or made to share another blob's data, no
+   * longer aliases the buffer, which is an error.
+   */
+  const Dtype* flat_param_data();
+  Dtype* mutable_flat_param_data();
+  /// @brief Like flat_param_data, for the diffs.
+  const Dtype* flat_param_diff();
+  Dtype* mutable_flat_param_diff();
   /// @brief returns the learnable parameter learning rate multipliers
   inline const vector<float>& params_lr() const { return params_lr_; }
   inline const vector<bool>& has_params_lr() const { return has_params_lr_; }
@@ -192,6 +210,15 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief The layer and the index within it of each of params().
+  inline const vector<pair<int, int> >& param_layer_indices() const {
+    return param_layer_indices_;
+  }
+  /// @brief The index in learnable_params() of each of params(), or of its
+  ///        owner for a shared param.
+  inline const vector<int>& learnable_param_ids() const {
+    return learnable_param_ids_;
+  }
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
@@ -217,6 +244,26 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  // Invoked at specific points of Backward
+  class Callback {
+   protected:
+    virtual void run(int layer) = 0;
+
+    template <typename T>
+    friend class Net;
+  };
+  const vector<Callback*>& after_backward() const { return after_backward_; }
+  /**
+   * @brief Adds a callback that BackwardFromTo runs after each layer, even
+   *        those that need no backward. Once it runs for layer i, the diffs
+   *        of the params of layer i hold their gradient for this pass unless
+   *        a lower layer shares them, so data parallelism can start reducing
+   *        them while the lower layers backpropagate.
+   */
+  void add_after_backward(Callback* value) {
+    after_backward_.push_back(value);
+  }
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -242,6 +289,31 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /// @brief Finds the blobs whose memory may be shared with other blobs
+  ///        (see NetParameter.reuse_blobs and recompute_segments), and when
+  ///        they are used.
+  void InitBlobReuse(const NetParameter& param);
+  /// @brief Splits the layers into the segments recomputed in Backward.
+  void InitRecomputeSegments(const int num_segments,
+      const vector<int>& blob_groups, const vector<int>& group_producers);
+  /// @brief Assigns the reusable blobs to shared buffers such that no two
+  ///        blobs with overlapping lifetimes share one.
+  void PlanBlobMemory();
+  /// @brief Moves the data and diffs of the learnable params into the flat
+  ///        buffers if NetParameter.flat_params is set.
+  void InitFlatParams(const NetParameter& param);
+  /// @brief Returns the flat data or diff buffer, checking that the params
+  ///        still alias it.
+  Dtype* FlatParams(const bool diff, const bool for_write);
+
+  /// @brief Puts the unshared parameters of TEST nets in the storage format
+  ///        of their ParamSpec.
+  void ApplyParamStorage();
+  /// @brief Folds the trained blobs of the layers merged by
+  ///        NetParameter.fuse_layers, by name, into the layers they follow.
+  void FoldTrainedLayers(
+      const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -257,6 +329,9 @@ class Net {
   vector<shared_ptr<Layer<Dtype> > > layers_;
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
+  /// The layers merged into others by NetParameter.fuse_layers, mapped to
+  /// the id of the layer each one was merged into.
+  map<string, int> folded_layer_owners_;
   vector<bool> layer_need_backward_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
@@ -302,8 +377,28 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The buffers holding the data and diffs of learnable_params_ when
+  /// NetParameter.flat_params is set, and their number of elements.
+  shared_ptr<SyncedMemory> flat_param_data_;
+  shared_ptr<SyncedMemory> flat_param_diff_;
+  size_t flat_param_count_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// Groups of blobs that alias the same memory and may share it with other
+  /// groups, and the first and the last layer using each group.
+  vector<vector<int> > reuse_groups_;
+  vector<pair<int, int> > reuse_group_lifetimes_;
+  /// The same for the diffs, which are only shared when recomputing.
+  vector<vector<int> > reuse_diff_groups_;
+  vector<pair<int, int> > reuse_diff_group_lifetimes_;
+  /// The first and the last layer of each segment, whether Backward reruns
+  /// its forward pass, and the recomputed segment whose blobs currently hold
+  /// valid data (-1 if none).
+  vector<pair<int, int> > recompute_segments_;
+  vector<bool> segment_recompute_;
+  int live_segment_;
+  /// The callbacks run after the backward pass of each layer.
+  vector<Callback*> after_backward_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
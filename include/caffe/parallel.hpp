@@ -13,6 +13,13 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/ring_comm.hpp"
+
+/**
+ Forward declare boost::barrier instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class barrier; }
 
 namespace caffe {
 
@@ -116,6 +123,106 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   using Params<Dtype>::diff_;
 };
 
+// Data parallelism between threads of this process on CPU. The root solver
+// runs on the calling thread and each other replica on a thread of its own,
+// with a net sharing the weights of the root net (see
+// Net::ShareTrainedLayersWith) and reading its share of the Data layers.
+// Synchronous mode averages the gradients of the replicas into the root
+// solver, which alone updates the weights; blobs that Forward updates (see
+// Layer::ForwardUpdatesBlobs) are kept per replica and averaged with them.
+// With hogwild every replica is a full solver that updates the shared
+// weights as it goes, without locks.
+template<typename Dtype>
+class ThreadSync : public Solver<Dtype>::Callback, public InternalThread {
+ public:
+  // With root NULL, wraps root_solver; otherwise creates replica index of
+  // root.
+  ThreadSync(shared_ptr<Solver<Dtype> > root_solver, ThreadSync<Dtype>* root,
+             int index, bool hogwild);
+  virtual ~ThreadSync();
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+
+  // Trains with num_threads replicas, this one included. Caffe::solver_count()
+  // must have been num_threads when the root solver was created.
+  void Run(int num_threads);
+
+ protected:
+  // Waits for the root to have updated the weights.
+  void on_start();
+  // Averages the gradients into the root's diffs, and the states over all
+  // replicas: each replica sums a slice of every param and state.
+  void on_gradients_ready();
+
+  void InternalThreadEntry();
+
+  ThreadSync<Dtype>* const root_;
+  const int index_;
+  const bool hogwild_;
+  const int initial_iter_;
+  shared_ptr<Solver<Dtype> > solver_;
+  // The diffs of the params of this replica, published for the averaging.
+  vector<Dtype*> diffs_;
+  // In synchronous mode, the blobs of this replica that Forward updates, and
+  // their data, published for the averaging.
+  vector<Blob<Dtype>*> states_;
+  vector<Dtype*> state_data_;
+  // Root only: all the replicas by index, and the barrier they meet at.
+  vector<ThreadSync<Dtype>*> replicas_;
+  shared_ptr<boost::barrier> barrier_;
+};
+
+// Synchronous data parallelism between processes, possibly on different
+// machines: the gradients of all ranks are summed with a ring allreduce over
+// comm, so that every rank applies the same update to the same weights.
+// Needs the train net to keep its params flat (see NetParameter.flat_params),
+// which Solver does when Caffe::world_size() > 1.
+//
+// The gradients are reduced in buckets. In CPU mode a thread reduces each
+// bucket as soon as Backward has gone past the lowest layer writing to it,
+// so the reduction of the last layers overlaps the backward pass of the
+// first ones.
+template<typename Dtype>
+class RingSync : public Solver<Dtype>::Callback, public Net<Dtype>::Callback,
+    public InternalThread {
+ public:
+  RingSync(shared_ptr<Solver<Dtype> > solver, shared_ptr<RingComm> comm,
+           size_t bucket_bytes = 4 << 20);
+  virtual ~RingSync();
+
+ protected:
+  // Before the first iteration, copies the weights and the solver history of
+  // rank 0 to the other ranks.
+  void on_start();
+  void on_gradients_ready();
+  // Queues the buckets whose gradients are final once layer is done.
+  void run(int layer);
+
+  void InternalThreadEntry();
+  // Sums bucket over the ranks and averages it.
+  void Reduce(int bucket);
+  void Queue(int bucket);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  shared_ptr<RingComm> comm_;
+  // Bucket b holds the diffs from b * bucket_size_ up to the next bucket.
+  const size_t bucket_size_;
+  int num_buckets_;
+  // For each layer, the buckets it is the lowest layer to write to.
+  vector<vector<int> > layer_buckets_;
+  const bool overlap_;
+  bool synced_;
+  Dtype* diff_;
+  // The backward passes of the current iteration so far, and the buckets
+  // queued for the thread.
+  int backward_passes_;
+  vector<bool> queued_;
+  BlockingQueue<int> ready_;
+  BlockingQueue<int> reduced_;
+};
+
 }  // namespace caffe
 
 #endif
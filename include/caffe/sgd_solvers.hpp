@@ -2,12 +2,33 @@
 #define CAFFE_SGD_SOLVERS_HPP_
 
 #include <string>
+#include <typeinfo>
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+/**
+ * @brief The gradient normalization and weight decay of one parameter,
+ *        applied element-wise by the fused CPU updates.
+ *
+ * Only one of l2_decay and l1_decay is nonzero, so that the same loop serves
+ * both regularization types.
+ */
+template <typename Dtype>
+struct DiffRegularizer {
+  Dtype normalization;
+  Dtype l2_decay;
+  Dtype l1_decay;
+
+  inline Dtype operator()(Dtype data, Dtype diff) const {
+    return normalization * diff + l2_decay * data +
+        l1_decay * caffe_sign(data);
+  }
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -31,6 +52,16 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  // In CPU mode, Normalize, Regularize, ComputeUpdateValue and the weight
+  // update of Net::Update are done by FusedUpdate in one pass over the
+  // parameter, its diff and its history, if HasFusedUpdate. Each built-in
+  // solver only claims that for its own type, so a subclass that overrides
+  // the separate steps runs them unless it overrides both functions.
+  virtual inline bool HasFusedUpdate() const {
+    return typeid(*this) == typeid(SGDSolver);
+  }
+  virtual void FusedUpdate(int param_id, Dtype rate);
+  DiffRegularizer<Dtype> Regularizer(int param_id) const;
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -56,6 +87,10 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool HasFusedUpdate() const {
+    return typeid(*this) == typeid(NesterovSolver);
+  }
+  virtual void FusedUpdate(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +106,10 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool HasFusedUpdate() const {
+    return typeid(*this) == typeid(AdaGradSolver);
+  }
+  virtual void FusedUpdate(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +130,10 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool HasFusedUpdate() const {
+    return typeid(*this) == typeid(RMSPropSolver);
+  }
+  virtual void FusedUpdate(int param_id, Dtype rate);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +158,10 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool HasFusedUpdate() const {
+    return typeid(*this) == typeid(AdaDeltaSolver);
+  }
+  virtual void FusedUpdate(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +186,10 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual inline bool HasFusedUpdate() const {
+    return typeid(*this) == typeid(AdamSolver);
+  }
+  virtual void FusedUpdate(int param_id, Dtype rate);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -13,6 +13,9 @@ namespace caffe {
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
 
+// The alignment in bytes of host memory from CaffeMallocHost.
+const size_t kHostAlignment = 64;
+
 	//caffe在机器上分配和释放内存，如果机器上有gpu，也包括使用cuda进行分配和释放内存
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
@@ -22,7 +25,11 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
-  *ptr = malloc(size);
+  // Aligned to a cache line, so that SIMD kernels can load whole vectors
+  // of channel blocks and rows without splitting them.
+  if (posix_memalign(ptr, kHostAlignment, size) != 0) {
+    *ptr = NULL;
+  }
   *use_cuda = false;
   CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
@@ -49,11 +56,11 @@ class SyncedMemory {
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(0) {}
   ~SyncedMemory();
   const void* cpu_data();				//获取cpu的data，注意const
   void set_cpu_data(void* data);		//设置cpu的data
@@ -64,6 +71,10 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED }; //定义了四中cpu和gpu数据更新状态
   SyncedHead head() { return head_; }	//获取数据众泰
   size_t size() { return size_; }		//获取data的size
+  /// @brief A count of the writes to the data, through mutable_cpu_data(),
+  ///        mutable_gpu_data(), set_cpu_data() or set_gpu_data(), for caches
+  ///        of values derived from it.
+  size_t version() { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);  //异步向cuda数据流推送cpu中的数据，即异步更新数据到gpu
@@ -82,6 +93,7 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;    //是否使用cuda分配内存
   bool own_gpu_data_;			//是否使用了gpu操作数据
   int gpu_device_;				//可以使用多卡，记录使用所在的gpu卡设备编号
+  size_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
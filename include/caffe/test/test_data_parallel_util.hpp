@@ -0,0 +1,70 @@
+#ifndef CAFFE_TEST_TEST_DATA_PARALLEL_UTIL_HPP_
+#define CAFFE_TEST_TEST_DATA_PARALLEL_UTIL_HPP_
+
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+// The source and net the tests of data parallelism (RingSync, ThreadSync)
+// train on, small enough that a few iterations can be compared with those
+// of a single solver.
+
+// Writes 8 records of 1 x 1 x 4 floats, labeled 0 or 1, to a PACKED DB in a
+// new temporary directory, and returns its path.
+inline string MakeDataParallelSource() {
+  string root;
+  MakeTempDir(&root);
+  const string source = root + "/db";
+  boost::scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_PACKED));
+  db->Open(source, db::NEW);
+  boost::scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  for (int i = 0; i < 8; ++i) {
+    Datum datum;
+    datum.set_channels(1);
+    datum.set_height(1);
+    datum.set_width(4);
+    for (int j = 0; j < 4; ++j) {
+      datum.add_float_data((i * 3 + j) % 5 - 2);
+    }
+    datum.set_label(i % 3 == 0);
+    string value;
+    datum.SerializeToString(&value);
+    txn->Put(format_int(i, 2), value);
+  }
+  txn->Commit();
+  return source;
+}
+
+// The net_param of a SolverParameter, as text: two InnerProduct layers and a
+// softmax loss on batches of batch_size records of source, followed by
+// extra_layers.
+inline string DataParallelNetProto(const string& source, int batch_size,
+    const string& extra_layers = "") {
+  return
+      "net_param { "
+      "  layer { name: 'data' type: 'Data' top: 'data' top: 'label' "
+      "    data_param { source: '" + source + "' backend: PACKED "
+      "      batch_size: " + format_int(batch_size) + " } } "
+      "  layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' "
+      "    top: 'ip1' inner_product_param { num_output: 3 "
+      "      weight_filler { type: 'gaussian' std: 0.1 } "
+      "      bias_filler { type: 'gaussian' std: 0.1 } } } "
+      "  layer { name: 'ip2' type: 'InnerProduct' bottom: 'ip1' "
+      "    top: 'ip2' inner_product_param { num_output: 2 "
+      "      weight_filler { type: 'gaussian' std: 0.1 } "
+      "      bias_filler { type: 'gaussian' std: 0.1 } } } "
+      "  layer { name: 'loss' type: 'SoftmaxWithLoss' bottom: 'ip2' "
+      "    bottom: 'label' top: 'loss' } " + extra_layers + "} ";
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_TEST_TEST_DATA_PARALLEL_UTIL_HPP_
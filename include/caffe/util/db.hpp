@@ -15,11 +15,26 @@ class Cursor {
   Cursor() { }
   virtual ~Cursor() { }
   virtual void SeekToFirst() = 0;
+  /// @brief Moves to the record with the given key, which must exist.
+  virtual void Seek(const string& key) = 0;
   virtual void Next() = 0;
   virtual string key() = 0;
   virtual string value() = 0;
+  /**
+   * @brief Points data and size at the value of the current record. Backends
+   *        that hold the value in memory do so without copying it; the view
+   *        is valid until the cursor is moved or destroyed.
+   */
+  virtual void value_view(const char** data, size_t* size) {
+    value_ = value();
+    *data = value_.data();
+    *size = value_.size();
+  }
   virtual bool valid() = 0;
 
+ protected:
+  string value_;
+
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
 
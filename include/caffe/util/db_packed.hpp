@@ -0,0 +1,135 @@
+#ifndef CAFFE_UTIL_DB_PACKED_HPP
+#define CAFFE_UTIL_DB_PACKED_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * @brief A packed record file, made for fast sequential reads.
+ *
+ * The file is a sequence of segments, each written while a PackedDB was open
+ * in NEW or WRITE mode:
+ *
+ *     chunk* chunk_index trailer
+ *
+ * A chunk holds the records of one committed transaction, each stored as its
+ * key size and value size (uint32), then the key and the value. The chunk
+ * index gives the offset within the segment, the size in bytes and the
+ * number of records of every chunk, and the trailer the number of chunks,
+ * the size of the segment and a magic number (all uint64). Integers are in
+ * host byte order.
+ *
+ * Readers find the segments from the end of the file, so packed files can be
+ * concatenated, and WRITE mode appends a segment. Records are read in the
+ * order they were written. The file is memory-mapped: cursors return values
+ * in place and ask the kernel to read the next chunk ahead.
+ */
+struct PackedChunk {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t num_records;
+};
+
+class PackedDB;
+
+class PackedCursor : public Cursor {
+ public:
+  explicit PackedCursor(const PackedDB* db) : db_(db) { SeekToFirst(); }
+  virtual void SeekToFirst() { EnterChunk(0); }
+  virtual void Seek(const string& key);
+  virtual void Next();
+  virtual string key() { return string(record() + kHeaderSize, key_size()); }
+  virtual string value() {
+    return string(record() + kHeaderSize + key_size(), value_size());
+  }
+  // Points into the memory map, which stays valid while the db is open.
+  virtual void value_view(const char** data, size_t* size) {
+    *data = record() + kHeaderSize + key_size();
+    *size = value_size();
+  }
+  virtual bool valid();
+
+  // The key size and value size before each record.
+  static const int kHeaderSize = 2 * sizeof(uint32_t);
+
+ private:
+  // Moves to the first record of the first non-empty chunk from chunk on.
+  void EnterChunk(int chunk);
+  const char* record() const;
+  uint32_t key_size() const;
+  uint32_t value_size() const;
+
+  const PackedDB* db_;
+  int chunk_;
+  uint64_t index_;
+  uint64_t offset_;
+
+  friend class PackedDB;
+};
+
+class PackedTransaction : public Transaction {
+ public:
+  explicit PackedTransaction(PackedDB* db) : db_(db), num_records_(0) { }
+  virtual void Put(const string& key, const string& value);
+  // Appends the records put so far to the file as one chunk.
+  virtual void Commit();
+
+ private:
+  PackedDB* db_;
+  string chunk_;
+  uint64_t num_records_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedTransaction);
+};
+
+class PackedDB : public DB {
+ public:
+  PackedDB() : file_(NULL), data_(NULL), size_(0) { }
+  virtual ~PackedDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  // In NEW and WRITE mode, writes the chunk index and trailer of the segment.
+  virtual void Close();
+  virtual PackedCursor* NewCursor();
+  virtual PackedTransaction* NewTransaction();
+
+ private:
+  void OpenRead(const string& source);
+  void AppendChunk(const string& chunk, uint64_t num_records);
+  // Sets cursor at the first record with key; indexes the keys on first use.
+  bool Find(const string& key, PackedCursor* cursor) const;
+
+  string source_;
+  // Writing
+  FILE* file_;
+  uint64_t segment_size_;
+  vector<PackedChunk> written_;
+  // Reading
+  const char* data_;
+  size_t size_;
+  vector<PackedChunk> chunks_;
+  struct Position {
+    int chunk;
+    uint64_t index;
+    uint64_t offset;
+  };
+  mutable boost::mutex keys_mutex_;
+  mutable std::map<string, Position> keys_;
+
+  friend class PackedCursor;
+  friend class PackedTransaction;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_PACKED_HPP
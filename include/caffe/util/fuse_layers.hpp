@@ -0,0 +1,37 @@
+#ifndef _CAFFE_UTIL_FUSE_LAYERS_HPP_
+#define _CAFFE_UTIL_FUSE_LAYERS_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the BatchNorm, Scale and Bias layers that directly
+// follow a Convolution or InnerProduct layer merged into it, along with a
+// ReLU ending such a chain. The merged layers are recorded in the
+// fusion_param of the remaining layer, which takes over the top of the last
+// merged layer; their trained parameters are folded in by the Net when it
+// copies trained layers.
+void FuseLayers(const NetParameter& param, NetParameter* param_fused);
+
+// Whether a layer's trained parameters can take in the per-channel affine
+// transform of a following BatchNorm, Scale or Bias layer.
+bool SupportsFolding(const LayerParameter& layer_param);
+
+// Whether a layer is a per-channel affine transform that can be folded into
+// the preceding layer.
+bool IsFoldable(const LayerParameter& layer_param);
+
+// Folds the per-channel affine transform of a BatchNorm, Scale or Bias layer,
+// given its parameters and trained blobs, into the weights and the bias of
+// the layer it follows.
+template <typename Dtype>
+void FoldTrainedLayer(const LayerParameter& folded_param,
+    const vector<shared_ptr<Blob<Dtype> > >& folded_blobs,
+    Blob<Dtype>* weight, Blob<Dtype>* bias);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_FUSE_LAYERS_HPP_
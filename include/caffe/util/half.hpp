@@ -0,0 +1,113 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+#include <cstring>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Conversions between fp32 and the 16-bit storage formats of
+// BlobProto.Storage: IEEE half precision (FLOAT16) and the upper half of an
+// fp32 (BFLOAT16). Both round to nearest even; arithmetic on the values is
+// always done after converting them back.
+
+inline uint16_t caffe_float_to_fp16(float value) {
+  uint32_t x;
+  std::memcpy(&x, &value, sizeof(x));
+  const uint32_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x > 0x7f800000) {
+    return sign | 0x7e00;  // NaN
+  }
+  if (x >= 0x47800000) {
+    return sign | 0x7c00;  // Overflows to infinity.
+  }
+  if (x < 0x38800000) {
+    // Subnormal in half precision, or rounds to zero.
+    if (x < 0x33000000) {
+      return sign;
+    }
+    const uint32_t shift = 126 - (x >> 23);
+    const uint32_t mantissa = (x & 0x7fffff) | 0x800000;
+    uint32_t h = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (h & 1))) {
+      ++h;
+    }
+    return sign | h;
+  }
+  // Rebias the exponent from 127 to 15; rounding may carry into it.
+  uint32_t h = (x - 0x38000000) >> 13;
+  const uint32_t rest = x & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+    ++h;
+  }
+  return sign | h;
+}
+
+inline float caffe_fp16_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t x;
+  if (exponent == 0x1f) {
+    x = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    x = sign;
+  } else {
+    // Normalize the subnormal.
+    exponent = 113;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      --exponent;
+    }
+    x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float value;
+  std::memcpy(&value, &x, sizeof(value));
+  return value;
+}
+
+inline uint16_t caffe_float_to_bf16(float value) {
+  uint32_t x;
+  std::memcpy(&x, &value, sizeof(x));
+  if ((x & 0x7fffffff) > 0x7f800000) {
+    return (x >> 16) | 0x40;  // Keep NaNs quiet.
+  }
+  x += 0x7fff + ((x >> 16) & 1);
+  return x >> 16;
+}
+
+inline float caffe_bf16_to_float(uint16_t h) {
+  const uint32_t x = static_cast<uint32_t>(h) << 16;
+  float value;
+  std::memcpy(&value, &x, sizeof(value));
+  return value;
+}
+
+inline float caffe_half_to_float(uint16_t h, BlobProto_Storage storage) {
+  return storage == BlobProto_Storage_BFLOAT16 ?
+      caffe_bf16_to_float(h) : caffe_fp16_to_float(h);
+}
+
+// Converts n values to or from a 16-bit storage format.
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, BlobProto_Storage storage, const Dtype* x,
+    uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, BlobProto_Storage storage,
+    const uint16_t* x, Dtype* y);
+
+// Rewrites the data of a BlobProto in a 16-bit storage format; the diff, if
+// any, is kept as it is.
+void CompressBlobProto(BlobProto_Storage storage, BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
@@ -2,14 +2,32 @@
 #define CAFFE_UTIL_HDF5_H_
 
 #include <string>
+#include <vector>
 
 #include "hdf5.h"
 #include "hdf5_hl.h"
 
 #include "caffe/blob.hpp"
 
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class recursive_mutex; }
+
 namespace caffe {
 
+/**
+ * @brief The lock to hold while calling the HDF5 library, which is usually
+ *        not built thread-safe, as HDF5Data layers read on threads of their
+ *        own. It is recursive, so that functions holding it can call others
+ *        that take it too.
+ */
+boost::recursive_mutex& hdf5_mutex();
+
+vector<int> hdf5_get_dataset_shape(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim);
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,6 +38,12 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob);
 
+// Reads num rows (slices along the first axis) from row first on.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, hsize_t first, hsize_t num,
+    Blob<Dtype>* blob);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
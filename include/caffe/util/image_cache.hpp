@@ -0,0 +1,70 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A bounded in-memory cache of decoded images, so that the data
+ *        layers only decode each image once when the dataset fits in it.
+ *
+ * Images are stored as datums that are not encoded, under the name the data
+ * layer reads them by: a file name or a database key. When the images take
+ * more than the capacity, the least recently used ones are evicted. The cache
+ * is safe to use from several threads.
+ */
+class ImageCache {
+ public:
+  explicit ImageCache(uint64_t capacity_bytes);
+  ~ImageCache();
+
+  /// Returns the image cached under key, or NULL, and counts a hit or miss.
+  shared_ptr<const Datum> Get(const string& key);
+  /// Caches datum under key, unless it is larger than the whole capacity.
+  void Put(const string& key, const shared_ptr<const Datum>& datum);
+
+  inline uint64_t capacity_bytes() const { return capacity_bytes_; }
+  uint64_t hits() const;
+  uint64_t misses() const;
+  uint64_t size_bytes() const;
+  int size() const;
+  /// Hits, misses and size, for the log.
+  string stats() const;
+
+ private:
+  // The bytes counted for an entry.
+  static uint64_t EntryBytes(const string& key, const Datum& datum);
+
+  typedef std::list<std::pair<string, shared_ptr<const Datum> > > LRUList;
+
+  const uint64_t capacity_bytes_;
+  // Guards the members below.
+  shared_ptr<boost::mutex> mutex_;
+  // Most recently used first.
+  LRUList entries_;
+  std::map<string, LRUList::iterator> index_;
+  uint64_t size_bytes_;
+  uint64_t hits_;
+  uint64_t misses_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
@@ -0,0 +1,26 @@
+#ifndef _CAFFE_UTIL_INSERT_REORDERS_HPP_
+#define _CAFFE_UTIL_INSERT_REORDERS_HPP_
+
+#include <string>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters so that the layers able to run in the channel-blocked
+// layout of param.channel_block() do so, with ReorderLayers added where
+// activations pass between blocked and plain layers. Net outputs and loss
+// tops stay in the plain layout under their original names.
+void InsertReorders(const NetParameter& param, NetParameter* param_reordered);
+
+// Whether a layer can take input and produce output in the blocked layout.
+bool SupportsChannelBlock(const LayerParameter& layer_param,
+    const int channel_block);
+
+void ConfigureReorderLayer(const string& blob_name,
+    const string& reordered_blob_name, const int channel_block,
+    LayerParameter* reorder_layer_param);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_INSERT_REORDERS_HPP_
@@ -7,6 +7,7 @@
 #include "glog/logging.h"
 
 #include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
 #include "caffe/util/device_alternate.hpp"
 #include "caffe/util/mkl_alternate.hpp"
 
@@ -25,6 +26,22 @@ void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
     Dtype* y);
 
+// caffe_cpu_gemm and caffe_cpu_gemv with the matrix B, respectively A, held
+// in a 16-bit storage format (see Blob::storage()). It is converted a panel
+// of rows at a time, so that it is read from memory at 16 bits while the
+// products are accumulated in Dtype.
+template <typename Dtype>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype alpha, const Dtype* A,
+    const uint16_t* B, const BlobProto_Storage storage, const Dtype beta,
+    Dtype* C);
+
+template <typename Dtype>
+void caffe_cpu_gemv_half(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const Dtype alpha, const uint16_t* A,
+    const BlobProto_Storage storage, const Dtype* x, const Dtype beta,
+    Dtype* y);
+
 template <typename Dtype>
 void caffe_axpy(const int N, const Dtype alpha, const Dtype* X,
     Dtype* Y);
@@ -142,6 +159,57 @@ DEFINE_CAFFE_CPU_UNARY_FUNC(fabs, y[i] = std::fabs(x[i]));
 template <typename Dtype>
 void caffe_cpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+// Convert between the plain num x channels x spatial_dim layout and the
+// channel-blocked num x (channels / block) x spatial_dim x block layout
+// (see Blob::channel_block()). channels must be a multiple of block.
+template <typename Dtype>
+void caffe_cpu_block_channels(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* plain,
+    Dtype* blocked);
+
+template <typename Dtype>
+void caffe_cpu_unblock_channels(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* blocked,
+    Dtype* plain);
+
+// In-place ReLU, x = max(x, 0) + negative_slope * min(x, 0), for layers that
+// apply a fused ReLU to their output (see FusionParameter).
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype negative_slope, Dtype* x);
+
+// Multiplies dy by the gradient of caffe_cpu_relu, given its output y.
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype negative_slope,
+    const Dtype* y, Dtype* dy);
+
+// Symmetric 8-bit quantization, y = round(x * scale) saturated to
+// [-127, 127], for layers run with a QuantizationParameter.
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y);
+
+// Quantizes each row of the M x K matrix A with its own scale, chosen so that
+// the row's largest magnitude maps to 127, and stores in scales the factors
+// mapping the quantized rows back.
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int M, const int K, const Dtype* A,
+    int8_t* y, Dtype* scales);
+
+// Integer gemm, C = op(A) * B, of the row-major M x K int8 matrix op(A) and
+// the K x N int8 matrix B, accumulated into the M x N int32 matrix C. B is
+// first rearranged by caffe_cpu_gemm_s8_pack into caffe_cpu_gemm_s8_packed_size
+// int16 entries, so that constant weights are packed once. With AVX2 the
+// products are computed 16 at a time by 16-bit multiply-adds.
+int caffe_cpu_gemm_s8_packed_size(const int K, const int N);
+void caffe_cpu_gemm_s8_pack(const CBLAS_TRANSPOSE TransB, const int K,
+    const int N, const int8_t* B, int16_t* packed_B);
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const int K, const int8_t* A, const int16_t* packed_B,
+    int32_t* C);
+
+// Whether the CPU runs AVX2 and FMA code, for the kernels compiled for them.
+bool caffe_cpu_has_avx2();
+
 #ifndef CPU_ONLY  // GPU
 
 // Decaf gpu gemm provides an interface that is almost the same as the cpu
@@ -246,6 +314,13 @@ void caffe_gpu_fabs(const int n, const Dtype* x, Dtype* y);
 template <typename Dtype>
 void caffe_gpu_scale(const int n, const Dtype alpha, const Dtype *x, Dtype* y);
 
+template <typename Dtype>
+void caffe_gpu_relu(const int n, const Dtype negative_slope, Dtype* x);
+
+template <typename Dtype>
+void caffe_gpu_relu_backward(const int n, const Dtype negative_slope,
+    const Dtype* y, Dtype* dy);
+
 #define DEFINE_AND_INSTANTIATE_GPU_UNARY_FUNC(name, operation) \
 template<typename Dtype> \
 __global__ void name##_kernel(const int n, const Dtype* x, Dtype* y) { \
@@ -0,0 +1,60 @@
+#ifndef CAFFE_UTIL_RING_COMM_HPP_
+#define CAFFE_UTIL_RING_COMM_HPP_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Connects the processes of a multi-process training job in a ring
+ *        of TCP connections, and runs collectives on host buffers over it.
+ *
+ * Every rank listens at its own address in peers, given as host:port, and
+ * connects to the address of the next rank, so each process sends to the
+ * next rank and receives from the previous one. All ranks must call the
+ * collectives in the same order and with the same sizes. Failures of the
+ * connections are fatal.
+ */
+class RingComm {
+ public:
+  /// Blocks until the ring is connected, waiting up to timeout_sec for the
+  /// next rank to listen.
+  RingComm(int rank, const vector<string>& peers, int timeout_sec = 300);
+  ~RingComm();
+
+  inline int rank() const { return rank_; }
+  inline int size() const { return size_; }
+
+  /// Sums the count elements of data over all ranks, in place. This is a
+  /// ring reduce-scatter then allgather: every rank sends and receives about
+  /// 2 * count elements whatever the number of ranks, and all ranks end
+  /// with the same bits.
+  template <typename Dtype>
+  void Allreduce(Dtype* data, size_t count);
+  /// Copies size bytes of data on rank 0 to data on the other ranks.
+  void Broadcast(void* data, size_t size);
+
+ private:
+  // Sends send_size bytes to the next rank while receiving recv_size bytes
+  // from the previous one.
+  void SendRecv(const void* send, size_t send_size, void* recv,
+      size_t recv_size);
+
+  int rank_;
+  int size_;
+  int next_fd_;
+  int prev_fd_;
+  // The segments received during Allreduce, before they are added in.
+  vector<char> buffer_;
+
+  DISABLE_COPY_AND_ASSIGN(RingComm);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_RING_COMM_HPP_
@@ -0,0 +1,87 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+// The smallest number of elements worth handing to another thread in
+// element-wise loops; below it the dispatch costs more than it saves.
+const int kParallelElementwiseGrain = 16384;
+
+/**
+ * @brief A fixed-size pool of threads the CPU paths of layers split their
+ *        work across (intra-op parallelism).
+ *
+ * The thread calling Run() takes part in the work, so a pool of N threads
+ * only starts N - 1 workers. The pool is owned by the thread-local Caffe
+ * singleton (see Caffe::thread_pool()) and must only be driven from the
+ * thread that owns it.
+ */
+class ThreadPool {
+ public:
+  /// Processes the half-open index range [begin, end).
+  typedef boost::function<void(int, int)> RangeFunc;
+
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  inline int num_threads() const { return num_threads_; }
+
+  /**
+   * @brief Splits [0, n) into at most num_threads() contiguous chunks of at
+   *        least grain indices each, and calls func(begin, end) once per
+   *        chunk. Returns when every chunk has been processed.
+   */
+  void Run(int n, const RangeFunc& func, int grain = 1);
+
+ private:
+  void WorkerEntry();
+  // Claims and runs chunks of the current job until none are left.
+  void RunChunks();
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<boost::thread> > workers_;
+  const int num_threads_;
+
+  // State of the job being run, guarded by sync_.
+  const RangeFunc* func_;
+  int n_;
+  int num_chunks_;
+  int next_chunk_;
+  int pending_chunks_;
+  unsigned int generation_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/**
+ * @brief Runs func over [0, n) split across the calling thread's intra-op
+ *        thread pool, or inline when Caffe::cpu_threads() is 1.
+ *
+ * grain is the smallest chunk worth handing to another thread; ranges not
+ * larger than it are always run inline. func must only write to memory that
+ * is disjoint between chunks.
+ */
+void caffe_parallel_for(int n, const ThreadPool::RangeFunc& func,
+    int grain = 1);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,77 @@
+#ifndef CAFFE_UTIL_TRACE_HPP_
+#define CAFFE_UTIL_TRACE_HPP_
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Records timed events of a run and writes them as a Chrome
+ *        trace-event JSON file, for chrome://tracing or Perfetto.
+ *
+ * Recording is off until Start(). While it is on, Net records the forward
+ * and backward pass of every layer, Solver its iterations, updates, tests
+ * and snapshots, and the prefetching data layers the time they wait for a
+ * batch. Each event carries the bytes SyncedMemory allocated while it ran
+ * (counted over the whole process). When recording is off the hooks cost a
+ * branch.
+ */
+class Trace {
+ public:
+  /// Starts recording; Stop() writes the events to filename.
+  static void Start(const string& filename);
+  /// Stops recording and writes the file.
+  static void Stop();
+  static inline bool enabled() {
+    return enabled_.load(boost::memory_order_acquire);
+  }
+
+  /// Microseconds since Start(), on a monotonic clock.
+  static int64_t NowMicros();
+  /// Bytes allocated by SyncedMemory since Start().
+  static int64_t bytes_allocated();
+  static void AddAllocation(size_t bytes);
+
+  /**
+   * @brief Records a complete event. args is the body of a JSON object, for
+   *        instance "\"iter\": 10", or empty.
+   */
+  static void AddEvent(const string& name, const char* category,
+      int64_t start, int64_t duration, const string& args);
+
+ private:
+  // Read by every thread that records events, without taking the lock.
+  static boost::atomic<bool> enabled_;
+};
+
+/**
+ * @brief Records the lifetime of the scope as a trace event, if recording
+ *        is on. In GPU mode the device is synchronized at the end of the
+ *        scope so that the event covers the kernels launched in it.
+ */
+class TraceScope {
+ public:
+  TraceScope(const string& name, const char* category);
+  ~TraceScope();
+
+  void AddArg(const char* key, const char* value);
+  void AddArg(const char* key, int64_t value);
+
+ private:
+  const bool enabled_;
+  string name_;
+  const char* category_;
+  int64_t start_;
+  int64_t start_bytes_;
+  string args_;
+
+  DISABLE_COPY_AND_ASSIGN(TraceScope);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TRACE_HPP_
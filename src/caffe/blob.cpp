@@ -1,9 +1,11 @@
 #include <climits>
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -41,6 +43,8 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    storage_ = BlobProto_Storage_FLOAT;
+    half_data_.reset();
   }
 }
 
@@ -57,20 +61,21 @@ void Blob<Dtype>::Reshape(const BlobShape& shape) {
 template <typename Dtype>
 void Blob<Dtype>::ReshapeLike(const Blob<Dtype>& other) {
   Reshape(other.shape());
+  channel_block_ = other.channel_block();
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), channel_block_(1), storage_(BlobProto_Storage_FLOAT) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), channel_block_(1), storage_(BlobProto_Storage_FLOAT) {
   Reshape(shape);
 }
 
@@ -83,18 +88,22 @@ const int* Blob<Dtype>::gpu_shape() const {
 template <typename Dtype>
 const Dtype* Blob<Dtype>::cpu_data() const {
   CHECK(data_);
+  ExpandHalfData();
   return (const Dtype*)data_->cpu_data();
 }
 
 template <typename Dtype>
 void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
+  storage_ = BlobProto_Storage_FLOAT;
+  half_data_.reset();
   data_->set_cpu_data(data);
 }
 
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
+  ExpandHalfData();
   return (const Dtype*)data_->gpu_data();
 }
 
@@ -113,12 +122,14 @@ const Dtype* Blob<Dtype>::gpu_diff() const {
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_cpu_data() {
   CHECK(data_);
+  ExpandHalfData();
   return static_cast<Dtype*>(data_->mutable_cpu_data());
 }
 
 template <typename Dtype>
 Dtype* Blob<Dtype>::mutable_gpu_data() {
   CHECK(data_);
+  ExpandHalfData();
   return static_cast<Dtype*>(data_->mutable_gpu_data());
 }
 
@@ -138,6 +149,8 @@ template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
   data_ = other.data();
+  storage_ = BlobProto_Storage_FLOAT;
+  half_data_.reset();
 }
 
 template <typename Dtype>
@@ -146,6 +159,23 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK_GE(memory->size(), count_ * sizeof(Dtype));
+  data_ = memory;
+  storage_ = BlobProto_Storage_FLOAT;
+  half_data_.reset();
+  // The shared memory may be smaller than the old capacity.
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK_GE(memory->size(), count_ * sizeof(Dtype));
+  diff_ = memory;
+  capacity_ = count_;
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -155,6 +185,7 @@ template <> void Blob<int>::Update() { NOT_IMPLEMENTED; }
 template <typename Dtype>
 void Blob<Dtype>::Update()
 {
+  ExpandHalfData();
   // We will perform update based on where the data is located.
   switch (data_->head()) 
   {
@@ -193,6 +224,7 @@ template <> int Blob<int>::asum_data() const {
 template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
+  ExpandHalfData();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
@@ -265,6 +297,7 @@ Dtype Blob<Dtype>::sumsq_data() const {
   Dtype sumsq;
   const Dtype* data;
   if (!data_) { return 0; }
+  ExpandHalfData();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
@@ -336,6 +369,7 @@ template <typename Dtype>
 void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
+  ExpandHalfData();
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
@@ -422,6 +456,10 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
       LOG(FATAL) << "Trying to copy blobs of different sizes.";
     }
   }
+  if (!copy_diff) {
+    storage_ = BlobProto_Storage_FLOAT;
+    half_data_.reset();
+  }
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
@@ -470,8 +508,18 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
     CHECK(ShapeEquals(proto)) << "shape mismatch (reshape not set)";
   }
   // copy data
+  storage_ = BlobProto_Storage_FLOAT;
+  half_data_.reset();
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.storage() != BlobProto_Storage_FLOAT) {
+    const string& half_data = proto.half_data();
+    CHECK_EQ(2 * count_, half_data.size());
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = caffe_half_to_float(
+          static_cast<uint8_t>(half_data[2 * i]) |
+          static_cast<uint8_t>(half_data[2 * i + 1]) << 8, proto.storage());
+    }
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -497,6 +545,66 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
 }
 
+template <typename Dtype>
+void Blob<Dtype>::WriteHalfData(BlobProto* proto) const {
+  const uint16_t* half_data = this->half_data();
+  // Two little-endian bytes per value, as in CompressBlobProto.
+  string bytes(2 * count_, '\0');
+  for (int i = 0; i < count_; ++i) {
+    bytes[2 * i] = static_cast<char>(half_data[i] & 0xff);
+    bytes[2 * i + 1] = static_cast<char>(half_data[i] >> 8);
+  }
+  proto->set_storage(storage_);
+  proto->set_half_data(bytes);
+}
+
+template <> void Blob<unsigned int>::set_storage(BlobProto_Storage storage) {
+  NOT_IMPLEMENTED;
+}
+
+template <> void Blob<int>::set_storage(BlobProto_Storage storage) {
+  NOT_IMPLEMENTED;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_storage(BlobProto_Storage storage) {
+  if (storage == storage_) {
+    return;
+  }
+  ExpandHalfData();
+  if (storage == BlobProto_Storage_FLOAT) {
+    return;
+  }
+  half_data_.reset(new SyncedMemory(count_ * sizeof(uint16_t)));
+  caffe_cpu_to_half(count_, storage, cpu_data(),
+      static_cast<uint16_t*>(half_data_->mutable_cpu_data()));
+  // Release the Dtype data; ExpandHalfData restores it when accessed.
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  storage_ = storage;
+}
+
+template <typename Dtype>
+const uint16_t* Blob<Dtype>::half_data() const {
+  CHECK_NE(storage_, BlobProto_Storage_FLOAT) << "Blob is held as Dtype.";
+  return static_cast<const uint16_t*>(half_data_->cpu_data());
+}
+
+template <> void Blob<unsigned int>::ExpandHalfData() const {}
+
+template <> void Blob<int>::ExpandHalfData() const {}
+
+template <typename Dtype>
+void Blob<Dtype>::ExpandHalfData() const {
+  if (storage_ == BlobProto_Storage_FLOAT) {
+    return;
+  }
+  caffe_cpu_from_half(count_, storage_,
+      static_cast<const uint16_t*>(half_data_->cpu_data()),
+      static_cast<Dtype*>(data_->mutable_cpu_data()));
+  storage_ = BlobProto_Storage_FLOAT;
+  half_data_.reset();
+}
+
 template <>
 void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   proto->clear_shape();
@@ -505,9 +613,13 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
-  const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
+  if (storage_ != BlobProto_Storage_FLOAT) {
+    WriteHalfData(proto);
+  } else {
+    const double* data_vec = cpu_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_double_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const double* diff_vec = cpu_diff();
@@ -525,9 +637,13 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
-  const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
+  if (storage_ != BlobProto_Storage_FLOAT) {
+    WriteHalfData(proto);
+  } else {
+    const float* data_vec = cpu_data();
+    for (int i = 0; i < count_; ++i) {
+      proto->add_data(data_vec[i]);
+    }
   }
   if (write_diff) {
     const float* diff_vec = cpu_diff();
@@ -1,11 +1,13 @@
 ﻿#include <boost/thread.hpp>
 #include <glog/logging.h>
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <ctime>
 
 #include "caffe/common.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -49,11 +51,31 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+void Caffe::set_cpu_threads(int val) {
+  CHECK_GE(val, 0) << "Number of CPU threads must be non-negative.";
+  if (val == 0) {
+    val = std::max(1u, boost::thread::physical_concurrency());
+  }
+  if (val != Get().cpu_threads_) {
+    Get().cpu_threads_ = val;
+    Get().thread_pool_.reset();
+  }
+}
+
+ThreadPool& Caffe::thread_pool() {
+  if (!Get().thread_pool_) {
+    Get().thread_pool_.reset(new ThreadPool(Get().cpu_threads_));
+  }
+  return *(Get().thread_pool_);
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), root_solver_(true) { }
+      solver_count_(1), root_solver_(true), world_size_(1), world_rank_(0),
+      cpu_threads_(1),
+      thread_pool_() { }
 
 Caffe::~Caffe() { }
 
@@ -106,7 +128,8 @@ void* Caffe::RNG::generator() {
 
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
-    mode_(Caffe::CPU), solver_count_(1), root_solver_(true) {
+    mode_(Caffe::CPU), solver_count_(1), root_solver_(true), world_size_(1),
+    world_rank_(0), cpu_threads_(1), thread_pool_() {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
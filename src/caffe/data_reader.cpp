@@ -1,4 +1,5 @@
 ﻿#include <boost/thread.hpp>
+#include <algorithm>
 #include <map>
 #include <string>
 #include <vector>
@@ -7,6 +8,8 @@
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe 
 {
@@ -20,6 +23,141 @@ map<const string, weak_ptr<DataReader::Body> > DataReader::bodies_;
 
 static boost::mutex bodies_mutex_;  //静态全局变量
 
+class DataReader::Body::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  // The position of the next record to pass on.
+  int64_t next_position_;
+};
+
+class DataReader::Body::KeyIndex {
+ public:
+  // Reads the keys from cursor, which it leaves at the first record.
+  explicit KeyIndex(db::Cursor* cursor) {
+    offsets_.push_back(0);
+    for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+      keys_ += cursor->key();
+      offsets_.push_back(keys_.size());
+    }
+    CHECK_GT(size(), 0) << "Cannot shuffle or shard an empty source.";
+    cursor->SeekToFirst();
+  }
+
+  inline int size() const { return offsets_.size() - 1; }
+  inline string key(int i) const {
+    return keys_.substr(offsets_[i], offsets_[i + 1] - offsets_[i]);
+  }
+
+ private:
+  // The keys back to back, to keep the index compact.
+  string keys_;
+  vector<size_t> offsets_;
+};
+
+class DataReader::Body::RecordStream {
+ public:
+  // With index NULL the records are read in key order. Otherwise the stream
+  // walks the records [begin, end) of the index, in key order or, with
+  // shuffle, in a new order every epoch. The stream is made of the records
+  // at offset, offset + stride, ... of that order.
+  RecordStream(db::Cursor* cursor, const KeyIndex* index, int begin, int end,
+      bool shuffle, unsigned int seed, int block_size, int offset, int stride)
+      : cursor_(cursor), index_(index), begin_(begin), end_(end),
+        shuffle_(shuffle), seed_(seed), block_size_(block_size),
+        stride_(stride), position_(offset), epoch_(-1) {
+    if (index_) {
+      CHECK_GT(end_, begin_);
+      CHECK(!shuffle_ || block_size_ > 0) << "shuffle_block must be positive.";
+      Seek();
+    } else {
+      Next(offset);
+    }
+  }
+
+  inline db::Cursor* cursor() const { return cursor_; }
+
+  // Moves steps records of the stream on.
+  void Advance(int64_t steps) {
+    if (!index_) {
+      Next(steps * stride_);
+      return;
+    }
+    const int64_t previous = position_;
+    position_ += steps * stride_;
+    // In key order the cursor steps on until the end of the range.
+    if (!shuffle_ && position_ / (end_ - begin_) ==
+        previous / (end_ - begin_)) {
+      for (int64_t i = 0; i < steps * stride_; ++i) {
+        cursor_->Next();
+      }
+      return;
+    }
+    Seek();
+  }
+
+ private:
+  void Next(int64_t steps) {
+    for (int64_t i = 0; i < steps; ++i) {
+      cursor_->Next();
+      if (!cursor_->valid()) {
+        DLOG(INFO) << "Restarting data prefetching from start.";
+        cursor_->SeekToFirst();
+      }
+    }
+  }
+
+  void Seek() {
+    const int n = end_ - begin_;
+    int record = position_ % n;
+    if (shuffle_) {
+      const int64_t epoch = position_ / n;
+      if (epoch != epoch_) {
+        Shuffle(epoch);
+      }
+      record = order_[record];
+    }
+    cursor_->Seek(index_->key(begin_ + record));
+  }
+
+  // Orders the records of epoch: the blocks of block_size_ consecutive
+  // records in random order, and the records within each block too. The
+  // order only depends on the seed and the epoch.
+  void Shuffle(int64_t epoch) {
+    const int n = end_ - begin_;
+    rng_t rng(seed_ + static_cast<unsigned int>(epoch));
+    vector<int> blocks((n + block_size_ - 1) / block_size_);
+    for (int i = 0; i < blocks.size(); ++i) {
+      blocks[i] = i;
+    }
+    shuffle(blocks.begin(), blocks.end(), &rng);
+    order_.clear();
+    for (int i = 0; i < blocks.size(); ++i) {
+      const int begin = blocks[i] * block_size_;
+      const int end = std::min(n, begin + block_size_);
+      const int first = order_.size();
+      for (int j = begin; j < end; ++j) {
+        order_.push_back(j);
+      }
+      shuffle(order_.begin() + first, order_.end(), &rng);
+    }
+    epoch_ = epoch;
+    DLOG(INFO) << "Shuffled epoch " << epoch;
+  }
+
+  db::Cursor* cursor_;
+  const KeyIndex* index_;
+  const int begin_;
+  const int end_;
+  const bool shuffle_;
+  const unsigned int seed_;
+  const int block_size_;
+  const int stride_;
+  int64_t position_;
+  int64_t epoch_;
+  vector<int> order_;
+};
+
 
 
 // LayerParameter是prototxt中定义的结构体，
@@ -29,7 +167,7 @@ DataReader::DataReader(const LayerParameter& param)
 //注意上面的queue_pair_的new操作，说明此时free_的datum中是没有数据的
   // Get or create a body
   boost::mutex::scoped_lock lock(bodies_mutex_);
-  string key = source_key(param);
+  string key = source_key(param, Caffe::world_rank());
   weak_ptr<Body>& weak = bodies_[key];   
   body_ = weak.lock();
 
@@ -43,7 +181,7 @@ DataReader::DataReader(const LayerParameter& param)
 
 DataReader::~DataReader() 
 {
-  string key = source_key(body_->param_);
+  string key = source_key(body_->param_, body_->world_rank_);
   body_.reset();
   boost::mutex::scoped_lock lock(bodies_mutex_);
   if (bodies_[key].expired()) {
@@ -72,12 +210,22 @@ DataReader::QueuePair::~QueuePair() {
 //
 
 DataReader::Body::Body(const LayerParameter& param)
-    : param_(param), new_queue_pairs_() {
+    : param_(param), new_queue_pairs_(), sync_(new sync()),
+      shuffle_seed_(0), num_shards_(1), world_rank_(Caffe::world_rank()),
+      world_size_(param.phase() == TRAIN ? Caffe::world_size() : 1) {
+  const uint64_t cache_mb = param.data_param().cache_mb();
+  if (cache_mb > 0) {
+    cache_.reset(new ImageCache(cache_mb * 1024 * 1024));
+  }
   StartInternalThread();
 }
 
 DataReader::Body::~Body() {
   StopInternalThread();
+  if (cache_) {
+    LOG(INFO) << "Image cache of " << param_.data_param().source() << ": "
+        << cache_->stats();
+  }
 }
 
 void DataReader::Body::InternalThreadEntry()
@@ -85,6 +233,21 @@ void DataReader::Body::InternalThreadEntry()
   shared_ptr<db::DB> db(db::GetDB(param_.data_param().backend()));  //根据参数参数lmdb new出一个lmdb子类构造了一个db父类，这会造成子类数据结构被截断
   db->Open(param_.data_param().source(), db::READ);                 //根据source的文件地址打开文件，这里使用了lmdb的open接口，尽管遭到构造截断，但是父类db提供了open接口，接口函数地址相同，不妨碍使用结果
   shared_ptr<db::Cursor> cursor(db->NewCursor());					//同样使用了lmdb的NewCursor的函数接口，这个例子很好的体现了纯虚函数的用途。
+  const DataParameter& data_param = param_.data_param();
+  if (data_param.shuffle() || data_param.reader_threads() > 1) {
+    key_index_.reset(new KeyIndex(cursor.get()));
+  }
+  if (data_param.shuffle()) {
+    shuffle_seed_ = caffe_rng_rand();
+    LOG(INFO) << "Shuffling " << key_index_->size() << " records of "
+        << data_param.source();
+  }
+  if (data_param.reader_threads() > 1) {
+    // Every shard of every rank needs a record.
+    num_shards_ = std::max(1, std::min<int>(data_param.reader_threads(),
+        key_index_->size() / world_size_));
+  }
+  shared_ptr<RecordStream> stream(NewStream(cursor.get(), 0));
   vector<shared_ptr<QueuePair> > qps;								//queue pair的share_ptr模式放入vector容器中
   try 
   {
@@ -108,10 +271,27 @@ void DataReader::Body::InternalThreadEntry()
 //
 //细心理清这里的结构，可以得到每个solver只读取了一个item，然后等待下一个求解器
 //这是为了初始化,之后qps中还存储了各自的指向的记录位置，方便接下来各个solver的数据读取
+	if (num_shards_ > 1) {
+      // The shards read on from the records read here, which are the first
+      // records of the shards of the first positions.
+      vector<int64_t> first_records(num_shards_, 0);
+      const int64_t shards_size = ShardBegin(num_shards_) - ShardBegin(0);
+      for (int i = 0; i < solver_count; ++i) {
+        shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
+        const int shard = (i % shards_size) % num_shards_;
+        shared_ptr<RecordStream> shard_stream(
+            NewStream(cursor.get(), shard));
+        shard_stream->Advance(first_records[shard]++);
+        read_one(shard_stream.get(), qp.get());
+        qps.push_back(qp);
+      }
+      ReadShards(db.get(), first_records, qps);
+      return;
+    }
 	for (int i = 0; i < solver_count; ++i) 
 	{
       shared_ptr<QueuePair> qp(new_queue_pairs_.pop());
-      read_one(cursor.get(), qp.get());
+      read_one(stream.get(), qp.get());
       qps.push_back(qp);
     }
 
@@ -122,7 +302,7 @@ void DataReader::Body::InternalThreadEntry()
 	{
       for (int i = 0; i < solver_count; ++i) 
 	  {
-        read_one(cursor.get(), qps[i].get());
+        read_one(stream.get(), qps[i].get());
       }
       // Check no additional readers have been created. This can happen if
       // more than one net is trained at a time per process, whether single
@@ -136,20 +316,161 @@ void DataReader::Body::InternalThreadEntry()
   }
 }
 
-void DataReader::Body::read_one(db::Cursor* cursor, QueuePair* qp) 
+DataReader::Body::RecordStream* DataReader::Body::NewStream(
+    db::Cursor* cursor, int shard) const {
+  const DataParameter& data_param = param_.data_param();
+  if (num_shards_ == 1) {
+    return new RecordStream(cursor, key_index_.get(), 0,
+        key_index_ ? key_index_->size() : 0, data_param.shuffle(),
+        shuffle_seed_, data_param.shuffle_block(),
+        world_size_ > 1 ? world_rank_ : 0, world_size_);
+  }
+  // The seeds of the shards are far apart, so that their epochs do not share
+  // an order.
+  const int global_shard =
+      (world_size_ > 1 ? world_rank_ : 0) * num_shards_ + shard;
+  return new RecordStream(cursor, key_index_.get(), ShardBegin(shard),
+      ShardBegin(shard + 1), data_param.shuffle(),
+      shuffle_seed_ + static_cast<unsigned int>(global_shard) * 1000003u,
+      data_param.shuffle_block(), 0, 1);
+}
+
+int DataReader::Body::ShardBegin(int shard) const {
+  // The ranks split the index into num_shards_ ranges each, the first ones
+  // one record longer than the others when it does not divide evenly.
+  const int num_ranges = world_size_ * num_shards_;
+  const int range = (world_size_ > 1 ? world_rank_ : 0) * num_shards_ + shard;
+  const int size = key_index_->size() / num_ranges;
+  return range * size + std::min(range, key_index_->size() % num_ranges);
+}
+
+void DataReader::Body::read_one(RecordStream* stream, QueuePair* qp)
 { 
 
   Datum* datum = qp->free_.pop();                  //数据库记录放在free_中，free表明Datum中数据为空
-  // TODO deserialize in-place instead of copy?
-  datum->ParseFromString(cursor->value());         //对数据库记录解析
+  ReadRecord(stream->cursor(), datum);
   qp->full_.push(datum);						   //解析结果存放在full_中，full表示Datum中数据已填充
   //揣测的套路是原先记录放在free_，并且解析一个丢弃一个，并且将解析结果存放在full_中
 
   // go to the next iter
-  cursor->Next();
-  if (!cursor->valid()) {
-    DLOG(INFO) << "Restarting data prefetching from start.";
-    cursor->SeekToFirst();
+  stream->Advance(1);
+}
+
+void DataReader::Body::ReadRecord(db::Cursor* cursor, Datum* datum) const {
+  // Parse the record where the cursor holds it, without copying it first.
+  const char* data;
+  size_t size;
+  cursor->value_view(&data, &size);
+  if (cache_) {
+    ReadCached(cursor->key(), data, size, datum);
+  } else {
+    ParseRecord(data, size, datum);
+  }
+}
+
+void DataReader::Body::ParseRecord(const char* data, size_t size,
+    Datum* datum) const {
+  CHECK(datum->ParseFromArray(data, size)) << "Failed to parse Datum";
+}
+
+void DataReader::Body::ReadCached(const string& key, const char* data,
+    size_t size, Datum* datum) const {
+  shared_ptr<const Datum> cached = cache_->Get(key);
+  if (cached) {
+    datum->CopyFrom(*cached);
+  } else {
+    ParseRecord(data, size, datum);
+    if (datum->encoded()) {
+#ifdef USE_OPENCV
+      // Decode as the transformer would.
+      const TransformationParameter& transform_param =
+          param_.transform_param();
+      if (transform_param.force_color() || transform_param.force_gray()) {
+        DecodeDatum(datum, transform_param.force_color());
+      } else {
+        DecodeDatumNative(datum);
+      }
+#else
+      LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+    }
+    cache_->Put(key, shared_ptr<const Datum>(new Datum(*datum)));
+  }
+  LOG_EVERY_N(INFO, 100000) << "Image cache of "
+      << param_.data_param().source() << ": " << cache_->stats();
+}
+
+void DataReader::Body::ReadShards(db::DB* db,
+    const vector<int64_t>& first_records,
+    const vector<shared_ptr<QueuePair> >& qps) {
+  const DataParameter& data_param = param_.data_param();
+  if (data_param.deterministic_read()) {
+    // A shard holds on to a parsed datum while it waits for its turn. The
+    // datums the other shards hold must leave a batch for the data layer,
+    // or the shard whose turn it is could wait for a free one forever.
+    CHECK_LE(num_shards_,
+        (data_param.prefetch() - 1) * data_param.batch_size() + 1)
+        << "With deterministic_read, reader_threads must be at most "
+        << "(prefetch - 1) * batch_size + 1.";
+  }
+  sync_->next_position_ = qps.size();
+  vector<shared_ptr<boost::thread> > shards;
+  for (int i = 0; i < num_shards_; ++i) {
+    shards.push_back(shared_ptr<boost::thread>(new boost::thread(
+        &DataReader::Body::ShardEntry, this, db, i, first_records[i],
+        boost::cref(qps))));
+  }
+  LOG(INFO) << "Reading " << data_param.source() << " with "
+      << num_shards_ << " threads";
+  try {
+    for (int i = 0; i < num_shards_; ++i) {
+      shards[i]->join();
+    }
+  } catch (boost::thread_interrupted&) {
+    for (int i = 0; i < num_shards_; ++i) {
+      shards[i]->interrupt();
+    }
+    for (int i = 0; i < num_shards_; ++i) {
+      shards[i]->join();
+    }
+  }
+}
+
+void DataReader::Body::ShardEntry(db::DB* db, int shard, int64_t record,
+    const vector<shared_ptr<QueuePair> >& qps) {
+  const bool deterministic = param_.data_param().deterministic_read();
+  const int solver_count = qps.size();
+  // Each epoch of the stream takes the shards' records in turn, so the k-th
+  // record of this shard's epoch is at position k * num_shards_ + shard of
+  // it. The longer shards come first, and cover the last positions alone.
+  const int shard_size = ShardBegin(shard + 1) - ShardBegin(shard);
+  const int64_t epoch_size = ShardBegin(num_shards_) - ShardBegin(0);
+  shared_ptr<db::Cursor> cursor(db->NewCursor());
+  shared_ptr<RecordStream> stream(NewStream(cursor.get(), shard));
+  stream->Advance(record);
+  try {
+    for (; ; ++record) {
+      const int64_t position = record / shard_size * epoch_size +
+          record % shard_size * num_shards_ + shard;
+      QueuePair* qp = qps[position % solver_count].get();
+      Datum* datum = qp->free_.pop();
+      ReadRecord(stream->cursor(), datum);
+      stream->Advance(1);
+      if (deterministic) {
+        boost::mutex::scoped_lock lock(sync_->mutex_);
+        while (sync_->next_position_ != position) {
+          sync_->condition_.wait(lock);
+        }
+        qp->full_.push(datum);
+        ++sync_->next_position_;
+        sync_->condition_.notify_all();
+      } else {
+        qp->full_.push(datum);
+      }
+      boost::this_thread::interruption_point();
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
   }
 }
 
@@ -2,6 +2,11 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif  // __SSE2__
+
+#include <cstring>
 #include <string>
 #include <vector>
 
@@ -12,6 +17,122 @@
 
 namespace caffe {
 
+namespace {
+
+// Transforms a row of uint8 pixels: out[w] = (in[w] - mean) * scale, where
+// mean is mean_row[w] or mean_value, and out is filled back to front when
+// mirroring. The choices are template arguments, so the loops have no
+// branches.
+template <typename Dtype, bool kMeanRow, bool kMirror>
+struct RowTransform {
+  static void Run(const uint8_t* in, const Dtype* mean_row, Dtype mean_value,
+      Dtype scale, int width, Dtype* out) {
+    for (int w = 0; w < width; ++w) {
+      const Dtype mean = kMeanRow ? mean_row[w] : mean_value;
+      out[kMirror ? width - 1 - w : w] =
+          (static_cast<Dtype>(in[w]) - mean) * scale;
+    }
+  }
+};
+
+#if defined(__SSE2__)
+// Converts and transforms 16 float or 8 double pixels at a time. The
+// operations are those of the scalar loop, so the results are the same.
+template <bool kMeanRow, bool kMirror>
+struct RowTransform<float, kMeanRow, kMirror> {
+  static void Run(const uint8_t* in, const float* mean_row, float mean_value,
+      float scale, int width, float* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale4 = _mm_set1_ps(scale);
+    const __m128 mean_value4 = _mm_set1_ps(mean_value);
+    int w = 0;
+    for (; w + 16 <= width; w += 16) {
+      const __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + w));
+      const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+      const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+      __m128 pixels[4];
+      pixels[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero));
+      pixels[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero));
+      pixels[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero));
+      pixels[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero));
+      for (int k = 0; k < 4; ++k) {
+        const __m128 mean =
+            kMeanRow ? _mm_loadu_ps(mean_row + w + 4 * k) : mean_value4;
+        const __m128 value = _mm_mul_ps(_mm_sub_ps(pixels[k], mean), scale4);
+        if (kMirror) {
+          _mm_storeu_ps(out + width - w - 4 * k - 4,
+              _mm_shuffle_ps(value, value, _MM_SHUFFLE(0, 1, 2, 3)));
+        } else {
+          _mm_storeu_ps(out + w + 4 * k, value);
+        }
+      }
+    }
+    for (; w < width; ++w) {
+      const float mean = kMeanRow ? mean_row[w] : mean_value;
+      out[kMirror ? width - 1 - w : w] =
+          (static_cast<float>(in[w]) - mean) * scale;
+    }
+  }
+};
+
+template <bool kMeanRow, bool kMirror>
+struct RowTransform<double, kMeanRow, kMirror> {
+  static void Run(const uint8_t* in, const double* mean_row,
+      double mean_value, double scale, int width, double* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128d scale2 = _mm_set1_pd(scale);
+    const __m128d mean_value2 = _mm_set1_pd(mean_value);
+    int w = 0;
+    for (; w + 8 <= width; w += 8) {
+      const __m128i words = _mm_unpacklo_epi8(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + w)), zero);
+      __m128i ints[2];
+      ints[0] = _mm_unpacklo_epi16(words, zero);
+      ints[1] = _mm_unpackhi_epi16(words, zero);
+      for (int k = 0; k < 4; ++k) {
+        // _mm_cvtepi32_pd converts the two low ints.
+        const __m128d pixels = _mm_cvtepi32_pd(
+            k % 2 ? _mm_srli_si128(ints[k / 2], 8) : ints[k / 2]);
+        const __m128d mean =
+            kMeanRow ? _mm_loadu_pd(mean_row + w + 2 * k) : mean_value2;
+        const __m128d value = _mm_mul_pd(_mm_sub_pd(pixels, mean), scale2);
+        if (kMirror) {
+          _mm_storeu_pd(out + width - w - 2 * k - 2,
+              _mm_shuffle_pd(value, value, 1));
+        } else {
+          _mm_storeu_pd(out + w + 2 * k, value);
+        }
+      }
+    }
+    for (; w < width; ++w) {
+      const double mean = kMeanRow ? mean_row[w] : mean_value;
+      out[kMirror ? width - 1 - w : w] =
+          (static_cast<double>(in[w]) - mean) * scale;
+    }
+  }
+};
+#endif  // __SSE2__
+
+template <typename Dtype>
+struct RowKernel {
+  typedef void (*Func)(const uint8_t* in, const Dtype* mean_row,
+      Dtype mean_value, Dtype scale, int width, Dtype* out);
+};
+
+// Picks the kernel for the rows of a datum.
+template <typename Dtype>
+typename RowKernel<Dtype>::Func SelectRowKernel(bool mean_row, bool mirror) {
+  if (mean_row) {
+    return mirror ? &RowTransform<Dtype, true, true>::Run :
+        &RowTransform<Dtype, true, false>::Run;
+  }
+  return mirror ? &RowTransform<Dtype, false, true>::Run :
+      &RowTransform<Dtype, false, false>::Run;
+}
+
+}  // namespace
+
 template<typename Dtype>
 DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
     Phase phase)
@@ -96,6 +217,23 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
+  if (has_uint8) {
+    const typename RowKernel<Dtype>::Func kernel =
+        SelectRowKernel<Dtype>(has_mean_file, do_mirror);
+    const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+    for (int c = 0; c < datum_channels; ++c) {
+      const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+      for (int h = 0; h < height; ++h) {
+        const int data_index =
+            (c * datum_height + h_off + h) * datum_width + w_off;
+        kernel(pixels + data_index, has_mean_file ? mean + data_index : NULL,
+            mean_value, scale, width,
+            transformed_data + (c * height + h) * width);
+      }
+    }
+    return;
+  }
+
   Dtype datum_element;
   int top_index, data_index;
   for (int c = 0; c < datum_channels; ++c) {
@@ -189,6 +327,84 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   Transform(datum, transformed_data);
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::CropRaw(const Datum& datum, uint8_t* raw,
+                                     RawCrop* crop) {
+  CHECK(!datum.encoded()) << "Raw batches need datums that are not encoded";
+  const string& data = datum.data();
+  const int datum_channels = datum.channels();
+  const int datum_height = datum.height();
+  const int datum_width = datum.width();
+  CHECK_EQ(data.size(), datum_channels * datum_height * datum_width)
+      << "Raw batches need uint8 datums";
+
+  const int crop_size = param_.crop_size();
+  CHECK_GE(datum_height, crop_size);
+  CHECK_GE(datum_width, crop_size);
+  // Draw in the same order as Transform.
+  crop->mirror = param_.mirror() && Rand(2);
+  crop->datum_height = datum_height;
+  crop->datum_width = datum_width;
+  int height = datum_height;
+  int width = datum_width;
+  crop->h_off = 0;
+  crop->w_off = 0;
+  if (crop_size) {
+    height = crop_size;
+    width = crop_size;
+    if (phase_ == TRAIN) {
+      crop->h_off = Rand(datum_height - crop_size + 1);
+      crop->w_off = Rand(datum_width - crop_size + 1);
+    } else {
+      crop->h_off = (datum_height - crop_size) / 2;
+      crop->w_off = (datum_width - crop_size) / 2;
+    }
+  }
+  for (int c = 0; c < datum_channels; ++c) {
+    for (int h = 0; h < height; ++h) {
+      memcpy(raw + (c * height + h) * width, data.data() +
+          (c * datum_height + crop->h_off + h) * datum_width + crop->w_off,
+          width);
+    }
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw(const uint8_t* raw,
+    const RawCrop& crop, int channels, int height, int width,
+    Dtype* transformed_data) {
+  const Dtype scale = param_.scale();
+  const Dtype* mean = NULL;
+  if (param_.has_mean_file()) {
+    CHECK_EQ(channels, data_mean_.channels());
+    CHECK_EQ(crop.datum_height, data_mean_.height());
+    CHECK_EQ(crop.datum_width, data_mean_.width());
+    mean = data_mean_.cpu_data();
+  }
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+     "Specify either 1 mean_value or as many as channels: " << channels;
+    if (channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
+      }
+    }
+  }
+  const typename RowKernel<Dtype>::Func kernel =
+      SelectRowKernel<Dtype>(mean != NULL, crop.mirror);
+  for (int c = 0; c < channels; ++c) {
+    const Dtype mean_value = mean_values_.empty() ? Dtype(0) : mean_values_[c];
+    for (int h = 0; h < height; ++h) {
+      const Dtype* mean_row = mean ? mean +
+          (c * crop.datum_height + crop.h_off + h) * crop.datum_width +
+          crop.w_off : NULL;
+      kernel(raw + (c * height + h) * width, mean_row, mean_value, scale,
+          width, transformed_data + (c * height + h) * width);
+    }
+  }
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
@@ -543,6 +759,15 @@ void DataTransformer<Dtype>::InitRand() {
   }
 }
 
+template <typename Dtype>
+void DataTransformer<Dtype>::SeedRand(unsigned int seed) {
+  if (rng_) {
+    static_cast<caffe::rng_t*>(rng_->generator())->seed(seed);
+  } else if (param_.mirror() || (phase_ == TRAIN && param_.crop_size())) {
+    rng_.reset(new Caffe::RNG(seed));
+  }
+}
+
 template <typename Dtype>
 int DataTransformer<Dtype>::Rand(int n) {
   CHECK(rng_);
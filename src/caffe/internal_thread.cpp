@@ -29,11 +29,13 @@ void InternalThread::StartInternalThread() {
   int rand_seed = caffe_rng_rand();
   int solver_count = Caffe::solver_count();
   bool root_solver = Caffe::root_solver();
+  int world_size = Caffe::world_size();
+  int world_rank = Caffe::world_rank();
 
   try 
   {
     thread_.reset(new boost::thread(&InternalThread::entry, this, device, mode,
-          rand_seed, solver_count, root_solver));
+          rand_seed, solver_count, root_solver, world_size, world_rank));
   } 
   catch (std::exception& e) 
   {
@@ -42,7 +44,7 @@ void InternalThread::StartInternalThread() {
 }
 
 void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
-    int solver_count, bool root_solver) 
+    int solver_count, bool root_solver, int world_size, int world_rank) 
 {
 #ifndef CPU_ONLY
   CUDA_CHECK(cudaSetDevice(device));
@@ -51,6 +53,8 @@ void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
   Caffe::set_random_seed(rand_seed);
   Caffe::set_solver_count(solver_count);
   Caffe::set_root_solver(root_solver);
+  Caffe::set_world_size(world_size);
+  Caffe::set_world_rank(world_rank);
 
   InternalThreadEntry();
 }
@@ -14,6 +14,7 @@
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 
 #ifdef USE_CUDNN
@@ -47,16 +48,30 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
     }
   }
 #endif
+  // Only the CAFFE engine runs quantized (see QuantizationParameter).
+  const bool quantized = param.has_quantization_param();
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
     engine = ConvolutionParameter_Engine_CAFFE;
 #ifdef USE_CUDNN
-    if (!use_dilation) {
+    if (!use_dilation && !quantized) {
       engine = ConvolutionParameter_Engine_CUDNN;
     }
+#else
+    if (WinogradConvolutionLayer<Dtype>::IsSupported(conv_param) &&
+        !quantized) {
+      engine = ConvolutionParameter_Engine_WINOGRAD;
+    }
 #endif
   }
+  if (quantized && engine != ConvolutionParameter_Engine_CAFFE) {
+    LOG(FATAL) << "Layer " << param.name() << " is quantized, which needs "
+               << "the CAFFE engine.";
+  }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_WINOGRAD) {
+    return shared_ptr<Layer<Dtype> >(
+        new WinogradConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
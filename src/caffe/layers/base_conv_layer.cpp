@@ -14,6 +14,7 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Configure the kernel size, padding, stride, and inputs.
   ConvolutionParameter conv_param = this->layer_param_.convolution_param();
   force_nd_im2col_ = conv_param.force_nd_im2col();
+  batch_parallel_ = conv_param.batch_parallel();
   channel_axis_ = bottom[0]->CanonicalAxisIndex(conv_param.axis());
   const int first_spatial_axis = channel_axis_ + 1;
   const int num_axes = bottom[0]->num_axes();
@@ -255,13 +256,17 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
+    const Dtype* weights, Dtype* output, bool skip_im2col,
+    Dtype* col_buffer) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    if (!col_buffer) {
+      col_buffer = col_buffer_.mutable_cpu_data();
+    }
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buffer);
     }
-    col_buff = col_buffer_.cpu_data();
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
@@ -271,6 +276,44 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_s8(const Dtype* input,
+    const int16_t* weights, const Dtype* weight_scales,
+    const Dtype input_scale, Dtype* output, Dtype* col_buffer,
+    int8_t* quantized_col, int32_t* quantized_output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    if (!col_buffer) {
+      col_buffer = col_buffer_.mutable_cpu_data();
+    }
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
+  }
+  caffe_cpu_quantize(col_offset_ * group_, input_scale, col_buff,
+      quantized_col);
+  // Each group's output is computed transposed, one row of its channels per
+  // pixel, so that the columns are the A of caffe_cpu_gemm_s8 and the
+  // constant weights the packed B.
+  const int group_outputs = conv_out_channels_ / group_;
+  const int packed_offset =
+      caffe_cpu_gemm_s8_packed_size(kernel_dim_, group_outputs);
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_s8(CblasTrans, conv_out_spatial_dim_, group_outputs,
+        kernel_dim_, quantized_col + col_offset_ * g,
+        weights + packed_offset * g, quantized_output + output_offset_ * g);
+  }
+  for (int c = 0; c < conv_out_channels_; ++c) {
+    const Dtype scale = weight_scales[c] / input_scale;
+    const int32_t* group_output =
+        quantized_output + output_offset_ * (c / group_outputs);
+    const int j = c % group_outputs;
+    for (int i = 0; i < conv_out_spatial_dim_; ++i) {
+      output[c * conv_out_spatial_dim_ + i] =
+          group_output[i * group_outputs + j] * scale;
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -281,10 +324,10 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+    const Dtype* weights, Dtype* input, Dtype* col_buffer) {
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    col_buff = col_buffer ? col_buffer : col_buffer_.mutable_cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -299,11 +342,14 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
+    const Dtype* output, Dtype* weights, Dtype* col_buffer) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    if (!col_buffer) {
+      col_buffer = col_buffer_.mutable_cpu_data();
+    }
+    conv_im2col_cpu(input, col_buffer);
+    col_buff = col_buffer;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
@@ -320,6 +366,58 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::cpu_batch_slices() {
+  if (!batch_parallel_) {
+    return 1;
+  }
+  return std::max(1, std::min(Caffe::cpu_threads(), num_));
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::cpu_slice_col_buffers(int num_slices,
+    vector<Dtype*>* col_buffers) {
+  col_buffers->assign(num_slices, static_cast<Dtype*>(NULL));
+  if (is_1x1_) {
+    return;
+  }
+  (*col_buffers)[0] = col_buffer_.mutable_cpu_data();
+  if (num_slices > 1) {
+    vector<int> shape(1, (num_slices - 1) * col_buffer_.count());
+    slice_col_buffer_.Reshape(shape);
+    Dtype* slice_col_data = slice_col_buffer_.mutable_cpu_data();
+    for (int s = 1; s < num_slices; ++s) {
+      (*col_buffers)[s] = slice_col_data + (s - 1) * col_buffer_.count();
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::cpu_slice_weight_diffs(int num_slices,
+    Dtype* weight_diff, vector<Dtype*>* weight_diffs) {
+  const int weight_count = this->blobs_[0]->count();
+  weight_diffs->assign(num_slices, weight_diff);
+  if (num_slices > 1) {
+    vector<int> shape(1, (num_slices - 1) * weight_count);
+    slice_weight_diff_.Reshape(shape);
+    Dtype* slice_weight_diff = slice_weight_diff_.mutable_cpu_data();
+    caffe_set(slice_weight_diff_.count(), Dtype(0), slice_weight_diff);
+    for (int s = 1; s < num_slices; ++s) {
+      (*weight_diffs)[s] = slice_weight_diff + (s - 1) * weight_count;
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::cpu_reduce_weight_diffs(
+    const vector<Dtype*>& weight_diffs) {
+  const int weight_count = this->blobs_[0]->count();
+  for (int s = 1; s < weight_diffs.size(); ++s) {
+    caffe_axpy<Dtype>(weight_count, Dtype(1), weight_diffs[s],
+        weight_diffs[0]);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -1,4 +1,5 @@
 ﻿#include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -8,6 +9,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe 
 {
@@ -35,10 +37,16 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(const LayerParameter& param)
-    : BaseDataLayer<Dtype>(param), prefetch_free_(), prefetch_full_() 
+    : BaseDataLayer<Dtype>(param),
+      prefetch_(param.data_param().prefetch()), prefetch_free_(),
+      prefetch_full_(), tune_prefetch_(param.data_param().adaptive_prefetch()),
+      wait_time_(0), iteration_time_(0), tune_iterations_(0),
+      last_wait_fraction_(-1)
 {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);						//prefetch_free_使用的内存空间是类的私有变量的空间
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be positive.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());						//prefetch_free_使用的内存空间是类的私有变量的空间
   }
 }
 
@@ -53,20 +61,31 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bot
 
   //下面的代码调用了mutable_cpu_data()函数，旨在获取最新的数据，但又没有存储获取的数据，很奇怪，这不同于很多其他layer的setup函数
   //英文的注释很清楚这段代码意义：只是去调用mutable_cpu_data()函数从而确保当主线程在运行时，prefetch的线程不会同时引起cudaMalloc的调用
-  for (int i = 0; i < PREFETCH_COUNT; ++i) 
+  // Raw batches leave data_ unshaped and unallocated.
+  for (int i = 0; i < prefetch_.size(); ++i) 
   {
-    prefetch_[i].data_.mutable_cpu_data();
+    if (prefetch_[i]->data_.count() > 0) {
+      prefetch_[i]->data_.mutable_cpu_data();
+    }
     if (this->output_labels_) 
 	{
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
+    }
+    for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+      prefetch_[i]->extra_[j]->mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      if (prefetch_[i]->data_.count() > 0) {
+        prefetch_[i]->data_.mutable_gpu_data();
+      }
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
+      }
+      for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+        prefetch_[i]->extra_[j]->mutable_gpu_data();
       }
     }
   }
@@ -94,7 +113,7 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry()
       Batch<Dtype>* batch = prefetch_free_.pop();
       load_batch(batch);									//这是个纯虚函数，根据不同的layer有其具体定义
 #ifndef CPU_ONLY
-      if (Caffe::mode() == Caffe::GPU) {
+      if (Caffe::mode() == Caffe::GPU && batch->raw_data_.empty()) {
         batch->data_.data().get()->async_gpu_push(stream);
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
@@ -111,10 +130,117 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry()
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::NextBatch() {
+  // An iteration runs from one call to the next. The wait of the first call,
+  // while the queue fills up, is not counted.
+  const bool timed = tune_prefetch_ && iteration_timer_.running();
+  if (timed) {
+    iteration_timer_.Stop();
+    iteration_time_ += iteration_timer_.MilliSeconds();
+    ++tune_iterations_;
+    wait_timer_.Start();
+  }
+  if (tune_prefetch_) {
+    iteration_timer_.Start();
+  }
+  Batch<Dtype>* batch;
+  {
+    // Time spent here is time the prefetch thread fell behind the net.
+    TraceScope trace(this->layer_param_.name(), "data_wait");
+    batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  }
+  if (timed) {
+    wait_timer_.Stop();
+    wait_time_ += wait_timer_.MilliSeconds();
+    TunePrefetch(*batch);
+  }
+  return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::TunePrefetch(const Batch<Dtype>& batch) {
+  // Adjust over windows of this many iterations, when the net waited for
+  // more than this fraction of them.
+  const int kTuneIterations = 20;
+  const float kStallFraction = 0.01;
+  if (tune_iterations_ < kTuneIterations) {
+    return;
+  }
+  const float wait_fraction = wait_time_ / std::max(iteration_time_, 1e-3f);
+  wait_time_ = 0;
+  iteration_time_ = 0;
+  tune_iterations_ = 0;
+  if (wait_fraction < kStallFraction) {
+    return;
+  }
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const string& name = this->layer_param_.name();
+  if (last_wait_fraction_ >= 0 && wait_fraction > 0.9 * last_wait_fraction_) {
+    LOG(INFO) << name << " waits " << 100 * wait_fraction << "% of the time "
+        << "with " << prefetch_.size() << " prefetched batches; batches are "
+        << "loaded too slowly, not growing the queue further.";
+    tune_prefetch_ = false;
+    return;
+  }
+  const bool raw = !batch.raw_data_.empty();
+  size_t batch_bytes = batch.label_.count() * sizeof(Dtype) +
+      (raw ? batch.raw_data_.size() : batch.data_.count() * sizeof(Dtype));
+  for (int j = 0; j < batch.extra_.size(); ++j) {
+    batch_bytes += batch.extra_[j]->count() * sizeof(Dtype);
+  }
+  const size_t memory_limit =
+      static_cast<size_t>(data_param.prefetch_memory_mb()) << 20;
+  if (prefetch_.size() >= data_param.max_prefetch() || (memory_limit > 0 &&
+      (prefetch_.size() + 1) * batch_bytes > memory_limit)) {
+    LOG(INFO) << name << " waits " << 100 * wait_fraction << "% of the time "
+        << "with " << prefetch_.size() << " prefetched batches, the most "
+        << "max_prefetch and prefetch_memory_mb allow.";
+    tune_prefetch_ = false;
+    return;
+  }
+  // The batch is not in use by the prefetch thread, so it is safe to read
+  // its shape.
+  shared_ptr<Batch<Dtype> > added(new Batch<Dtype>());
+  added->data_.ReshapeLike(batch.data_);
+  if (raw) {
+    added->raw_data_.resize(batch.raw_data_.size());
+  } else {
+    added->data_.mutable_cpu_data();
+  }
+  if (this->output_labels_) {
+    added->label_.ReshapeLike(batch.label_);
+    added->label_.mutable_cpu_data();
+  }
+  for (int j = 0; j < batch.extra_.size(); ++j) {
+    added->extra_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    added->extra_[j]->ReshapeLike(*batch.extra_[j]);
+    added->extra_[j]->mutable_cpu_data();
+  }
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    if (!raw) {
+      added->data_.mutable_gpu_data();
+    }
+    if (this->output_labels_) {
+      added->label_.mutable_gpu_data();
+    }
+    for (int j = 0; j < added->extra_.size(); ++j) {
+      added->extra_[j]->mutable_gpu_data();
+    }
+  }
+#endif
+  prefetch_.push_back(added);
+  prefetch_free_.push(added.get());
+  last_wait_fraction_ = wait_fraction;
+  LOG(INFO) << name << " waits " << 100 * wait_fraction << "% of the time; "
+      << "prefetching " << prefetch_.size() << " batches.";
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) 
 {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data，在这个地方可以看到数据是直接读到top的数据中取得，而bottom是没有数据的
@@ -127,6 +253,11 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bo
     // Copy the labels.
     caffe_copy(batch->label_.count(), batch->label_.cpu_data(), top[1]->mutable_cpu_data());
   }
+  for (int j = 0; j < batch->extra_.size(); ++j) {
+    top[j + 2]->ReshapeLike(*batch->extra_[j]);
+    caffe_copy(batch->extra_[j]->count(), batch->extra_[j]->cpu_data(),
+        top[j + 2]->mutable_cpu_data());
+  }
 
   prefetch_free_.push(batch);				//prefetch_free_将batch收回到自己的容器中
 }
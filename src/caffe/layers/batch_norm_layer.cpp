@@ -1,8 +1,11 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -91,10 +94,6 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int num = bottom[0]->shape(0);
   int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
 
-  if (bottom[0] != top[0]) {
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  }
-
   if (use_global_stats_) {
     // use the stored mean/variance estimates.
     const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
@@ -114,18 +113,15 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         mean_.mutable_cpu_data());
   }
 
-  // subtract mean
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, -1, num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., top_data);
+  // subtract mean, and compute (X-EX)^2 if the variance is needed
+  caffe_parallel_for(num * channels_, boost::bind(
+      &BatchNormLayer<Dtype>::CenterRange_cpu, this, bottom_data,
+      mean_.cpu_data(), top_data,
+      use_global_stats_ ? NULL : temp_.mutable_cpu_data(), spatial_dim,
+      _1, _2), std::max(1, kParallelElementwiseGrain / spatial_dim));
 
   if (!use_global_stats_) {
     // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
     caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
         1. / (num * spatial_dim), temp_.cpu_data(),
         spatial_sum_multiplier_.cpu_data(), 0.,
@@ -151,18 +147,45 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
              variance_.mutable_cpu_data());
 
-  // replicate variance to input size
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), variance_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., temp_.mutable_cpu_data());
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
+  // replicate variance to input size and divide
   // TODO(cdoersch): The caching is only needed because later in-place layers
   //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data,
-      x_norm_.mutable_cpu_data());
+  caffe_parallel_for(num * channels_, boost::bind(
+      &BatchNormLayer<Dtype>::NormalizeRange_cpu, this, variance_.cpu_data(),
+      top_data, temp_.mutable_cpu_data(), x_norm_.mutable_cpu_data(),
+      spatial_dim, _1, _2),
+      std::max(1, kParallelElementwiseGrain / spatial_dim));
+}
+
+template <typename Dtype>
+void BatchNormLayer<Dtype>::CenterRange_cpu(const Dtype* bottom_data,
+    const Dtype* mean_data, Dtype* top_data, Dtype* temp_data,
+    int spatial_dim, int begin, int end) {
+  for (int nc = begin; nc < end; ++nc) {
+    const Dtype mean = mean_data[nc % channels_];
+    const int offset = nc * spatial_dim;
+    for (int i = offset; i < offset + spatial_dim; ++i) {
+      top_data[i] = bottom_data[i] - mean;
+    }
+    if (temp_data) {
+      caffe_sqr(spatial_dim, top_data + offset, temp_data + offset);
+    }
+  }
+}
+
+template <typename Dtype>
+void BatchNormLayer<Dtype>::NormalizeRange_cpu(const Dtype* std_data,
+    Dtype* top_data, Dtype* temp_data, Dtype* x_norm_data, int spatial_dim,
+    int begin, int end) {
+  for (int nc = begin; nc < end; ++nc) {
+    const Dtype std = std_data[nc % channels_];
+    const int offset = nc * spatial_dim;
+    for (int i = offset; i < offset + spatial_dim; ++i) {
+      temp_data[i] = std;
+      top_data[i] /= std;
+      x_norm_data[i] = top_data[i];
+    }
+  }
 }
 
 template <typename Dtype>
@@ -1,9 +1,101 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <vector>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_BLOCKED_CONV_AVX2
+#endif
+
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const FusionParameter& fusion_param = this->layer_param_.fusion_param();
+  fused_relu_ = fusion_param.has_relu_param();
+  relu_negative_slope_ = fusion_param.relu_param().negative_slope();
+  quantized_ = this->layer_param_.has_quantization_param();
+  if (quantized_) {
+    const float range = this->layer_param_.quantization_param().bottom_range();
+    CHECK_GT(range, 0) << "Quantized layers need a positive bottom_range.";
+    bottom_scale_ = 127 / range;
+  }
+  channel_block_ = bottom[0]->channel_block();
+  if (channel_block_ == 1) {
+    BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+    return;
+  }
+  ReshapePlainBottoms(bottom);
+  BaseConvolutionLayer<Dtype>::LayerSetUp(plain_bottom_vec_, plain_top_vec_);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  channel_block_ = bottom[0]->channel_block();
+  if (channel_block_ == 1) {
+    BaseConvolutionLayer<Dtype>::Reshape(bottom, top);
+    for (int i = 0; i < top.size(); ++i) {
+      top[i]->set_channel_block(1);
+    }
+    return;
+  }
+  ReshapePlainBottoms(bottom);
+  BaseConvolutionLayer<Dtype>::Reshape(plain_bottom_vec_, plain_top_vec_);
+  CHECK(!quantized_) << "Blocked input is not supported by quantized layers.";
+  CHECK_EQ(2, this->num_spatial_axes_)
+      << "Blocked input is only supported for 2D convolution.";
+  CHECK_EQ(1, this->group_)
+      << "Blocked input is not supported for group convolution.";
+  CHECK_EQ(0, this->num_output_ % channel_block_)
+      << "Blocked input requires num_output to be a multiple of "
+      << channel_block_;
+  for (int i = 0; i < top.size(); ++i) {
+    vector<int> top_shape = plain_top_[i]->shape();
+    top_shape[1] /= channel_block_;
+    top_shape.push_back(channel_block_);
+    top[i]->Reshape(top_shape);
+    top[i]->set_channel_block(channel_block_);
+  }
+  vector<int> weight_shape = this->blobs_[0]->shape();
+  weight_shape[0] /= channel_block_;
+  weight_shape[1] /= channel_block_;
+  weight_shape.push_back(channel_block_);
+  weight_shape.push_back(channel_block_);
+  blocked_weight_.Reshape(weight_shape);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ReshapePlainBottoms(
+      const vector<Blob<Dtype>*>& bottom) {
+  while (plain_bottom_.size() < bottom.size()) {
+    plain_bottom_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    plain_top_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    plain_bottom_vec_.push_back(plain_bottom_.back().get());
+    plain_top_vec_.push_back(plain_top_.back().get());
+  }
+  plain_bottom_.resize(bottom.size());
+  plain_top_.resize(bottom.size());
+  plain_bottom_vec_.resize(bottom.size());
+  plain_top_vec_.resize(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    CHECK_EQ(channel_block_, bottom[i]->channel_block())
+        << "All bottoms must have the same layout.";
+    CHECK_EQ(5, bottom[i]->num_axes()) << "Blocked input must have 5 axes, "
+        << "corresponding to (num, channel blocks, height, width, channels)";
+    vector<int> plain_shape = bottom[i]->shape();
+    plain_shape.pop_back();
+    plain_shape[1] *= channel_block_;
+    plain_bottom_[i]->Reshape(plain_shape);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::compute_output_shape() {
   const int* kernel_shape_data = this->kernel_shape_.cpu_data();
@@ -24,30 +116,190 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (bottom[0]->channel_block() > 1) {
+    const int block = channel_block_;
+    // Reorder the filters to match the blocked input and output.
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    Dtype* blocked_weight = blocked_weight_.mutable_cpu_data();
+    const int kernel_dim = this->blobs_[0]->count(2);
+    for (int o = 0; o < this->num_output_; ++o) {
+      for (int c = 0; c < this->channels_; ++c) {
+        for (int k = 0; k < kernel_dim; ++k) {
+          blocked_weight[((((o / block) * (this->channels_ / block)
+              + c / block) * kernel_dim + k) * block + c % block) * block
+              + o % block] = weight[(o * this->channels_ + c) * kernel_dim + k];
+        }
+      }
+    }
+    const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+    for (int i = 0; i < bottom.size(); ++i) {
+      caffe_parallel_for(top[i]->count(0, 2), boost::bind(
+          &ConvolutionLayer<Dtype>::BlockedForwardRange_cpu, this,
+          bottom[i]->cpu_data(), blocked_weight_.cpu_data(), bias,
+          top[i]->mutable_cpu_data(), _1, _2));
+    }
+    return;
+  }
+  // The batch is cut into one slice per intra-op thread, each slice with its
+  // own column buffer; with a single thread this is the plain image loop.
+  const int num_slices = this->cpu_batch_slices();
+  vector<Dtype*> col_buffers;
+  this->cpu_slice_col_buffers(num_slices, &col_buffers);
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  if (quantized_) {
+    // The filters are quantized again whenever they are replaced or written.
+    if (quantized_memory_ != this->blobs_[0]->data() ||
+        quantized_version_ != quantized_memory_->version()) {
+      QuantizeWeights_cpu();
+    }
+    const int col_count =
+        this->blobs_[0]->count(1) * this->group_ * this->out_spatial_dim_;
+    quantized_col_.resize(num_slices * col_count);
+    quantized_output_.resize(num_slices * this->top_dim_);
+    for (int i = 0; i < bottom.size(); ++i) {
+      caffe_parallel_for(num_slices, boost::bind(
+          &ConvolutionLayer<Dtype>::QuantizedForwardSlices_cpu, this,
+          bottom[i]->cpu_data(), bias, top[i]->mutable_cpu_data(),
+          boost::cref(col_buffers), _1, _2));
+    }
+    return;
+  }
   const Dtype* weight = this->blobs_[0]->cpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
+    caffe_parallel_for(num_slices, boost::bind(
+        &ConvolutionLayer<Dtype>::ForwardSlices_cpu, this,
+        bottom[i]->cpu_data(), weight, bias, top[i]->mutable_cpu_data(),
+        boost::cref(col_buffers), _1, _2));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ForwardSlices_cpu(const Dtype* bottom_data,
+      const Dtype* weight, const Dtype* bias, Dtype* top_data,
+      const vector<Dtype*>& col_buffers, int begin, int end) {
+  for (int s = begin; s < end; ++s) {
+    int n_begin, n_end;
+    this->cpu_batch_slice(s, col_buffers.size(), &n_begin, &n_end);
+    for (int n = n_begin; n < n_end; ++n) {
       this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
+          top_data + n * this->top_dim_, false, col_buffers[s]);
       if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
+      if (fused_relu_) {
+        caffe_cpu_relu(this->top_dim_, relu_negative_slope_,
+            top_data + n * this->top_dim_);
+      }
     }
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::QuantizedForwardSlices_cpu(
+      const Dtype* bottom_data, const Dtype* bias, Dtype* top_data,
+      const vector<Dtype*>& col_buffers, int begin, int end) {
+  const int col_count = quantized_col_.size() / col_buffers.size();
+  for (int s = begin; s < end; ++s) {
+    int n_begin, n_end;
+    this->cpu_batch_slice(s, col_buffers.size(), &n_begin, &n_end);
+    for (int n = n_begin; n < n_end; ++n) {
+      this->forward_cpu_gemm_s8(bottom_data + n * this->bottom_dim_,
+          &packed_weight_[0], &weight_scale_[0], bottom_scale_,
+          top_data + n * this->top_dim_, col_buffers[s],
+          &quantized_col_[s * col_count],
+          &quantized_output_[s * this->top_dim_]);
+      if (this->bias_term_) {
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+      if (fused_relu_) {
+        caffe_cpu_relu(this->top_dim_, relu_negative_slope_,
+            top_data + n * this->top_dim_);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::QuantizeWeights_cpu() {
+  // Each output channel gets its own scale. The filters of a group are then
+  // packed transposed, as forward_cpu_gemm_s8 computes the output with one
+  // row per pixel.
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int group_outputs = this->num_output_ / this->group_;
+  vector<int8_t> quantized_weight(this->blobs_[0]->count());
+  weight_scale_.resize(this->num_output_);
+  caffe_cpu_quantize_rows(this->num_output_, kernel_dim,
+      this->blobs_[0]->cpu_data(), &quantized_weight[0], &weight_scale_[0]);
+  const int packed_size =
+      caffe_cpu_gemm_s8_packed_size(kernel_dim, group_outputs);
+  packed_weight_.resize(this->group_ * packed_size);
+  for (int g = 0; g < this->group_; ++g) {
+    caffe_cpu_gemm_s8_pack(CblasTrans, kernel_dim, group_outputs,
+        &quantized_weight[g * group_outputs * kernel_dim],
+        &packed_weight_[g * packed_size]);
+  }
+  if (this->layer_param_.quantization_param().release_float_weights()) {
+    this->blobs_[0]->ShareDataMemory(shared_ptr<SyncedMemory>(
+        new SyncedMemory(this->blobs_[0]->count() * sizeof(Dtype))));
+  }
+  quantized_memory_ = this->blobs_[0]->data();
+  quantized_version_ = quantized_memory_->version();
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (fused_relu_) {
+    // The ReLU gradient only depends on the output, so it is applied to the
+    // top diff in place, as by an in-place ReLU layer.
+    for (int i = 0; i < top.size(); ++i) {
+      caffe_cpu_relu_backward(top[i]->count(), relu_negative_slope_,
+          top[i]->cpu_data(), top[i]->mutable_cpu_diff());
+    }
+  }
+  if (top[0]->channel_block() > 1) {
+    // Blocked input is differentiated in the plain layout.
+    for (int i = 0; i < top.size(); ++i) {
+      caffe_cpu_unblock_channels(bottom[i]->shape(0), this->channels_,
+          plain_bottom_[i]->count(2), channel_block_, bottom[i]->cpu_data(),
+          plain_bottom_[i]->mutable_cpu_data());
+      caffe_cpu_unblock_channels(top[i]->shape(0), this->num_output_,
+          plain_top_[i]->count(2), channel_block_, top[i]->cpu_diff(),
+          plain_top_[i]->mutable_cpu_diff());
+    }
+    PlainBackward_cpu(plain_top_vec_, propagate_down, plain_bottom_vec_);
+    for (int i = 0; i < top.size(); ++i) {
+      if (propagate_down[i]) {
+        caffe_cpu_block_channels(bottom[i]->shape(0), this->channels_,
+            plain_bottom_[i]->count(2), channel_block_,
+            plain_bottom_[i]->cpu_diff(), bottom[i]->mutable_cpu_diff());
+      }
+    }
+    return;
+  }
+  PlainBackward_cpu(top, propagate_down, bottom);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::PlainBackward_cpu(
+      const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+      const vector<Blob<Dtype>*>& bottom) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  const int num_slices = this->cpu_batch_slices();
+  vector<Dtype*> col_buffers;
+  this->cpu_slice_col_buffers(num_slices, &col_buffers);
+  // Slices other than the first accumulate their weight gradient separately;
+  // the partial gradients are summed into weight_diff at the end.
+  vector<Dtype*> weight_diffs;
+  if (this->param_propagate_down_[0]) {
+    this->cpu_slice_weight_diffs(num_slices, weight_diff, &weight_diffs);
+  } else {
+    weight_diffs.assign(num_slices, static_cast<Dtype*>(NULL));
+  }
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
@@ -56,18 +308,327 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
+      Dtype* bottom_diff = propagate_down[i] ?
+          bottom[i]->mutable_cpu_diff() : NULL;
+      caffe_parallel_for(num_slices, boost::bind(
+          &ConvolutionLayer<Dtype>::BackwardSlices_cpu, this, top_diff,
+          bottom_data, weight, bottom_diff, boost::cref(col_buffers),
+          boost::cref(weight_diffs), _1, _2));
+    }
+  }
+  if (this->param_propagate_down_[0]) {
+    this->cpu_reduce_weight_diffs(weight_diffs);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::BackwardSlices_cpu(const Dtype* top_diff,
+      const Dtype* bottom_data, const Dtype* weight, Dtype* bottom_diff,
+      const vector<Dtype*>& col_buffers, const vector<Dtype*>& weight_diffs,
+      int begin, int end) {
+  for (int s = begin; s < end; ++s) {
+    int n_begin, n_end;
+    this->cpu_batch_slice(s, col_buffers.size(), &n_begin, &n_end);
+    for (int n = n_begin; n < n_end; ++n) {
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (weight_diffs[s]) {
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diffs[s], col_buffers[s]);
+      }
+      // gradient w.r.t. bottom data, if necessary.
+      if (bottom_diff) {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_, col_buffers[s]);
+      }
+    }
+  }
+}
+
+namespace {
+
+// Accumulates the products of count blocked input pixels, input_stride
+// elements apart, with one block x block filter tap into count consecutive
+// blocked output pixels. With the block size known at compile time the
+// output blocks of kPixels pixels are kept in registers across the input
+// channels, and every filter row loaded is used for all of them.
+template <typename Dtype, int kBlock>
+void BlockedTapRow(const Dtype* input, int input_stride, const Dtype* filter,
+    Dtype* output, int count) {
+  const int kPixels = 4;
+  int x = 0;
+  for (; x + kPixels <= count; x += kPixels) {
+    Dtype sum[kPixels][kBlock];
+    for (int p = 0; p < kPixels; ++p) {
+      for (int o = 0; o < kBlock; ++o) {
+        sum[p][o] = output[p * kBlock + o];
+      }
+    }
+    for (int c = 0; c < kBlock; ++c) {
+      for (int p = 0; p < kPixels; ++p) {
+        const Dtype value = input[p * input_stride + c];
+        for (int o = 0; o < kBlock; ++o) {
+          sum[p][o] += value * filter[c * kBlock + o];
+        }
+      }
+    }
+    for (int p = 0; p < kPixels; ++p) {
+      for (int o = 0; o < kBlock; ++o) {
+        output[p * kBlock + o] = sum[p][o];
+      }
+    }
+    input += kPixels * input_stride;
+    output += kPixels * kBlock;
+  }
+  for (; x < count; ++x) {
+    Dtype sum[kBlock];
+    for (int o = 0; o < kBlock; ++o) {
+      sum[o] = output[o];
+    }
+    for (int c = 0; c < kBlock; ++c) {
+      const Dtype value = input[c];
+      for (int o = 0; o < kBlock; ++o) {
+        sum[o] += value * filter[c * kBlock + o];
+      }
+    }
+    for (int o = 0; o < kBlock; ++o) {
+      output[o] = sum[o];
+    }
+    input += input_stride;
+    output += kBlock;
+  }
+}
+
+#ifdef CAFFE_BLOCKED_CONV_AVX2
+// The float micro-kernels for blocks of 8 and 16 channels, one or two AVX
+// registers per output pixel. They are compiled for AVX2 and FMA whatever
+// the build flags, and chosen at run time on CPUs that have both. Every
+// input channel of the block is broadcast and multiplied by one filter row
+// into the sums of kPixels pixels, which stay in registers for the whole
+// block. The filters come from blocked_weight_, whose rows are 32 byte
+// aligned as host memory is.
+template <int kPixels>
+__attribute__((target("avx2,fma"), always_inline))
+inline void BlockedTapPixels8Avx2(const float* input, int input_stride,
+    const float* filter, float* output) {
+  __m256 sum[kPixels];
+#pragma GCC unroll 8
+  for (int p = 0; p < kPixels; ++p) {
+    sum[p] = _mm256_loadu_ps(output + p * 8);
+  }
+#pragma GCC unroll 8
+  for (int c = 0; c < 8; ++c) {
+    const __m256 row = _mm256_load_ps(filter + c * 8);
+#pragma GCC unroll 8
+    for (int p = 0; p < kPixels; ++p) {
+      sum[p] = _mm256_fmadd_ps(
+          _mm256_broadcast_ss(input + p * input_stride + c), row, sum[p]);
+    }
+  }
+#pragma GCC unroll 8
+  for (int p = 0; p < kPixels; ++p) {
+    _mm256_storeu_ps(output + p * 8, sum[p]);
+  }
+}
+
+__attribute__((target("avx2,fma")))
+void BlockedTapRow8Avx2(const float* input, int input_stride,
+    const float* filter, float* output, int count) {
+  int x = 0;
+  if (input_stride == 8) {
+    // Stride 1: the input pixels are at constant offsets from input.
+    for (; x + 8 <= count; x += 8) {
+      BlockedTapPixels8Avx2<8>(input, 8, filter, output);
+      input += 8 * 8;
+      output += 8 * 8;
+    }
+  }
+  for (; x + 8 <= count; x += 8) {
+    BlockedTapPixels8Avx2<8>(input, input_stride, filter, output);
+    input += 8 * input_stride;
+    output += 8 * 8;
+  }
+  for (; x < count; ++x) {
+    BlockedTapPixels8Avx2<1>(input, input_stride, filter, output);
+    input += input_stride;
+    output += 8;
+  }
+}
+
+template <int kPixels>
+__attribute__((target("avx2,fma"), always_inline))
+inline void BlockedTapPixels16Avx2(const float* input, int input_stride,
+    const float* filter, float* output) {
+  __m256 low[kPixels];
+  __m256 high[kPixels];
+#pragma GCC unroll 8
+  for (int p = 0; p < kPixels; ++p) {
+    low[p] = _mm256_loadu_ps(output + p * 16);
+    high[p] = _mm256_loadu_ps(output + p * 16 + 8);
+  }
+#pragma GCC unroll 16
+  for (int c = 0; c < 16; ++c) {
+    const __m256 row_low = _mm256_load_ps(filter + c * 16);
+    const __m256 row_high = _mm256_load_ps(filter + c * 16 + 8);
+#pragma GCC unroll 8
+    for (int p = 0; p < kPixels; ++p) {
+      const __m256 value = _mm256_broadcast_ss(input + p * input_stride + c);
+      low[p] = _mm256_fmadd_ps(value, row_low, low[p]);
+      high[p] = _mm256_fmadd_ps(value, row_high, high[p]);
+    }
+  }
+#pragma GCC unroll 8
+  for (int p = 0; p < kPixels; ++p) {
+    _mm256_storeu_ps(output + p * 16, low[p]);
+    _mm256_storeu_ps(output + p * 16 + 8, high[p]);
+  }
+}
+
+__attribute__((target("avx2,fma")))
+void BlockedTapRow16Avx2(const float* input, int input_stride,
+    const float* filter, float* output, int count) {
+  int x = 0;
+  if (input_stride == 16) {
+    for (; x + 6 <= count; x += 6) {
+      BlockedTapPixels16Avx2<6>(input, 16, filter, output);
+      input += 6 * 16;
+      output += 6 * 16;
+    }
+  }
+  for (; x + 6 <= count; x += 6) {
+    BlockedTapPixels16Avx2<6>(input, input_stride, filter, output);
+    input += 6 * input_stride;
+    output += 6 * 16;
+  }
+  for (; x < count; ++x) {
+    BlockedTapPixels16Avx2<1>(input, input_stride, filter, output);
+    input += input_stride;
+    output += 16;
+  }
+}
+#endif  // CAFFE_BLOCKED_CONV_AVX2
+
+// Runs the vector micro-kernel for block where there is one, and returns
+// whether it did.
+template <typename Dtype>
+bool BlockedTapRowSimd(const Dtype* input, int input_stride,
+    const Dtype* filter, Dtype* output, int count, int block) {
+  return false;
+}
+
+template <>
+bool BlockedTapRowSimd<float>(const float* input, int input_stride,
+    const float* filter, float* output, int count, int block) {
+#ifdef CAFFE_BLOCKED_CONV_AVX2
+  if (!caffe_cpu_has_avx2()) {
+    return false;
+  }
+  switch (block) {
+  case 8:
+    BlockedTapRow8Avx2(input, input_stride, filter, output, count);
+    return true;
+  case 16:
+    BlockedTapRow16Avx2(input, input_stride, filter, output, count);
+    return true;
+  }
+#endif  // CAFFE_BLOCKED_CONV_AVX2
+  return false;
+}
+
+template <typename Dtype>
+void BlockedTapRow(const Dtype* input, int input_stride, const Dtype* filter,
+    Dtype* output, int count, int block) {
+  if (BlockedTapRowSimd(input, input_stride, filter, output, count, block)) {
+    return;
+  }
+  switch (block) {
+  case 4:
+    BlockedTapRow<Dtype, 4>(input, input_stride, filter, output, count);
+    return;
+  case 8:
+    BlockedTapRow<Dtype, 8>(input, input_stride, filter, output, count);
+    return;
+  case 16:
+    BlockedTapRow<Dtype, 16>(input, input_stride, filter, output, count);
+    return;
+  }
+  for (int x = 0; x < count; ++x) {
+    for (int c = 0; c < block; ++c) {
+      const Dtype value = input[c];
+      const Dtype* filter_row = filter + c * block;
+      for (int o = 0; o < block; ++o) {
+        output[o] += value * filter_row[o];
+      }
+    }
+    input += input_stride;
+    output += block;
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::BlockedForwardRange_cpu(
+      const Dtype* bottom_data, const Dtype* blocked_weight, const Dtype* bias,
+      Dtype* top_data, int begin, int end) {
+  const int block = channel_block_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int input_blocks = this->channels_ / block;
+  const int output_blocks = this->num_output_ / block;
+  for (int index = begin; index < end; ++index) {
+    const int n = index / output_blocks;
+    const int ob = index % output_blocks;
+    const Dtype* filters = blocked_weight
+        + ob * input_blocks * kernel_h * kernel_w * block * block;
+    // One output row at a time, so that the row being accumulated and the
+    // filters of an input block stay in cache across all the taps.
+    for (int y = 0; y < output_h; ++y) {
+      Dtype* output = top_data + (index * output_h + y) * output_w * block;
+      for (int x = 0; x < output_w; ++x) {
+        for (int o = 0; o < block; ++o) {
+          output[x * block + o] = bias ? bias[ob * block + o] : Dtype(0);
         }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
+      }
+      for (int ib = 0; ib < input_blocks; ++ib) {
+        const Dtype* input = bottom_data
+            + (n * input_blocks + ib) * height * width * block;
+        for (int kh = 0; kh < kernel_h; ++kh) {
+          const int input_y = y * stride_h - pad_h + kh * dilation_h;
+          if (input_y < 0 || input_y >= height) {
+            continue;
+          }
+          for (int kw = 0; kw < kernel_w; ++kw) {
+            const Dtype* filter = filters + ((ib * kernel_h + kh) * kernel_w
+                + kw) * block * block;
+            // The output columns whose input column lies inside the image.
+            const int offset_w = kw * dilation_w - pad_w;
+            const int x_begin = offset_w >= 0 ? 0 :
+                (-offset_w + stride_w - 1) / stride_w;
+            const int x_end = width - offset_w <= 0 ? 0 : std::min(output_w,
+                (width - 1 - offset_w) / stride_w + 1);
+            if (x_begin >= x_end) {
+              continue;
+            }
+            BlockedTapRow(input
+                + (input_y * width + x_begin * stride_w + offset_w) * block,
+                stride_w * block, filter, output + x_begin * block,
+                x_end - x_begin, block);
+          }
         }
       }
+      if (fused_relu_) {
+        caffe_cpu_relu(output_w * block, relu_negative_slope_, output);
+      }
     }
   }
 }
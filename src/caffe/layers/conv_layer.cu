@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -19,12 +20,21 @@ void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
         this->forward_gpu_bias(top_data + n * this->top_dim_, bias);
       }
     }
+    if (fused_relu_) {
+      caffe_gpu_relu(top[i]->count(), relu_negative_slope_, top_data);
+    }
   }
 }
 
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (fused_relu_) {
+    for (int i = 0; i < top.size(); ++i) {
+      caffe_gpu_relu_backward(top[i]->count(), relu_negative_slope_,
+          top[i]->gpu_data(), top[i]->mutable_gpu_diff());
+    }
+  }
   const Dtype* weight = this->blobs_[0]->gpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_gpu_diff();
   for (int i = 0; i < top.size(); ++i) {
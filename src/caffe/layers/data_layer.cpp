@@ -5,16 +5,21 @@
 
 #include <vector>
 
+#include "boost/bind.hpp"
+
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    reader_(param),
+    raw_batch_(param.data_param().raw_batch()) {
 }
 
 template <typename Dtype>
@@ -28,15 +33,19 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
   Datum& datum = *(reader_.full().peek());
+  if (raw_batch_) {
+    CHECK(!datum.encoded()) << "raw_batch needs datums that are not encoded";
+  }
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
   this->transformed_data_.Reshape(top_shape);
-  // Reshape top[0] and prefetch_data according to the batch_size.
+  // Reshape top[0] and prefetch_data according to the batch_size. Raw
+  // batches allocate their uint8 data as they are loaded.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size() && !raw_batch_; ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -45,9 +54,23 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
+    }
+  }
+  const int transform_threads =
+      this->layer_param_.data_param().transform_threads();
+  CHECK_GE(transform_threads, 1);
+  if (transform_threads > 1) {
+    transform_pool_.reset(new ThreadPool(transform_threads));
+    for (int i = 0; i < transform_threads; ++i) {
+      worker_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+          new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+      worker_transformed_data_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
     }
+    worker_trans_time_.resize(transform_threads);
+    LOG(INFO) << "Transforming with " << transform_threads << " threads";
   }
 }
 
@@ -60,7 +83,7 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch)
   double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
-  CHECK(batch->data_.count());
+  CHECK(raw_batch_ || batch->data_.count());
   CHECK(this->transformed_data_.count());
 
   // Reshape according to the first datum of each batch
@@ -74,35 +97,157 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch)
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
 
-  Dtype* top_data = batch->data_.mutable_cpu_data();
+  // Raw batches only take the shape from data_.
+  Dtype* top_data = NULL;
+  uint8_t* raw_data = NULL;
+  if (raw_batch_) {
+    batch->raw_data_.resize(batch->data_.count());
+    batch->raw_crops_.resize(batch_size);
+    raw_data = &batch->raw_data_[0];
+  } else {
+    top_data = batch->data_.mutable_cpu_data();
+  }
   Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
 
   if (this->output_labels_) {
     top_label = batch->label_.mutable_cpu_data();
   }
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
+  if (transform_pool_) {
+    // Read the datums in order, then transform them into their slots of the
+    // batch on the pool. Each item seeds its own random crop and mirror.
+    vector<Datum*> datums(batch_size);
+    vector<unsigned int> seeds(batch_size);
     timer.Start();
-    // get a datum
-    Datum& datum = *(reader_.full().pop("Waiting for data"));
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      datums[item_id] = reader_.full().pop("Waiting for data");
+      seeds[item_id] = caffe_rng_rand();
+    }
     read_time += timer.MicroSeconds();
     timer.Start();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
+    for (int i = 0; i < worker_transformed_data_.size(); ++i) {
+      worker_transformed_data_[i]->Reshape(this->transformed_data_.shape());
     }
+    transform_pool_->Run(worker_transformers_.size(),
+        boost::bind(&DataLayer<Dtype>::TransformWorkers, this, _1, _2,
+            boost::cref(datums), boost::cref(seeds), batch, top_data,
+            top_label));
     trans_time += timer.MicroSeconds();
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      reader_.free().push(datums[item_id]);
+    }
+  } else {
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      timer.Start();
+      // get a datum
+      Datum& datum = *(reader_.full().pop("Waiting for data"));
+      read_time += timer.MicroSeconds();
+      timer.Start();
+      // Apply data transformations (mirror, scale, crop...)
+      int offset = batch->data_.offset(item_id);
+      if (raw_batch_) {
+        this->data_transformer_->CropRaw(datum, raw_data + offset,
+            &batch->raw_crops_[item_id]);
+      } else {
+        this->transformed_data_.set_cpu_data(top_data + offset);
+        this->data_transformer_->Transform(datum, &(this->transformed_data_));
+      }
+      // Copy label.
+      if (this->output_labels_) {
+        top_label[item_id] = datum.label();
+      }
+      trans_time += timer.MicroSeconds();
 
-    reader_.free().push(const_cast<Datum*>(&datum));
+      reader_.free().push(const_cast<Datum*>(&datum));
+    }
   }
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  for (int i = 0; i < worker_trans_time_.size(); ++i) {
+    DLOG(INFO) << "      Worker " << i << ": "
+        << worker_trans_time_[i] / 1000 << " ms.";
+  }
+}
+
+// Called on the transform pool: runs workers [begin, end).
+template<typename Dtype>
+void DataLayer<Dtype>::TransformWorkers(int begin, int end,
+    const vector<Datum*>& datums, const vector<unsigned int>& seeds,
+    Batch<Dtype>* batch, Dtype* top_data, Dtype* top_label) {
+  for (int worker = begin; worker < end; ++worker) {
+    TransformItems(worker, datums, seeds, batch, top_data, top_label);
+  }
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::TransformItems(int worker,
+    const vector<Datum*>& datums, const vector<unsigned int>& seeds,
+    Batch<Dtype>* batch, Dtype* top_data, Dtype* top_label) {
+  TraceScope trace(this->layer_param_.name(), "transform");
+  trace.AddArg("worker", worker);
+  CPUTimer timer;
+  timer.Start();
+  const int num_workers = worker_transformers_.size();
+  const int batch_size = datums.size();
+  // Each worker takes a contiguous range of the batch.
+  const int first = worker * batch_size / num_workers;
+  const int last = (worker + 1) * batch_size / num_workers;
+  DataTransformer<Dtype>* transformer = worker_transformers_[worker].get();
+  Blob<Dtype>* transformed_data = worker_transformed_data_[worker].get();
+  const int item_count = transformed_data->count();
+  for (int item_id = first; item_id < last; ++item_id) {
+    transformer->SeedRand(seeds[item_id]);
+    if (raw_batch_) {
+      transformer->CropRaw(*datums[item_id],
+          &batch->raw_data_[item_id * item_count], &batch->raw_crops_[item_id]);
+    } else {
+      transformed_data->set_cpu_data(top_data + item_id * item_count);
+      transformer->Transform(*datums[item_id], transformed_data);
+    }
+    if (top_label) {
+      top_label[item_id] = datums[item_id]->label();
+    }
+  }
+  worker_trans_time_[worker] = timer.MicroSeconds();
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (!raw_batch_) {
+    BasePrefetchingDataLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  Batch<Dtype>* batch = this->NextBatch();
+  top[0]->ReshapeLike(batch->data_);
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int item_count = top[0]->count(1);
+  for (int item_id = 0; item_id < top[0]->num(); ++item_id) {
+    this->data_transformer_->TransformRaw(
+        &batch->raw_data_[item_id * item_count], batch->raw_crops_[item_id],
+        top[0]->channels(), top[0]->height(), top[0]->width(),
+        top_data + item_id * item_count);
+  }
+  if (this->output_labels_) {
+    top[1]->ReshapeLike(batch->label_);
+    caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
+        top[1]->mutable_cpu_data());
+  }
+  this->prefetch_free_.push(batch);
+}
+
+// Raw batches are transformed on the host; the layers that follow copy them
+// to the device.
+template<typename Dtype>
+void DataLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (raw_batch_) {
+    Forward_cpu(bottom, top);
+  } else {
+    BasePrefetchingDataLayer<Dtype>::Forward_gpu(bottom, top);
+  }
 }
 
 INSTANTIATE_CLASS(DataLayer);
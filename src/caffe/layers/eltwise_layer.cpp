@@ -1,8 +1,11 @@
+#include <boost/bind.hpp>
+
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/eltwise_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -32,6 +35,8 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   for (int i = 1; i < bottom.size(); ++i) {
     CHECK(bottom[i]->shape() == bottom[0]->shape());
+    CHECK_EQ(bottom[i]->channel_block(), bottom[0]->channel_block())
+        << "All bottoms must have the same layout.";
   }
   top[0]->ReshapeLike(*bottom[0]);
   // If max operation, we will initialize the vector index part.
@@ -44,33 +49,51 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  vector<const Dtype*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
   int* mask = NULL;
+  if (op_ == EltwiseParameter_EltwiseOp_MAX) {
+    mask = max_idx_.mutable_cpu_data();
+  }
+  caffe_parallel_for(top[0]->count(),
+      boost::bind(&EltwiseLayer<Dtype>::ForwardRange_cpu, this,
+      boost::cref(bottom_data), top[0]->mutable_cpu_data(), mask, _1, _2),
+      kParallelElementwiseGrain);
+}
+
+template <typename Dtype>
+void EltwiseLayer<Dtype>::ForwardRange_cpu(
+    const vector<const Dtype*>& bottom_data, Dtype* top_data, int* mask,
+    int begin, int end) {
   const Dtype* bottom_data_a = NULL;
   const Dtype* bottom_data_b = NULL;
-  const int count = top[0]->count();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int count = end - begin;
+  top_data += begin;
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
+    caffe_mul(count, bottom_data[0] + begin, bottom_data[1] + begin,
+        top_data);
+    for (int i = 2; i < bottom_data.size(); ++i) {
+      caffe_mul(count, top_data, bottom_data[i] + begin, top_data);
     }
     break;
   case EltwiseParameter_EltwiseOp_SUM:
     caffe_set(count, Dtype(0), top_data);
     // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
+    for (int i = 0; i < bottom_data.size(); ++i) {
+      caffe_axpy(count, coeffs_[i], bottom_data[i] + begin, top_data);
     }
     break;
   case EltwiseParameter_EltwiseOp_MAX:
     // Initialize
-    mask = max_idx_.mutable_cpu_data();
+    mask += begin;
     caffe_set(count, -1, mask);
     caffe_set(count, Dtype(-FLT_MAX), top_data);
     // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
+    bottom_data_a = bottom_data[0] + begin;
+    bottom_data_b = bottom_data[1] + begin;
     for (int idx = 0; idx < count; ++idx) {
       if (bottom_data_a[idx] > bottom_data_b[idx]) {
         top_data[idx] = bottom_data_a[idx];  // maxval
@@ -81,8 +104,8 @@ void EltwiseLayer<Dtype>::Forward_cpu(
       }
     }
     // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
+    for (int blob_idx = 2; blob_idx < bottom_data.size(); ++blob_idx) {
+      bottom_data_b = bottom_data[blob_idx] + begin;
       for (int idx = 0; idx < count; ++idx) {
         if (bottom_data_b[idx] > top_data[idx]) {
           top_data[idx] = bottom_data_b[idx];  // maxval
@@ -99,48 +122,67 @@ void EltwiseLayer<Dtype>::Forward_cpu(
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  const int* mask = NULL;
-  const int count = top[0]->count();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* top_diff = top[0]->cpu_diff();
+  vector<const Dtype*> bottom_data(bottom.size());
+  vector<Dtype*> bottom_diff(bottom.size(), static_cast<Dtype*>(NULL));
   for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
     if (propagate_down[i]) {
-      const Dtype* bottom_data = bottom[i]->cpu_data();
-      Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      bottom_diff[i] = bottom[i]->mutable_cpu_diff();
+    }
+  }
+  const int* mask = NULL;
+  if (op_ == EltwiseParameter_EltwiseOp_MAX) {
+    mask = max_idx_.cpu_data();
+  }
+  caffe_parallel_for(top[0]->count(),
+      boost::bind(&EltwiseLayer<Dtype>::BackwardRange_cpu, this,
+      boost::cref(bottom_data), boost::cref(bottom_diff), top[0]->cpu_data(),
+      top[0]->cpu_diff(), mask, _1, _2), kParallelElementwiseGrain);
+}
+
+template <typename Dtype>
+void EltwiseLayer<Dtype>::BackwardRange_cpu(
+    const vector<const Dtype*>& bottom_data,
+    const vector<Dtype*>& bottom_diff, const Dtype* top_data,
+    const Dtype* top_diff, const int* mask, int begin, int end) {
+  const int count = end - begin;
+  top_data += begin;
+  top_diff += begin;
+  for (int i = 0; i < bottom_data.size(); ++i) {
+    if (bottom_diff[i]) {
+      Dtype* diff = bottom_diff[i] + begin;
       switch (op_) {
       case EltwiseParameter_EltwiseOp_PROD:
         if (stable_prod_grad_) {
           bool initialized = false;
-          for (int j = 0; j < bottom.size(); ++j) {
+          for (int j = 0; j < bottom_data.size(); ++j) {
             if (i == j) { continue; }
             if (!initialized) {
-              caffe_copy(count, bottom[j]->cpu_data(), bottom_diff);
+              caffe_copy(count, bottom_data[j] + begin, diff);
               initialized = true;
             } else {
-              caffe_mul(count, bottom[j]->cpu_data(), bottom_diff,
-                        bottom_diff);
+              caffe_mul(count, bottom_data[j] + begin, diff, diff);
             }
           }
         } else {
-          caffe_div(count, top_data, bottom_data, bottom_diff);
+          caffe_div(count, top_data, bottom_data[i] + begin, diff);
         }
-        caffe_mul(count, bottom_diff, top_diff, bottom_diff);
+        caffe_mul(count, diff, top_diff, diff);
         break;
       case EltwiseParameter_EltwiseOp_SUM:
         if (coeffs_[i] == Dtype(1)) {
-          caffe_copy(count, top_diff, bottom_diff);
+          caffe_copy(count, top_diff, diff);
         } else {
-          caffe_cpu_scale(count, coeffs_[i], top_diff, bottom_diff);
+          caffe_cpu_scale(count, coeffs_[i], top_diff, diff);
         }
         break;
       case EltwiseParameter_EltwiseOp_MAX:
-        mask = max_idx_.cpu_data();
         for (int index = 0; index < count; ++index) {
           Dtype gradient = 0;
-          if (mask[index] == i) {
+          if (mask[begin + index] == i) {
             gradient += top_diff[index];
           }
-          bottom_diff[index] = gradient;
+          diff[index] = gradient;
         }
         break;
       default:
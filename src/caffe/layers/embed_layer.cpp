@@ -2,6 +2,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/embed_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -65,15 +66,29 @@ template <typename Dtype>
 void EmbedLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  // The weights may be held in 16 bits (see ParamSpec.storage), in which
+  // case only the rows looked up are converted.
+  const BlobProto_Storage storage = this->blobs_[0]->storage();
+  const Dtype* weight = NULL;
+  const uint16_t* half_weight = NULL;
+  if (storage == BlobProto_Storage_FLOAT) {
+    weight = this->blobs_[0]->cpu_data();
+  } else {
+    half_weight = this->blobs_[0]->half_data();
+  }
   int index;
   for (int n = 0; n < M_; ++n) {
     index = static_cast<int>(bottom_data[n]);
     DCHECK_GE(index, 0);
     DCHECK_LT(index, K_);
     DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n]) << "non-integer input";
-    caffe_copy(N_, weight + index * N_, top_data + n * N_);
+    if (weight) {
+      caffe_copy(N_, weight + index * N_, top_data + n * N_);
+    } else {
+      caffe_cpu_from_half(N_, storage, half_weight + index * N_,
+          top_data + n * N_);
+    }
   }
   if (bias_term_) {
     const Dtype* bias = this->blobs_[1]->cpu_data();
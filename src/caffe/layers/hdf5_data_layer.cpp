@@ -1,11 +1,7 @@
-/*
-TODO:
-- load file in a separate thread ("prefetch")
-- can be smarter about the memcpy call instead of doing it row-by-row
-  :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
-*/
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <climits>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -14,62 +10,175 @@ TODO:
 #include "hdf5_hl.h"
 #include "stdint.h"
 
+#include "caffe/internal_thread.hpp"
 #include "caffe/layers/hdf5_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+// Reads the files in chunks onto full_, taking the chunks to read into from
+// free_. With two chunks, one is read while the other is being output.
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+class HDF5DataLayer<Dtype>::ChunkReader : public InternalThread {
+ public:
+  // The shapes of the rows of each top are checked against top_shapes. A
+  // resident reader holds the single file in a single chunk, which is read
+  // once and output again every epoch.
+  ChunkReader(const LayerParameter& param, const vector<string>& filenames,
+      const vector<vector<int> >& top_shapes, bool resident)
+      : param_(param), filenames_(filenames), top_shapes_(top_shapes),
+        resident_(resident) {
+    const int num_chunks = resident_ ? 1 : 2;
+    for (int i = 0; i < num_chunks; ++i) {
+      chunks_.push_back(shared_ptr<Chunk>(new Chunk()));
+      for (int j = 0; j < top_shapes_.size(); ++j) {
+        chunks_[i]->blobs_.push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      }
+      free_.push(chunks_[i].get());
+    }
+  }
+  virtual ~ChunkReader() { StopInternalThread(); }
+
+  BlockingQueue<Chunk*> free_;
+  BlockingQueue<Chunk*> full_;
+
+ protected:
+  virtual void InternalThreadEntry();
+  // Reads the chunks of filename in turn, and returns its number of rows.
+  int ReadFile(const string& filename);
+  int CountRows(const string& filename);
+  void ReadRows(const string& filename, int first, int num, Chunk* chunk);
+
+  const LayerParameter param_;
+  const vector<string> filenames_;
+  const vector<vector<int> > top_shapes_;
+  const bool resident_;
+  vector<shared_ptr<Chunk> > chunks_;
+};
 
-// Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
-  DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
-    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+void HDF5DataLayer<Dtype>::ChunkReader::InternalThreadEntry() {
+  const bool shuffle_files = param_.hdf5_data_param().shuffle();
+  vector<int> file_order(filenames_.size());
+  for (int i = 0; i < file_order.size(); ++i) {
+    file_order[i] = i;
   }
+  try {
+    if (resident_) {
+      Chunk* chunk = free_.pop();
+      ReadRows(filenames_[0], 0, CountRows(filenames_[0]), chunk);
+      while (true) {
+        full_.push(chunk);
+        chunk = free_.pop();
+      }
+    }
+    while (!must_stop()) {
+      if (shuffle_files) {
+        shuffle(file_order.begin(), file_order.end());
+      }
+      int rows = 0;
+      for (int i = 0; i < file_order.size(); ++i) {
+        rows += ReadFile(filenames_[file_order[i]]);
+      }
+      CHECK_GT(rows, 0) << "The HDF5 files of "
+          << param_.hdf5_data_param().source() << " hold no rows.";
+      DLOG(INFO) << "Looping around to first file.";
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
 
-  int top_size = this->layer_param_.top_size();
-  hdf_blobs_.resize(top_size);
-
-  const int MIN_DATA_DIM = 1;
-  const int MAX_DATA_DIM = INT_MAX;
+template <typename Dtype>
+int HDF5DataLayer<Dtype>::ChunkReader::ReadFile(const string& filename) {
+  const int rows = CountRows(filename);
+  const int chunk_size = param_.hdf5_data_param().chunk_size() > 0 ?
+      param_.hdf5_data_param().chunk_size() : rows;
+  vector<int> chunk_order(rows > 0 ? (rows + chunk_size - 1) / chunk_size : 0);
+  for (int i = 0; i < chunk_order.size(); ++i) {
+    chunk_order[i] = i;
+  }
+  if (param_.hdf5_data_param().shuffle()) {
+    shuffle(chunk_order.begin(), chunk_order.end());
+  }
+  for (int i = 0; i < chunk_order.size(); ++i) {
+    const int first = chunk_order[i] * chunk_size;
+    Chunk* chunk = free_.pop();
+    ReadRows(filename, first, std::min(chunk_size, rows - first), chunk);
+    full_.push(chunk);
+  }
+  return rows;
+}
 
-  for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get());
+template <typename Dtype>
+int HDF5DataLayer<Dtype>::ChunkReader::CountRows(const string& filename) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << filename;
+  int rows = 0;
+  for (int i = 0; i < param_.top_size(); ++i) {
+    const vector<int> shape = hdf5_get_dataset_shape(file_id,
+        param_.top(i).c_str(), 1, INT_MAX);
+    if (i == 0) {
+      rows = shape[0];
+    }
+    CHECK_EQ(shape[0], rows) << "The datasets of " << filename
+        << " have different numbers of rows.";
   }
+  herr_t status = H5Fclose(file_id);
+  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+  return rows;
+}
 
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::ChunkReader::ReadRows(const string& filename,
+    int first, int num, Chunk* chunk) {
+  DLOG(INFO) << "Loading rows " << first << " to " << first + num
+      << " of HDF5 file: " << filename;
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << filename;
+  for (int i = 0; i < param_.top_size(); ++i) {
+    Blob<Dtype>* blob = chunk->blobs_[i].get();
+    hdf5_load_nd_dataset_rows(file_id, param_.top(i).c_str(), first, num,
+        blob);
+    CHECK_EQ(blob->num_axes(), top_shapes_[i].size()) << "Dataset "
+        << param_.top(i) << " of " << filename << " has a different shape "
+        << "from the first file's.";
+    for (int j = 1; j < top_shapes_[i].size(); ++j) {
+      CHECK_EQ(blob->shape(j), top_shapes_[i][j]) << "Dataset "
+          << param_.top(i) << " of " << filename << " has a different shape "
+          << "from the first file's.";
+    }
+  }
   herr_t status = H5Fclose(file_id);
   CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+}
+
+template <typename Dtype>
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  // Stop the prefetch thread before the reader it takes chunks from.
+  this->StopInternalThread();
+  reader_.reset();
+}
 
-  // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
-  for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+template <typename Dtype>
+Blob<Dtype>* HDF5DataLayer<Dtype>::batch_top(Batch<Dtype>* batch, int i) {
+  if (i == 0) {
+    return &batch->data_;
   }
-  // Default to identity permutation.
-  data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
-    data_permutation_[i] = i;
-
-  // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
-  } else {
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+  if (i == 1) {
+    return &batch->label_;
   }
+  return batch->extra_[i - 2].get();
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+void HDF5DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
@@ -88,78 +197,102 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     LOG(FATAL) << "Failed to open source file: " << source;
   }
   source_file.close();
-  num_files_ = hdf_filenames_.size();
-  current_file_ = 0;
-  LOG(INFO) << "Number of HDF5 files: " << num_files_;
-  CHECK_GE(num_files_, 1) << "Must have at least 1 HDF5 filename listed in "
+  const int num_files = hdf_filenames_.size();
+  LOG(INFO) << "Number of HDF5 files: " << num_files;
+  CHECK_GE(num_files, 1) << "Must have at least 1 HDF5 filename listed in "
     << source;
 
-  file_permutation_.clear();
-  file_permutation_.resize(num_files_);
-  // Default to identity permutation.
-  for (int i = 0; i < num_files_; i++) {
-    file_permutation_[i] = i;
-  }
-
-  // Shuffle if needed.
-  if (this->layer_param_.hdf5_data_param().shuffle()) {
-    std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+  // Shape the tops from the datasets of the first file.
+  const int MIN_DATA_DIM = 1;
+  const int MAX_DATA_DIM = INT_MAX;
+  const int top_size = this->layer_param_.top_size();
+  vector<vector<int> > top_shapes(top_size);
+  {
+    boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
+    const string& filename = hdf_filenames_[0];
+    hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file_id < 0) {
+      LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+    }
+    for (int i = 0; i < top_size; ++i) {
+      top_shapes[i] = hdf5_get_dataset_shape(file_id,
+          this->layer_param_.top(i).c_str(), MIN_DATA_DIM, MAX_DATA_DIM);
+      CHECK_EQ(top_shapes[i][0], top_shapes[0][0]);
+    }
+    herr_t status = H5Fclose(file_id);
+    CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
   }
-
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
-  current_row_ = 0;
+  const int first_rows = top_shapes[0][0];
 
   // Reshape blobs.
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  const int top_size = this->layer_param_.top_size();
-  vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-    top_shape.resize(hdf_blobs_[i]->num_axes());
-    top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
+    top_shapes[i][0] = batch_size;
+    top[i]->Reshape(top_shapes[i]);
+  }
+  for (int p = 0; p < this->prefetch_.size(); ++p) {
+    Batch<Dtype>* batch = this->prefetch_[p].get();
+    batch->extra_.clear();
+    for (int i = 2; i < top_size; ++i) {
+      batch->extra_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+    for (int i = 0; i < top_size; ++i) {
+      batch_top(batch, i)->Reshape(top_shapes[i]);
     }
-    top[i]->Reshape(top_shape);
   }
+
+  // Start reading. A single file that fits in a chunk is only read once.
+  const int chunk_size = this->layer_param_.hdf5_data_param().chunk_size();
+  const bool resident = num_files == 1 &&
+      (chunk_size == 0 || chunk_size >= first_rows);
+  reader_.reset(new ChunkReader(this->layer_param_, hdf_filenames_,
+      top_shapes, resident));
+  reader_->StartInternalThread();
+  chunk_ = NULL;
+  row_order_.clear();
+  current_row_ = 0;
 }
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  double wait_time = 0;
+  CPUTimer timer;
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
+  const int top_size = this->layer_param_.top_size();
   for (int i = 0; i < batch_size; ++i, ++current_row_) {
-    if (current_row_ == hdf_blobs_[0]->shape(0)) {
-      if (num_files_ > 1) {
-        ++current_file_;
-        if (current_file_ == num_files_) {
-          current_file_ = 0;
-          if (this->layer_param_.hdf5_data_param().shuffle()) {
-            std::random_shuffle(file_permutation_.begin(),
-                                file_permutation_.end());
-          }
-          DLOG(INFO) << "Looping around to first file.";
-        }
-        LoadHDF5FileData(
-            hdf_filenames_[file_permutation_[current_file_]].c_str());
+    if (current_row_ == row_order_.size()) {
+      timer.Start();
+      if (chunk_) {
+        reader_->free_.push(chunk_);
+      }
+      chunk_ = reader_->full_.pop("Waiting for HDF5 data");
+      wait_time += timer.MicroSeconds();
+      // Output the rows in order, or shuffled.
+      row_order_.resize(chunk_->blobs_[0]->shape(0));
+      for (int r = 0; r < row_order_.size(); ++r) {
+        row_order_[r] = r;
+      }
+      if (this->layer_param_.hdf5_data_param().shuffle()) {
+        shuffle(row_order_.begin(), row_order_.end());
       }
       current_row_ = 0;
-      if (this->layer_param_.hdf5_data_param().shuffle())
-        std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
     }
-    for (int j = 0; j < this->layer_param_.top_size(); ++j) {
-      int data_dim = top[j]->count() / top[j]->shape(0);
+    for (int j = 0; j < top_size; ++j) {
+      Blob<Dtype>* blob = batch_top(batch, j);
+      const int data_dim = blob->count() / blob->shape(0);
       caffe_copy(data_dim,
-          &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+          &chunk_->blobs_[j]->cpu_data()[row_order_[current_row_] * data_dim],
+          &blob->mutable_cpu_data()[i * data_dim]);
     }
   }
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+  DLOG(INFO) << "     Wait time: " << wait_time / 1000 << " ms.";
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(HDF5DataLayer, Forward);
-#endif
-
 INSTANTIATE_CLASS(HDF5DataLayer);
 REGISTER_LAYER_CLASS(HDF5Data);
 
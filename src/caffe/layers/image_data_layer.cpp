@@ -20,6 +20,9 @@ namespace caffe {
 template <typename Dtype>
 ImageDataLayer<Dtype>::~ImageDataLayer<Dtype>() {
   this->StopInternalThread();
+  if (cache_) {
+    LOG(INFO) << "Image cache: " << cache_->stats();
+  }
 }
 
 template <typename Dtype>
@@ -66,6 +69,10 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  const uint64_t cache_mb = this->layer_param_.image_data_param().cache_mb();
+  if (cache_mb > 0) {
+    cache_.reset(new ImageCache(cache_mb * 1024 * 1024));
+  }
   // Read an image, and use it to initialize the top blob.
   cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
                                     new_height, new_width, is_color);
@@ -77,8 +84,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   top_shape[0] = batch_size;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   top[0]->Reshape(top_shape);
 
@@ -88,8 +95,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   vector<int> label_shape(1, batch_size);
   top[1]->Reshape(label_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].label_.Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
   }
 }
 
@@ -100,6 +107,24 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+shared_ptr<const Datum> ImageDataLayer<Dtype>::ReadCachedImage(
+    const string& filename) {
+  shared_ptr<const Datum> datum = cache_->Get(filename);
+  if (!datum) {
+    const ImageDataParameter& image_data_param =
+        this->layer_param_.image_data_param();
+    Datum* image = new Datum();
+    datum.reset(image);
+    // The label comes from lines_, so the cached image goes without.
+    CHECK(ReadImageToDatum(image_data_param.root_folder() + filename, 0,
+        image_data_param.new_height(), image_data_param.new_width(),
+        image_data_param.is_color(), image)) << "Could not load " << filename;
+    cache_->Put(filename, datum);
+  }
+  return datum;
+}
+
 // This function is called on prefetch thread
 template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -119,11 +144,22 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
+  // The first image is kept for the first item.
+  timer.Start();
+  cv::Mat cv_img;
+  shared_ptr<const Datum> datum;
+  vector<int> top_shape;
+  if (cache_) {
+    datum = ReadCachedImage(lines_[lines_id_].first);
+    top_shape = this->data_transformer_->InferBlobShape(*datum);
+  } else {
+    cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+        new_height, new_width, is_color);
+    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+    // Use data_transformer to infer the expected blob shape from a cv_img.
+    top_shape = this->data_transformer_->InferBlobShape(cv_img);
+  }
+  read_time += timer.MicroSeconds();
   this->transformed_data_.Reshape(top_shape);
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
@@ -138,15 +174,24 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     // get a blob
     timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+    if (item_id > 0 && cache_) {
+      datum = ReadCachedImage(lines_[lines_id_].first);
+    } else if (item_id > 0) {
+      cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+          new_height, new_width, is_color);
+      CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+    }
     read_time += timer.MicroSeconds();
     timer.Start();
     // Apply transformations (mirror, crop...) to the image
     int offset = batch->data_.offset(item_id);
     this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    if (cache_) {
+      // The decoded datum transforms to the same values as the image.
+      this->data_transformer_->Transform(*datum, &(this->transformed_data_));
+    } else {
+      this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
+    }
     trans_time += timer.MicroSeconds();
 
     prefetch_label[item_id] = lines_[lines_id_].second;
@@ -155,6 +200,9 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     if (lines_id_ >= lines_size) {
       // We have reached the end. Restart from the first.
       DLOG(INFO) << "Restarting data prefetching from start.";
+      if (cache_) {
+        LOG(INFO) << "Image cache: " << cache_->stats();
+      }
       lines_id_ = 0;
       if (this->layer_param_.image_data_param().shuffle()) {
         ShuffleImages();
@@ -12,6 +12,15 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  fused_relu_ = this->layer_param_.fusion_param().has_relu_param();
+  relu_negative_slope_ =
+      this->layer_param_.fusion_param().relu_param().negative_slope();
+  quantized_ = this->layer_param_.has_quantization_param();
+  if (quantized_) {
+    const float range = this->layer_param_.quantization_param().bottom_range();
+    CHECK_GT(range, 0) << "Quantized layers need a positive bottom_range.";
+    bottom_scale_ = 127 / range;
+  }
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -85,21 +94,91 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  const BlobProto_Storage storage = this->blobs_[0]->storage();
+  if (quantized_) {
+    // The weights are quantized again whenever they are replaced or written.
+    if (quantized_memory_ != this->blobs_[0]->data() ||
+        quantized_version_ != quantized_memory_->version()) {
+      QuantizeWeights_cpu();
+    }
+    quantized_bottom_.resize(M_ * K_);
+    quantized_top_.resize(M_ * N_);
+    caffe_cpu_quantize(M_ * K_, bottom_scale_, bottom_data,
+        &quantized_bottom_[0]);
+    caffe_cpu_gemm_s8(CblasNoTrans, M_, N_, K_, &quantized_bottom_[0],
+        &packed_weight_[0], &quantized_top_[0]);
+    for (int i = 0; i < M_; ++i) {
+      for (int j = 0; j < N_; ++j) {
+        top_data[i * N_ + j] =
+            quantized_top_[i * N_ + j] * weight_scale_[j] / bottom_scale_;
+      }
+    }
+  } else if (storage != BlobProto_Storage_FLOAT) {
+    // The weights are held in 16 bits (see ParamSpec.storage).
+    const uint16_t* weight = this->blobs_[0]->half_data();
+    if (M_ == 1) {
+      caffe_cpu_gemv_half<Dtype>(transpose_ ? CblasTrans : CblasNoTrans,
+          transpose_ ? K_ : N_, transpose_ ? N_ : K_, (Dtype)1., weight,
+          storage, bottom_data, (Dtype)0., top_data);
+    } else {
+      caffe_cpu_gemm_half<Dtype>(transpose_ ? CblasNoTrans : CblasTrans,
+          M_, N_, K_, (Dtype)1., bottom_data, weight, storage, (Dtype)0.,
+          top_data);
+    }
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans,
+        transpose_ ? CblasNoTrans : CblasTrans, M_, N_, K_, (Dtype)1.,
+        bottom_data, this->blobs_[0]->cpu_data(), (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
+  if (fused_relu_) {
+    caffe_cpu_relu(top[0]->count(), relu_negative_slope_, top_data);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::QuantizeWeights_cpu() {
+  // Each output's weights get their own scale, so quantize them as rows of an
+  // N_ x K_ matrix and pack that transposed, as the B of caffe_cpu_gemm_s8.
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  vector<Dtype> rows;
+  if (transpose_) {
+    rows.resize(N_ * K_);
+    for (int k = 0; k < K_; ++k) {
+      for (int n = 0; n < N_; ++n) {
+        rows[n * K_ + k] = weight[k * N_ + n];
+      }
+    }
+    weight = &rows[0];
+  }
+  vector<int8_t> quantized_rows(N_ * K_);
+  weight_scale_.resize(N_);
+  caffe_cpu_quantize_rows(N_, K_, weight, &quantized_rows[0],
+      &weight_scale_[0]);
+  packed_weight_.resize(caffe_cpu_gemm_s8_packed_size(K_, N_));
+  caffe_cpu_gemm_s8_pack(CblasTrans, K_, N_, &quantized_rows[0],
+      &packed_weight_[0]);
+  if (this->layer_param_.quantization_param().release_float_weights()) {
+    this->blobs_[0]->ShareDataMemory(shared_ptr<SyncedMemory>(
+        new SyncedMemory(this->blobs_[0]->count() * sizeof(Dtype))));
+  }
+  quantized_memory_ = this->blobs_[0]->data();
+  quantized_version_ = quantized_memory_->version();
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  if (fused_relu_) {
+    // Applied to the top diff in place, as by an in-place ReLU layer.
+    caffe_cpu_relu_backward(top[0]->count(), relu_negative_slope_,
+        top[0]->cpu_data(), top[0]->mutable_cpu_diff());
+  }
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
@@ -1,7 +1,10 @@
+#include <boost/bind.hpp>
+
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -107,11 +110,20 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
+  // Each image only depends on its own channels.
+  caffe_parallel_for(num_, boost::bind(
+      &LRNLayer<Dtype>::CrossChannelForwardRange_cpu, this,
+      bottom[0]->cpu_data(), scale_.mutable_cpu_data(),
+      top[0]->mutable_cpu_data(), _1, _2));
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelForwardRange_cpu(const Dtype* bottom_data,
+    Dtype* scale_data, Dtype* top_data, int begin, int end) {
+  const int image_dim = channels_ * height_ * width_;
+  const int count = (end - begin) * image_dim;
   // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
+  for (int i = begin * image_dim; i < end * image_dim; ++i) {
     scale_data[i] = k_;
   }
   Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
@@ -119,10 +131,9 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   caffe_set(padded_square.count(), Dtype(0), padded_square_data);
   Dtype alpha_over_size = alpha_ / size_;
   // go through the images
-  for (int n = 0; n < num_; ++n) {
+  for (int n = begin; n < end; ++n) {
     // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
+    caffe_sqr(image_dim, bottom_data + scale_.offset(n),
         padded_square_data + padded_square.offset(0, pre_pad_));
     // Create the first channel scale
     for (int c = 0; c < size_; ++c) {
@@ -147,8 +158,10 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   }
 
   // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+  const int offset = begin * image_dim;
+  caffe_powx<Dtype>(count, scale_data + offset, -beta_, top_data + offset);
+  caffe_mul<Dtype>(count, top_data + offset, bottom_data + offset,
+      top_data + offset);
 }
 
 template <typename Dtype>
@@ -180,11 +193,17 @@ template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelBackward_cpu(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* scale_data = scale_.cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  caffe_parallel_for(num_, boost::bind(
+      &LRNLayer<Dtype>::CrossChannelBackwardRange_cpu, this,
+      top[0]->cpu_diff(), top[0]->cpu_data(), bottom[0]->cpu_data(),
+      scale_.cpu_data(), bottom[0]->mutable_cpu_diff(), _1, _2));
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelBackwardRange_cpu(const Dtype* top_diff,
+    const Dtype* top_data, const Dtype* bottom_data, const Dtype* scale_data,
+    Dtype* bottom_diff, int begin, int end) {
+  const int image_dim = channels_ * height_ * width_;
   Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
   Blob<Dtype> accum_ratio(1, 1, height_, width_);
   Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
@@ -194,18 +213,21 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
   Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
 
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+  const int offset = begin * image_dim;
+  caffe_powx<Dtype>((end - begin) * image_dim, scale_data + offset, -beta_,
+      bottom_diff + offset);
+  caffe_mul<Dtype>((end - begin) * image_dim, top_diff + offset,
+      bottom_diff + offset, bottom_diff + offset);
 
   // go through individual data
   int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
+  for (int n = begin; n < end; ++n) {
     int block_offset = scale_.offset(n);
     // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
+    caffe_mul<Dtype>(image_dim,
         top_diff + block_offset, top_data + block_offset,
         padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
+    caffe_div<Dtype>(image_dim,
         padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
         scale_data + block_offset,
         padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
@@ -221,10 +243,10 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
           accum_ratio_data);
       // compute bottom diff
       caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
+          bottom_data + scale_.offset(n, c),
           accum_ratio_data, accum_ratio_times_bottom);
       caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
+          accum_ratio_times_bottom, bottom_diff + scale_.offset(n, c));
       caffe_axpy<Dtype>(height_ * width_, -1.,
           padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
     }
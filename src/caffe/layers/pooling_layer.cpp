@@ -1,9 +1,12 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -36,8 +39,8 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       << "Stride is stride OR stride_h and stride_w are required.";
   global_pooling_ = pool_param.global_pooling();
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = bottom[0]->shape(2);
+    kernel_w_ = bottom[0]->shape(3);
   } else {
     if (pool_param.has_kernel_size()) {
       kernel_h_ = kernel_w_ = pool_param.kernel_size();
@@ -78,14 +81,25 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
-      << "corresponding to (num, channels, height, width)";
-  channels_ = bottom[0]->channels();
-  height_ = bottom[0]->height();
-  width_ = bottom[0]->width();
+  channel_block_ = bottom[0]->channel_block();
+  if (channel_block_ > 1) {
+    CHECK_EQ(5, bottom[0]->num_axes()) << "Blocked input must have 5 axes, "
+        << "corresponding to (num, channel blocks, height, width, channels)";
+    CHECK_EQ(1, top.size()) << "Blocked input does not support a mask top.";
+    CHECK_NE(this->layer_param_.pooling_param().pool(),
+        PoolingParameter_PoolMethod_STOCHASTIC)
+        << "Blocked input does not support stochastic pooling.";
+    channels_ = bottom[0]->shape(1) * channel_block_;
+  } else {
+    CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
+        << "corresponding to (num, channels, height, width)";
+    channels_ = bottom[0]->channels();
+  }
+  height_ = bottom[0]->shape(2);
+  width_ = bottom[0]->shape(3);
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = height_;
+    kernel_w_ = width_;
   }
   pooled_height_ = static_cast<int>(ceil(static_cast<float>(
       height_ + 2 * pad_h_ - kernel_h_) / stride_h_)) + 1;
@@ -103,8 +117,24 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT((pooled_height_ - 1) * stride_h_, height_ + pad_h_);
     CHECK_LT((pooled_width_ - 1) * stride_w_, width_ + pad_w_);
   }
+  if (channel_block_ > 1) {
+    vector<int> top_shape(5);
+    top_shape[0] = bottom[0]->shape(0);
+    top_shape[1] = bottom[0]->shape(1);
+    top_shape[2] = pooled_height_;
+    top_shape[3] = pooled_width_;
+    top_shape[4] = channel_block_;
+    top[0]->Reshape(top_shape);
+    top[0]->set_channel_block(channel_block_);
+    if (this->layer_param_.pooling_param().pool() ==
+        PoolingParameter_PoolMethod_MAX) {
+      max_idx_.Reshape(top_shape);
+    }
+    return;
+  }
   top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
+  top[0]->set_channel_block(1);
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
@@ -129,59 +159,89 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    if (use_top_mask) {
+      top_mask = top[1]->mutable_cpu_data();
+    } else {
+      mask = max_idx_.mutable_cpu_data();
+    }
+  }
+  if (channel_block_ > 1) {
+    // Each (n, channel block) plane is pooled independently.
+    caffe_parallel_for(bottom[0]->count(0, 2),
+        boost::bind(&PoolingLayer<Dtype>::BlockedForwardRange_cpu, this,
+        bottom_data, top_data, mask, _1, _2),
+        max(1, kParallelElementwiseGrain / bottom[0]->count(2)));
+    return;
+  }
+  // Each (n, c) plane is pooled independently.
+  caffe_parallel_for(bottom[0]->num() * channels_,
+      boost::bind(&PoolingLayer<Dtype>::ForwardRange_cpu, this, bottom_data,
+      top_data, mask, top_mask, _1, _2),
+      max(1, kParallelElementwiseGrain / (height_ * width_)));
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ForwardRange_cpu(const Dtype* bottom_data,
+      Dtype* top_data, int* mask, Dtype* top_mask, int begin, int end) {
+  const int bottom_offset = height_ * width_;
+  const int top_offset = pooled_height_ * pooled_width_;
+  const int top_count = (end - begin) * top_offset;
+  // We'll output the mask to top[1] if it's of size >1.
+  const bool use_top_mask = top_mask != NULL;
+  bottom_data += begin * bottom_offset;
+  top_data += begin * top_offset;
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // Initialize
     if (use_top_mask) {
-      top_mask = top[1]->mutable_cpu_data();
+      top_mask += begin * top_offset;
       caffe_set(top_count, Dtype(-1), top_mask);
     } else {
-      mask = max_idx_.mutable_cpu_data();
+      mask += begin * top_offset;
       caffe_set(top_count, -1, mask);
     }
     caffe_set(top_count, Dtype(-FLT_MAX), top_data);
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_);
+          int wend = min(wstart + kernel_w_, width_);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          const int pool_index = ph * pooled_width_ + pw;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              const int index = h * width_ + w;
+              if (bottom_data[index] > top_data[pool_index]) {
+                top_data[pool_index] = bottom_data[index];
+                if (use_top_mask) {
+                  top_mask[pool_index] = static_cast<Dtype>(index);
+                } else {
+                  mask[pool_index] = index;
                 }
               }
             }
           }
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+      }
+      // compute offset
+      bottom_data += bottom_offset;
+      top_data += top_offset;
+      if (use_top_mask) {
+        top_mask += top_offset;
+      } else {
+        mask += top_offset;
       }
     }
     break;
@@ -190,32 +250,30 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       top_data[i] = 0;
     }
     // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          int pool_size = (hend - hstart) * (wend - wstart);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              top_data[ph * pooled_width_ + pw] +=
+                  bottom_data[h * width_ + w];
             }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
           }
+          top_data[ph * pooled_width_ + pw] /= pool_size;
         }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
       }
+      // compute offset
+      bottom_data += bottom_offset;
+      top_data += top_offset;
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
@@ -234,68 +292,94 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  // Different pooling methods. We explicitly do the switch outside the for
-  // loop to save time, although this results in more codes.
-  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Dtype* top_mask = NULL;
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    if (use_top_mask) {
+      top_mask = top[1]->cpu_data();
+    } else {
+      mask = max_idx_.cpu_data();
+    }
+  }
+  if (channel_block_ > 1) {
+    caffe_parallel_for(top[0]->count(0, 2),
+        boost::bind(&PoolingLayer<Dtype>::BlockedBackwardRange_cpu, this,
+        top_diff, mask, bottom_diff, _1, _2),
+        max(1, kParallelElementwiseGrain / bottom[0]->count(2)));
+    return;
+  }
+  caffe_parallel_for(top[0]->num() * channels_,
+      boost::bind(&PoolingLayer<Dtype>::BackwardRange_cpu, this, top_diff,
+      mask, top_mask, bottom_diff, _1, _2),
+      max(1, kParallelElementwiseGrain / (height_ * width_)));
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::BackwardRange_cpu(const Dtype* top_diff,
+      const int* mask, const Dtype* top_mask, Dtype* bottom_diff, int begin,
+      int end) {
+  const int bottom_offset = height_ * width_;
+  const int top_offset = pooled_height_ * pooled_width_;
+  const bool use_top_mask = top_mask != NULL;
+  top_diff += begin * top_offset;
+  bottom_diff += begin * bottom_offset;
+  // Different pooling methods. We explicitly do the switch outside the for
+  // loop to save time, although this results in more codes.
+  caffe_set((end - begin) * bottom_offset, Dtype(0), bottom_diff);
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // The main loop
     if (use_top_mask) {
-      top_mask = top[1]->cpu_data();
+      top_mask += begin * top_offset;
     } else {
-      mask = max_idx_.cpu_data();
+      mask += begin * top_offset;
     }
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
-            bottom_diff[bottom_index] += top_diff[index];
-          }
-        }
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          const int index = ph * pooled_width_ + pw;
+          const int bottom_index =
+              use_top_mask ? top_mask[index] : mask[index];
+          bottom_diff[bottom_index] += top_diff[index];
         }
       }
+      bottom_diff += bottom_offset;
+      top_diff += top_offset;
+      if (use_top_mask) {
+        top_mask += top_offset;
+      } else {
+        mask += top_offset;
+      }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
     // The main loop
-    for (int n = 0; n < top[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                bottom_diff[h * width_ + w] +=
-                  top_diff[ph * pooled_width_ + pw] / pool_size;
-              }
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          int pool_size = (hend - hstart) * (wend - wstart);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              bottom_diff[h * width_ + w] +=
+                top_diff[ph * pooled_width_ + pw] / pool_size;
             }
           }
         }
-        // offset
-        bottom_diff += bottom[0]->offset(0, 1);
-        top_diff += top[0]->offset(0, 1);
       }
+      // offset
+      bottom_diff += bottom_offset;
+      top_diff += top_offset;
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
@@ -306,6 +390,143 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+// The blocked variants keep the channel_block_ channels of a pixel in the
+// innermost loop, so that they are processed with contiguous vector accesses.
+template <typename Dtype>
+void PoolingLayer<Dtype>::BlockedForwardRange_cpu(const Dtype* bottom_data,
+      Dtype* top_data, int* mask, int begin, int end) {
+  const int block = channel_block_;
+  const int bottom_offset = height_ * width_ * block;
+  const int top_offset = pooled_height_ * pooled_width_ * block;
+  bottom_data += begin * bottom_offset;
+  top_data += begin * top_offset;
+  switch (this->layer_param_.pooling_param().pool()) {
+  case PoolingParameter_PoolMethod_MAX:
+    mask += begin * top_offset;
+    caffe_set((end - begin) * top_offset, -1, mask);
+    caffe_set((end - begin) * top_offset, Dtype(-FLT_MAX), top_data);
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_);
+          int wend = min(wstart + kernel_w_, width_);
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          Dtype* top_pixel = top_data + (ph * pooled_width_ + pw) * block;
+          int* mask_pixel = mask + (ph * pooled_width_ + pw) * block;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              const int index = h * width_ + w;
+              const Dtype* bottom_pixel = bottom_data + index * block;
+              for (int c = 0; c < block; ++c) {
+                if (bottom_pixel[c] > top_pixel[c]) {
+                  top_pixel[c] = bottom_pixel[c];
+                  mask_pixel[c] = index;
+                }
+              }
+            }
+          }
+        }
+      }
+      bottom_data += bottom_offset;
+      top_data += top_offset;
+      mask += top_offset;
+    }
+    break;
+  case PoolingParameter_PoolMethod_AVE:
+    caffe_set((end - begin) * top_offset, Dtype(0), top_data);
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          const Dtype scale = Dtype(1) / ((hend - hstart) * (wend - wstart));
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          Dtype* top_pixel = top_data + (ph * pooled_width_ + pw) * block;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              const Dtype* bottom_pixel = bottom_data
+                  + (h * width_ + w) * block;
+              for (int c = 0; c < block; ++c) {
+                top_pixel[c] += bottom_pixel[c];
+              }
+            }
+          }
+          for (int c = 0; c < block; ++c) {
+            top_pixel[c] *= scale;
+          }
+        }
+      }
+      bottom_data += bottom_offset;
+      top_data += top_offset;
+    }
+    break;
+  default:
+    LOG(FATAL) << "Unsupported pooling method for blocked input.";
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::BlockedBackwardRange_cpu(const Dtype* top_diff,
+      const int* mask, Dtype* bottom_diff, int begin, int end) {
+  const int block = channel_block_;
+  const int bottom_offset = height_ * width_ * block;
+  const int top_offset = pooled_height_ * pooled_width_ * block;
+  top_diff += begin * top_offset;
+  bottom_diff += begin * bottom_offset;
+  caffe_set((end - begin) * bottom_offset, Dtype(0), bottom_diff);
+  switch (this->layer_param_.pooling_param().pool()) {
+  case PoolingParameter_PoolMethod_MAX:
+    mask += begin * top_offset;
+    for (int nc = begin; nc < end; ++nc) {
+      for (int index = 0; index < top_offset; ++index) {
+        bottom_diff[mask[index] * block + index % block] += top_diff[index];
+      }
+      bottom_diff += bottom_offset;
+      top_diff += top_offset;
+      mask += top_offset;
+    }
+    break;
+  case PoolingParameter_PoolMethod_AVE:
+    for (int nc = begin; nc < end; ++nc) {
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart = ph * stride_h_ - pad_h_;
+          int wstart = pw * stride_w_ - pad_w_;
+          int hend = min(hstart + kernel_h_, height_ + pad_h_);
+          int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          const Dtype scale = Dtype(1) / ((hend - hstart) * (wend - wstart));
+          hstart = max(hstart, 0);
+          wstart = max(wstart, 0);
+          hend = min(hend, height_);
+          wend = min(wend, width_);
+          const Dtype* top_pixel = top_diff
+              + (ph * pooled_width_ + pw) * block;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              Dtype* bottom_pixel = bottom_diff + (h * width_ + w) * block;
+              for (int c = 0; c < block; ++c) {
+                bottom_pixel[c] += top_pixel[c] * scale;
+              }
+            }
+          }
+        }
+      }
+      bottom_diff += bottom_offset;
+      top_diff += top_offset;
+    }
+    break;
+  default:
+    LOG(FATAL) << "Unsupported pooling method for blocked input.";
+  }
+}
 
 #ifdef CPU_ONLY
 STUB_GPU(PoolingLayer);
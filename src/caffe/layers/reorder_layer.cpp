@@ -0,0 +1,76 @@
+#include <vector>
+
+#include "caffe/layers/reorder_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  const int channel_block = this->layer_param_.reorder_param().channel_block();
+  CHECK_GE(channel_block, 1);
+  to_blocked_ = channel_block > 1;
+  vector<int> top_shape;
+  if (to_blocked_) {
+    CHECK_EQ(bottom[0]->channel_block(), 1)
+        << "Reorder between two blocked layouts is not supported.";
+    CHECK_GE(bottom[0]->num_axes(), 2);
+    channel_block_ = channel_block;
+    num_ = bottom[0]->shape(0);
+    channels_ = bottom[0]->shape(1);
+    spatial_dim_ = bottom[0]->count(2);
+    CHECK_EQ(channels_ % channel_block_, 0) << "The " << channels_
+        << " channels of bottom '" << this->layer_param_.bottom(0)
+        << "' are not a multiple of the channel block " << channel_block_;
+    top_shape = bottom[0]->shape();
+    top_shape[1] /= channel_block_;
+    top_shape.push_back(channel_block_);
+  } else {
+    channel_block_ = bottom[0]->channel_block();
+    CHECK_GT(channel_block_, 1) << "Bottom '" << this->layer_param_.bottom(0)
+        << "' is not in a blocked layout.";
+    CHECK_GE(bottom[0]->num_axes(), 3);
+    CHECK_EQ(bottom[0]->shape(-1), channel_block_);
+    top_shape = bottom[0]->shape();
+    top_shape.pop_back();
+    top_shape[1] *= channel_block_;
+    num_ = top_shape[0];
+    channels_ = top_shape[1];
+    spatial_dim_ = bottom[0]->count(2) / channel_block_;
+  }
+  top[0]->Reshape(top_shape);
+  top[0]->set_channel_block(to_blocked_ ? channel_block_ : 1);
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (to_blocked_) {
+    caffe_cpu_block_channels(num_, channels_, spatial_dim_, channel_block_,
+        bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
+  } else {
+    caffe_cpu_unblock_channels(num_, channels_, spatial_dim_, channel_block_,
+        bottom[0]->cpu_data(), top[0]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void ReorderLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  if (to_blocked_) {
+    caffe_cpu_unblock_channels(num_, channels_, spatial_dim_, channel_block_,
+        top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+  } else {
+    caffe_cpu_block_channels(num_, channels_, spatial_dim_, channel_block_,
+        top[0]->cpu_diff(), bottom[0]->mutable_cpu_diff());
+  }
+}
+
+INSTANTIATE_CLASS(ReorderLayer);
+REGISTER_LAYER_CLASS(Reorder);
+
+}  // namespace caffe
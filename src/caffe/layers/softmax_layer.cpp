@@ -1,8 +1,11 @@
+#include <boost/bind.hpp>
+
 #include <algorithm>
 #include <vector>
 
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -26,34 +29,44 @@ void SoftmaxLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void SoftmaxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int channels = bottom[0]->shape(softmax_axis_);
-  int dim = bottom[0]->count() / outer_num_;
-  caffe_copy(bottom[0]->count(), bottom_data, top_data);
+  // scale_ holds one inner_num_ slice per outer index, so every outer index
+  // can be normalized independently.
+  caffe_parallel_for(outer_num_, boost::bind(
+      &SoftmaxLayer<Dtype>::ForwardRange_cpu, this, bottom[0]->cpu_data(),
+      top[0]->mutable_cpu_data(), scale_.mutable_cpu_data(), _1, _2));
+}
+
+template <typename Dtype>
+void SoftmaxLayer<Dtype>::ForwardRange_cpu(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* scale_data, int begin, int end) {
+  const Dtype* sum_multiplier = sum_multiplier_.cpu_data();
+  int channels = sum_multiplier_.count();
+  int dim = channels * inner_num_;
+  top_data += begin * dim;
+  caffe_copy((end - begin) * dim, bottom_data + begin * dim, top_data);
   // We need to subtract the max to avoid numerical issues, compute the exp,
   // and then normalize.
-  for (int i = 0; i < outer_num_; ++i) {
+  for (int i = begin; i < end; ++i) {
+    Dtype* scale = scale_data + i * inner_num_;
     // initialize scale_data to the first plane
-    caffe_copy(inner_num_, bottom_data + i * dim, scale_data);
+    caffe_copy(inner_num_, bottom_data + i * dim, scale);
     for (int j = 0; j < channels; j++) {
       for (int k = 0; k < inner_num_; k++) {
-        scale_data[k] = std::max(scale_data[k],
+        scale[k] = std::max(scale[k],
             bottom_data[i * dim + j * inner_num_ + k]);
       }
     }
     // subtraction
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_,
-        1, -1., sum_multiplier_.cpu_data(), scale_data, 1., top_data);
+        1, -1., sum_multiplier, scale, 1., top_data);
     // exponentiation
     caffe_exp<Dtype>(dim, top_data, top_data);
     // sum after exp
     caffe_cpu_gemv<Dtype>(CblasTrans, channels, inner_num_, 1.,
-        top_data, sum_multiplier_.cpu_data(), 0., scale_data);
+        top_data, sum_multiplier, 0., scale);
     // division
     for (int j = 0; j < channels; j++) {
-      caffe_div(inner_num_, top_data, scale_data, top_data);
+      caffe_div(inner_num_, top_data, scale, top_data);
       top_data += inner_num_;
     }
   }
@@ -63,26 +76,36 @@ template <typename Dtype>
 void SoftmaxLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  int channels = top[0]->shape(softmax_axis_);
-  int dim = top[0]->count() / outer_num_;
-  caffe_copy(top[0]->count(), top_diff, bottom_diff);
-  for (int i = 0; i < outer_num_; ++i) {
+  caffe_parallel_for(outer_num_, boost::bind(
+      &SoftmaxLayer<Dtype>::BackwardRange_cpu, this, top[0]->cpu_diff(),
+      top[0]->cpu_data(), bottom[0]->mutable_cpu_diff(),
+      scale_.mutable_cpu_data(), _1, _2));
+}
+
+template <typename Dtype>
+void SoftmaxLayer<Dtype>::BackwardRange_cpu(const Dtype* top_diff,
+    const Dtype* top_data, Dtype* bottom_diff, Dtype* scale_data, int begin,
+    int end) {
+  const Dtype* sum_multiplier = sum_multiplier_.cpu_data();
+  int channels = sum_multiplier_.count();
+  int dim = channels * inner_num_;
+  const int offset = begin * dim;
+  caffe_copy((end - begin) * dim, top_diff + offset, bottom_diff + offset);
+  for (int i = begin; i < end; ++i) {
+    Dtype* scale = scale_data + i * inner_num_;
     // compute dot(top_diff, top_data) and subtract them from the bottom diff
     for (int k = 0; k < inner_num_; ++k) {
-      scale_data[k] = caffe_cpu_strided_dot<Dtype>(channels,
+      scale[k] = caffe_cpu_strided_dot<Dtype>(channels,
           bottom_diff + i * dim + k, inner_num_,
           top_data + i * dim + k, inner_num_);
     }
     // subtraction
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels, inner_num_, 1,
-        -1., sum_multiplier_.cpu_data(), scale_data, 1., bottom_diff + i * dim);
+        -1., sum_multiplier, scale, 1., bottom_diff + i * dim);
   }
   // elementwise multiplication
-  caffe_mul(top[0]->count(), bottom_diff, top_data, bottom_diff);
+  caffe_mul((end - begin) * dim, bottom_diff + offset, top_data + offset,
+      bottom_diff + offset);
 }
 
 
@@ -0,0 +1,322 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// F(2x2, 3x3) works on 4x4 input tiles, i.e. 16 points in the Winograd
+// domain, and produces 2x2 output tiles.
+const int kWinogradTile = 4;
+const int kWinogradPoints = kWinogradTile * kWinogradTile;
+const int kWinogradOutputTile = 2;
+
+// Reads a 2D spatial parameter given either as repeated field or as _h/_w.
+// Returns false if the field does not describe two spatial axes.
+static bool GetSpatialParam(const google::protobuf::RepeatedField<uint32_t>&
+    values, bool has_hw, uint32_t h, uint32_t w, int default_value,
+    int* param_h, int* param_w) {
+  if (has_hw) {
+    *param_h = h;
+    *param_w = w;
+  } else if (values.size() == 0) {
+    *param_h = *param_w = default_value;
+  } else if (values.size() <= 2) {
+    *param_h = values.Get(0);
+    *param_w = values.Get(values.size() - 1);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool WinogradConvolutionLayer<Dtype>::IsSupported(
+    const ConvolutionParameter& conv_param) {
+  int kernel_h, kernel_w, stride_h, stride_w, dilation_h, dilation_w;
+  if (!GetSpatialParam(conv_param.kernel_size(),
+      conv_param.has_kernel_h() || conv_param.has_kernel_w(),
+      conv_param.kernel_h(), conv_param.kernel_w(), 0, &kernel_h, &kernel_w)
+      || !GetSpatialParam(conv_param.stride(),
+      conv_param.has_stride_h() || conv_param.has_stride_w(),
+      conv_param.stride_h(), conv_param.stride_w(), 1, &stride_h, &stride_w)
+      || !GetSpatialParam(conv_param.dilation(), false, 1, 1, 1,
+      &dilation_h, &dilation_w)) {
+    return false;
+  }
+  if (conv_param.group() > 1) {
+    // Direct path; whether the groups are narrow enough is only known once
+    // the input shape is.
+    return true;
+  }
+  return kernel_h == 3 && kernel_w == 3 && stride_h == 1 && stride_w == 1
+      && dilation_h == 1 && dilation_w == 1;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  algorithm_ = GEMM;
+  if (this->num_spatial_axes_ != 2 || bottom[0]->channel_block() > 1) {
+    return;
+  }
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  const bool dense = stride_data[0] == 1 && stride_data[1] == 1
+      && dilation_data[0] == 1 && dilation_data[1] == 1;
+  if (this->group_ == 1 && dense
+      && kernel_shape_data[0] == 3 && kernel_shape_data[1] == 3) {
+    algorithm_ = WINOGRAD;
+    tiles_h_ = (this->output_shape_[0] + kWinogradOutputTile - 1)
+        / kWinogradOutputTile;
+    tiles_w_ = (this->output_shape_[1] + kWinogradOutputTile - 1)
+        / kWinogradOutputTile;
+    vector<int> weight_shape(3);
+    weight_shape[0] = kWinogradPoints;
+    weight_shape[1] = this->num_output_;
+    weight_shape[2] = this->channels_;
+    transformed_weight_.Reshape(weight_shape);
+  } else if (this->group_ > 1
+      && this->channels_ / this->group_ <= kMaxDirectGroupChannels) {
+    algorithm_ = DIRECT;
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (algorithm_ == GEMM) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  if (algorithm_ == DIRECT) {
+    for (int i = 0; i < bottom.size(); ++i) {
+      caffe_parallel_for(this->num_ * this->num_output_, boost::bind(
+          &WinogradConvolutionLayer<Dtype>::DirectRange_cpu, this,
+          bottom[i]->cpu_data(), weight, bias, top[i]->mutable_cpu_data(),
+          _1, _2));
+    }
+    return;
+  }
+  // The filters are transformed on every pass since they change during
+  // training; this is cheap next to the convolution itself.
+  TransformWeights_cpu(weight);
+  // As in ConvolutionLayer, each batch slice gets its own tile buffers.
+  const int num_slices = this->cpu_batch_slices();
+  const int tiles = tiles_h_ * tiles_w_;
+  vector<int> tile_shape(2);
+  tile_shape[0] = num_slices;
+  tile_shape[1] = kWinogradPoints * this->channels_ * tiles;
+  transformed_input_.Reshape(tile_shape);
+  tile_shape[1] = kWinogradPoints * this->num_output_ * tiles;
+  transformed_output_.Reshape(tile_shape);
+  for (int i = 0; i < bottom.size(); ++i) {
+    caffe_parallel_for(num_slices, boost::bind(
+        &WinogradConvolutionLayer<Dtype>::WinogradSlices_cpu, this,
+        bottom[i]->cpu_data(), transformed_weight_.cpu_data(), bias,
+        top[i]->mutable_cpu_data(), transformed_input_.mutable_cpu_data(),
+        transformed_output_.mutable_cpu_data(), _1, _2));
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformWeights_cpu(
+      const Dtype* weight) {
+  const int num_filters = this->num_output_ * this->channels_;
+  Dtype* transformed = transformed_weight_.mutable_cpu_data();
+  for (int f = 0; f < num_filters; ++f) {
+    // U = G g G^T with G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1].
+    const Dtype* g = weight + f * 9;
+    Dtype tmp[4][3];
+    for (int j = 0; j < 3; ++j) {
+      tmp[0][j] = g[j];
+      tmp[1][j] = (g[j] + g[3 + j] + g[6 + j]) * Dtype(0.5);
+      tmp[2][j] = (g[j] - g[3 + j] + g[6 + j]) * Dtype(0.5);
+      tmp[3][j] = g[6 + j];
+    }
+    for (int i = 0; i < 4; ++i) {
+      const Dtype u[4] = {
+        tmp[i][0],
+        (tmp[i][0] + tmp[i][1] + tmp[i][2]) * Dtype(0.5),
+        (tmp[i][0] - tmp[i][1] + tmp[i][2]) * Dtype(0.5),
+        tmp[i][2]
+      };
+      for (int j = 0; j < 4; ++j) {
+        transformed[(i * 4 + j) * num_filters + f] = u[j];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::WinogradSlices_cpu(
+      const Dtype* bottom_data, const Dtype* transformed_weight,
+      const Dtype* bias, Dtype* top_data, Dtype* input_tiles,
+      Dtype* output_tiles, int begin, int end) {
+  const int num_slices = transformed_input_.shape(0);
+  const int channels = this->channels_;
+  const int num_output = this->num_output_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int tiles = tiles_h_ * tiles_w_;
+  for (int s = begin; s < end; ++s) {
+    Dtype* V = input_tiles + s * kWinogradPoints * channels * tiles;
+    Dtype* M = output_tiles + s * kWinogradPoints * num_output * tiles;
+    int n_begin, n_end;
+    this->cpu_batch_slice(s, num_slices, &n_begin, &n_end);
+    for (int n = n_begin; n < n_end; ++n) {
+      // Input transform V = B^T d B with
+      // B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1].
+      const Dtype* input = bottom_data + n * this->bottom_dim_;
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* plane = input + c * height * width;
+        for (int ty = 0; ty < tiles_h_; ++ty) {
+          for (int tx = 0; tx < tiles_w_; ++tx) {
+            const int y0 = ty * kWinogradOutputTile - pad_h;
+            const int x0 = tx * kWinogradOutputTile - pad_w;
+            Dtype d[4][4];
+            for (int i = 0; i < 4; ++i) {
+              const int y = y0 + i;
+              for (int j = 0; j < 4; ++j) {
+                const int x = x0 + j;
+                d[i][j] = (y >= 0 && y < height && x >= 0 && x < width) ?
+                    plane[y * width + x] : Dtype(0);
+              }
+            }
+            Dtype tmp[4][4];
+            for (int j = 0; j < 4; ++j) {
+              tmp[0][j] = d[0][j] - d[2][j];
+              tmp[1][j] = d[1][j] + d[2][j];
+              tmp[2][j] = d[2][j] - d[1][j];
+              tmp[3][j] = d[1][j] - d[3][j];
+            }
+            Dtype* v = V + c * tiles + ty * tiles_w_ + tx;
+            const int stride = channels * tiles;
+            for (int i = 0; i < 4; ++i) {
+              v[(i * 4 + 0) * stride] = tmp[i][0] - tmp[i][2];
+              v[(i * 4 + 1) * stride] = tmp[i][1] + tmp[i][2];
+              v[(i * 4 + 2) * stride] = tmp[i][2] - tmp[i][1];
+              v[(i * 4 + 3) * stride] = tmp[i][1] - tmp[i][3];
+            }
+          }
+        }
+      }
+      // One GEMM per Winograd point sums the products over input channels.
+      for (int p = 0; p < kWinogradPoints; ++p) {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, tiles,
+            channels, (Dtype)1., transformed_weight + p * num_output * channels,
+            V + p * channels * tiles, (Dtype)0., M + p * num_output * tiles);
+      }
+      // Output transform Y = A^T m A with A^T = [1 1 1 0; 0 1 -1 -1].
+      Dtype* output = top_data + n * this->top_dim_;
+      for (int k = 0; k < num_output; ++k) {
+        const Dtype b = bias ? bias[k] : Dtype(0);
+        Dtype* plane = output + k * output_h * output_w;
+        for (int ty = 0; ty < tiles_h_; ++ty) {
+          for (int tx = 0; tx < tiles_w_; ++tx) {
+            const Dtype* m = M + k * tiles + ty * tiles_w_ + tx;
+            const int stride = num_output * tiles;
+            Dtype tmp[2][4];
+            for (int j = 0; j < 4; ++j) {
+              const Dtype m0 = m[j * stride];
+              const Dtype m1 = m[(4 + j) * stride];
+              const Dtype m2 = m[(8 + j) * stride];
+              const Dtype m3 = m[(12 + j) * stride];
+              tmp[0][j] = m0 + m1 + m2;
+              tmp[1][j] = m1 - m2 - m3;
+            }
+            for (int i = 0; i < 2; ++i) {
+              const int y = ty * kWinogradOutputTile + i;
+              if (y >= output_h) {
+                break;
+              }
+              const int x = tx * kWinogradOutputTile;
+              plane[y * output_w + x] = tmp[i][0] + tmp[i][1] + tmp[i][2] + b;
+              if (x + 1 < output_w) {
+                plane[y * output_w + x + 1] = tmp[i][1] - tmp[i][2] - tmp[i][3]
+                    + b;
+              }
+            }
+          }
+        }
+      }
+      if (this->fused_relu_) {
+        caffe_cpu_relu(this->top_dim_, this->relu_negative_slope_, output);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::DirectRange_cpu(
+      const Dtype* bottom_data, const Dtype* weight, const Dtype* bias,
+      Dtype* top_data, int begin, int end) {
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const int group_channels = this->channels_ / this->group_;
+  const int group_outputs = this->num_output_ / this->group_;
+  for (int index = begin; index < end; ++index) {
+    const int n = index / this->num_output_;
+    const int o = index % this->num_output_;
+    const int g = o / group_outputs;
+    Dtype* output = top_data + n * this->top_dim_ + o * output_h * output_w;
+    caffe_set(output_h * output_w, bias ? bias[o] : Dtype(0), output);
+    for (int c = 0; c < group_channels; ++c) {
+      const Dtype* input = bottom_data + n * this->bottom_dim_
+          + (g * group_channels + c) * height * width;
+      const Dtype* filter = weight + (o * group_channels + c)
+          * kernel_h * kernel_w;
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const Dtype w = filter[kh * kernel_w + kw];
+          // The output columns whose input column lies inside the image.
+          const int offset_w = kw * dilation_w - pad_w;
+          const int x_begin = offset_w >= 0 ? 0 :
+              (-offset_w + stride_w - 1) / stride_w;
+          const int x_end = width - offset_w <= 0 ? 0 : std::min(output_w,
+              (width - 1 - offset_w) / stride_w + 1);
+          for (int y = 0; y < output_h; ++y) {
+            const int input_y = y * stride_h - pad_h + kh * dilation_h;
+            if (input_y < 0 || input_y >= height) {
+              continue;
+            }
+            const Dtype* input_row = input + input_y * width;
+            Dtype* output_row = output + y * output_w;
+            for (int x = x_begin; x < x_end; ++x) {
+              output_row[x] += w * input_row[x * stride_w + offset_w];
+            }
+          }
+        }
+      }
+    }
+    if (this->fused_relu_) {
+      caffe_cpu_relu(output_h * output_w, this->relu_negative_slope_, output);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <map>
 #include <set>
@@ -12,9 +13,12 @@
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fuse_layers.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/insert_reorders.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -61,6 +65,27 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   // Create a copy of filtered_param with splits added where necessary.
   NetParameter param;
   InsertSplits(filtered_param, &param);
+  // Merge the layers that only transform the output of a Convolution or
+  // InnerProduct layer into it, if asked.
+  if (param.fuse_layers()) {
+    if (phase_ == TEST) {
+      NetParameter split_param;
+      split_param.Swap(&param);
+      FuseLayers(split_param, &param);
+    } else {
+      LOG(WARNING) << "fuse_layers only applies to TEST nets; ignored.";
+    }
+  }
+  // Run the layers that support it in the channel-blocked layout, if asked.
+  if (param.channel_block() > 1) {
+    if (Caffe::mode() == Caffe::CPU) {
+      NetParameter split_param;
+      split_param.Swap(&param);
+      InsertReorders(split_param, &param);
+    } else {
+      LOG(WARNING) << "channel_block is only supported in CPU mode; ignored.";
+    }
+  }
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -280,12 +305,408 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
+    const FusionParameter& fusion_param =
+        layers_[layer_id]->layer_param().fusion_param();
+    for (int i = 0; i < fusion_param.folded_layer_size(); ++i) {
+      folded_layer_owners_[fusion_param.folded_layer(i).name()] = layer_id;
+    }
   }
   ShareWeights();
+  InitFlatParams(param);
+  InitBlobReuse(param);
+  PlanBlobMemory();
+  ApplyParamStorage();
   debug_info_ = param.debug_info();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::InitFlatParams(const NetParameter& param) {
+  flat_param_data_.reset();
+  flat_param_diff_.reset();
+  flat_param_count_ = 0;
+  // TEST nets of a solver share the params of its TRAIN net, and with them
+  // its flat buffers.
+  if (!param.flat_params() || phase_ != TRAIN) {
+    return;
+  }
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    flat_param_count_ += learnable_params_[i]->count();
+  }
+  // Allocate at least one element, so that the buffers exist even for nets
+  // without learnable params.
+  const size_t size = std::max<size_t>(flat_param_count_, 1) * sizeof(Dtype);
+  flat_param_data_.reset(new SyncedMemory(size));
+  flat_param_diff_.reset(new SyncedMemory(size));
+  Dtype* data = static_cast<Dtype*>(flat_param_data_->mutable_cpu_data());
+  Dtype* diff = static_cast<Dtype*>(flat_param_diff_->mutable_cpu_data());
+  // Shared params use the SyncedMemory of their owner, so they follow it.
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    caffe_copy(blob->count(), blob->cpu_data(), data);
+    caffe_copy(blob->count(), blob->cpu_diff(), diff);
+    blob->data()->set_cpu_data(data);
+    blob->diff()->set_cpu_data(diff);
+    data += blob->count();
+    diff += blob->count();
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Flat params: "
+      << learnable_params_.size() << " blobs, "
+      << flat_param_count_ * sizeof(Dtype) << " bytes";
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::FlatParams(const bool diff, const bool for_write) {
+  CHECK(flat_params()) << "Net " << name_ << " does not have flat params";
+  Dtype* flat = static_cast<Dtype*>(
+      (diff ? flat_param_diff_ : flat_param_data_)->mutable_cpu_data());
+  size_t offset = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    const Dtype* ptr;
+    if (for_write) {
+      ptr = diff ? blob->mutable_cpu_diff() : blob->mutable_cpu_data();
+    } else {
+      ptr = diff ? blob->cpu_diff() : blob->cpu_data();
+    }
+    CHECK(ptr == flat + offset) << "Learnable param " << i
+        << " no longer aliases the flat params of net " << name_;
+    offset += blob->count();
+  }
+  return flat;
+}
+
+template <typename Dtype>
+const Dtype* Net<Dtype>::flat_param_data() {
+  return FlatParams(false, false);
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_flat_param_data() {
+  return FlatParams(false, true);
+}
+
+template <typename Dtype>
+const Dtype* Net<Dtype>::flat_param_diff() {
+  return FlatParams(true, false);
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_flat_param_diff() {
+  return FlatParams(true, true);
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitBlobReuse(const NetParameter& param) {
+  reuse_groups_.clear();
+  reuse_group_lifetimes_.clear();
+  reuse_diff_groups_.clear();
+  reuse_diff_group_lifetimes_.clear();
+  recompute_segments_.clear();
+  segment_recompute_.clear();
+  live_segment_ = -1;
+  const bool recompute = param.recompute_segments() > 0;
+  if (!param.reuse_blobs() && !recompute) {
+    return;
+  }
+  if (recompute) {
+    if (phase_ == TEST && !param.force_backward()) {
+      LOG(WARNING) << "recompute_segments only applies to nets that run "
+          << "backward; ignored.";
+      return;
+    }
+  } else if (phase_ != TEST || param.force_backward()) {
+    LOG(WARNING) << "reuse_blobs only applies to TEST nets without "
+        << "force_backward; ignored.";
+    return;
+  }
+  // The first and the last layer using each blob, and whether its memory has
+  // to stay intact.
+  const int num_blobs = blobs_.size();
+  vector<int> first_use(num_blobs, -1);
+  vector<int> last_use(num_blobs, -1);
+  vector<bool> pinned(num_blobs, false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      last_use[bottom_id_vecs_[layer_id][i]] = layer_id;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      if (first_use[blob_id] < 0) {
+        first_use[blob_id] = layer_id;
+      }
+      last_use[blob_id] = std::max(last_use[blob_id], layer_id);
+      // Data layers may hand out their own buffers (e.g. MemoryData), and
+      // some fill their tops only once.
+      if (bottom_vecs_[layer_id].empty()) {
+        pinned[blob_id] = true;
+      }
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    pinned[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    pinned[net_output_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < param.keep_blob_size(); ++i) {
+    CHECK(has_blob(param.keep_blob(i)))
+        << "Unknown keep_blob " << param.keep_blob(i);
+    pinned[blob_names_index_[param.keep_blob(i)]] = true;
+  }
+  // Blobs sharing memory (e.g. the tops of Split and Reshape layers and
+  // their bottoms) are handled as one group. Split and Flatten only share
+  // in Forward and Backward, so their tops are grouped with the blob whose
+  // memory they will share rather than by their memory now.
+  vector<int> memory_owners(num_blobs);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    memory_owners[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (!layers_[layer_id]->SharesBottomMemory()) {
+      continue;
+    }
+    const int owner = memory_owners[bottom_id_vecs_[layer_id][0]];
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      memory_owners[top_id_vecs_[layer_id][i]] = owner;
+    }
+  }
+  map<const SyncedMemory*, int> memory_groups;
+  vector<vector<int> > groups;
+  vector<int> blob_groups(num_blobs);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const SyncedMemory* memory =
+        blobs_[memory_owners[blob_id]]->data().get();
+    if (memory_groups.find(memory) == memory_groups.end()) {
+      memory_groups[memory] = groups.size();
+      groups.push_back(vector<int>());
+    }
+    blob_groups[blob_id] = memory_groups[memory];
+    groups[memory_groups[memory]].push_back(blob_id);
+  }
+  vector<bool> groups_pinned(groups.size(), false);
+  vector<pair<int, int> > lifetimes(groups.size(),
+      make_pair(static_cast<int>(layers_.size()), -1));
+  for (int g = 0; g < groups.size(); ++g) {
+    for (int i = 0; i < groups[g].size(); ++i) {
+      const int blob_id = groups[g][i];
+      groups_pinned[g] = groups_pinned[g] || pinned[blob_id];
+      lifetimes[g].first = std::min(lifetimes[g].first, first_use[blob_id]);
+      lifetimes[g].second = std::max(lifetimes[g].second, last_use[blob_id]);
+    }
+  }
+  if (recompute) {
+    vector<int> group_producers(groups.size());
+    for (int g = 0; g < groups.size(); ++g) {
+      group_producers[g] = lifetimes[g].first;
+    }
+    InitRecomputeSegments(param.recompute_segments(), blob_groups,
+        group_producers);
+    // Only the blobs used inside a single recomputed segment can share
+    // memory, and they are all needed while Backward runs through it. The
+    // loss weights are kept in the diffs of the loss blobs.
+    vector<int> layer_segments(layers_.size());
+    for (int s = 0; s < recompute_segments_.size(); ++s) {
+      for (int i = recompute_segments_[s].first;
+           i <= recompute_segments_[s].second; ++i) {
+        layer_segments[i] = s;
+      }
+    }
+    for (int g = 0; g < groups.size(); ++g) {
+      const int s = layer_segments[lifetimes[g].first];
+      groups_pinned[g] = groups_pinned[g] || !segment_recompute_[s] ||
+          layer_segments[lifetimes[g].second] != s;
+      for (int i = 0; i < groups[g].size(); ++i) {
+        groups_pinned[g] = groups_pinned[g] ||
+            blob_loss_weights_[groups[g][i]] != Dtype(0);
+      }
+      lifetimes[g] = recompute_segments_[s];
+    }
+    // Segments that keep all their blobs need not be rerun.
+    vector<bool> segment_shares(recompute_segments_.size(), false);
+    for (int g = 0; g < groups.size(); ++g) {
+      if (!groups_pinned[g]) {
+        segment_shares[layer_segments[lifetimes[g].first]] = true;
+      }
+    }
+    int num_recomputed = 0;
+    for (int s = 0; s < recompute_segments_.size(); ++s) {
+      segment_recompute_[s] = segment_recompute_[s] && segment_shares[s];
+      num_recomputed += segment_recompute_[s];
+    }
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Split " << layers_.size() << " layers into "
+        << recompute_segments_.size() << " segments, " << num_recomputed
+        << " of them recomputed in Backward";
+  }
+  // Blob ids follow the layer order, so the groups come in the order of
+  // their first use.
+  for (int g = 0; g < groups.size(); ++g) {
+    if (groups_pinned[g]) {
+      continue;
+    }
+    reuse_groups_.push_back(groups[g]);
+    reuse_group_lifetimes_.push_back(lifetimes[g]);
+    if (!recompute) {
+      continue;
+    }
+    // Blobs of one group may still have their own diffs (e.g. the tops of a
+    // Split layer).
+    map<const SyncedMemory*, int> diff_groups;
+    for (int i = 0; i < groups[g].size(); ++i) {
+      const SyncedMemory* memory = blobs_[groups[g][i]]->diff().get();
+      if (diff_groups.find(memory) == diff_groups.end()) {
+        diff_groups[memory] = reuse_diff_groups_.size();
+        reuse_diff_groups_.push_back(vector<int>());
+        reuse_diff_group_lifetimes_.push_back(lifetimes[g]);
+      }
+      reuse_diff_groups_[diff_groups[memory]].push_back(groups[g][i]);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitRecomputeSegments(const int num_segments,
+    const vector<int>& blob_groups, const vector<int>& group_producers) {
+  const int num_layers = layers_.size();
+  const int segment_size = (num_layers + num_segments - 1) / num_segments;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const bool allow_recompute = !bottom_vecs_[layer_id].empty() &&
+        layers_[layer_id]->AllowRecompute();
+    // A layer working in place has to be rerun together with the layer that
+    // produced its input, or not at all.
+    int producer = -1;
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      if (std::find(bottom_id_vecs_[layer_id].begin(),
+          bottom_id_vecs_[layer_id].end(), blob_id) !=
+          bottom_id_vecs_[layer_id].end()) {
+        producer = std::max(producer, group_producers[blob_groups[blob_id]]);
+      }
+    }
+    const int last = recompute_segments_.size() - 1;
+    if (producer >= 0 && last >= 0) {
+      if (producer < recompute_segments_[last].first) {
+        if (!segment_recompute_[last]) {
+          recompute_segments_[last].second = layer_id;
+        } else {
+          recompute_segments_.push_back(make_pair(layer_id, layer_id));
+          segment_recompute_.push_back(false);
+        }
+      } else if (segment_recompute_[last] && !allow_recompute) {
+        if (producer > recompute_segments_[last].first) {
+          recompute_segments_[last].second = producer - 1;
+          recompute_segments_.push_back(make_pair(producer, layer_id));
+          segment_recompute_.push_back(false);
+        } else {
+          recompute_segments_[last].second = layer_id;
+          segment_recompute_[last] = false;
+        }
+      } else {
+        recompute_segments_[last].second = layer_id;
+      }
+      continue;
+    }
+    if (last >= 0 && segment_recompute_[last] == allow_recompute &&
+        (!allow_recompute || layer_id - recompute_segments_[last].first <
+         segment_size)) {
+      recompute_segments_[last].second = layer_id;
+    } else {
+      recompute_segments_.push_back(make_pair(layer_id, layer_id));
+      segment_recompute_.push_back(allow_recompute);
+    }
+  }
+}
+
+namespace {
+
+// Greedy assignment of items with the given byte sizes and [first, last]
+// lifetimes (in order of their first use) to shared buffers: each item goes
+// to the smallest free buffer that fits it, or else grows the largest free
+// one, or else gets a new buffer. A buffer is free once the last layer using
+// its current item has run.
+void AssignSharedBuffers(const vector<size_t>& sizes,
+    const vector<pair<int, int> >& lifetimes, vector<int>* item_buffers,
+    vector<size_t>* buffer_sizes) {
+  vector<int> buffer_free_after;
+  item_buffers->resize(sizes.size());
+  buffer_sizes->clear();
+  for (int i = 0; i < sizes.size(); ++i) {
+    int fit = -1;
+    int largest = -1;
+    for (int b = 0; b < buffer_sizes->size(); ++b) {
+      if (buffer_free_after[b] >= lifetimes[i].first) {
+        continue;
+      }
+      const size_t buffer_size = (*buffer_sizes)[b];
+      if (buffer_size >= sizes[i] &&
+          (fit < 0 || buffer_size < (*buffer_sizes)[fit])) {
+        fit = b;
+      }
+      if (largest < 0 || buffer_size > (*buffer_sizes)[largest]) {
+        largest = b;
+      }
+    }
+    int buffer = fit >= 0 ? fit : largest;
+    if (buffer < 0) {
+      buffer = buffer_sizes->size();
+      buffer_sizes->push_back(0);
+      buffer_free_after.push_back(-1);
+    }
+    (*buffer_sizes)[buffer] = std::max((*buffer_sizes)[buffer], sizes[i]);
+    buffer_free_after[buffer] = lifetimes[i].second;
+    (*item_buffers)[i] = buffer;
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void Net<Dtype>::PlanBlobMemory() {
+  live_segment_ = -1;
+  for (int diff = 0; diff <= 1; ++diff) {
+    const vector<vector<int> >& groups =
+        diff ? reuse_diff_groups_ : reuse_groups_;
+    if (groups.empty()) {
+      continue;
+    }
+    vector<size_t> sizes(groups.size(), 0);
+    size_t separate_size = 0;
+    for (int g = 0; g < groups.size(); ++g) {
+      for (int i = 0; i < groups[g].size(); ++i) {
+        sizes[g] = std::max(sizes[g],
+            blobs_[groups[g][i]]->count() * sizeof(Dtype));
+      }
+      separate_size += sizes[g];
+    }
+    vector<int> group_buffers;
+    vector<size_t> buffer_sizes;
+    AssignSharedBuffers(sizes,
+        diff ? reuse_diff_group_lifetimes_ : reuse_group_lifetimes_,
+        &group_buffers, &buffer_sizes);
+    vector<shared_ptr<SyncedMemory> > buffers(buffer_sizes.size());
+    size_t shared_size = 0;
+    for (int b = 0; b < buffers.size(); ++b) {
+      buffers[b].reset(new SyncedMemory(buffer_sizes[b]));
+      shared_size += buffer_sizes[b];
+    }
+    for (int g = 0; g < groups.size(); ++g) {
+      for (int i = 0; i < groups[g].size(); ++i) {
+        if (diff) {
+          blobs_[groups[g][i]]->ShareDiffMemory(buffers[group_buffers[g]]);
+        } else {
+          blobs_[groups[g][i]]->ShareDataMemory(buffers[group_buffers[g]]);
+        }
+      }
+    }
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Reusing blob " << (diff ? "diff" : "data") << " memory: "
+        << groups.size() << " blob groups of " << separate_size
+        << " bytes share " << buffers.size() << " buffers of " << shared_size
+        << " bytes";
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -550,10 +971,23 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    TraceScope trace(layer_names_[i], "forward");
+    trace.AddArg("type", layers_[i]->type());
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  // The blobs of the last recomputed segment run here hold valid data, unless
+  // only a part of that segment was run.
+  for (int s = recompute_segments_.size() - 1; s >= 0; --s) {
+    if (recompute_segments_[s].first > end ||
+        recompute_segments_[s].second < start || !segment_recompute_[s]) {
+      continue;
+    }
+    live_segment_ = (recompute_segments_[s].first >= start &&
+        recompute_segments_[s].second <= end) ? s : -1;
+    break;
+  }
   return loss;
 }
 
@@ -593,12 +1027,46 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (!recompute_segments_.empty()) {
+    // Rerun the forward pass of each recomputed segment before
+    // backpropagating through it, as its blobs share memory with those of the
+    // other segments.
+    for (int s = recompute_segments_.size() - 1; s >= 0; --s) {
+      const int first = std::max(recompute_segments_[s].first, end);
+      const int last = std::min(recompute_segments_[s].second, start);
+      if (first > last) {
+        continue;
+      }
+      if (segment_recompute_[s] && live_segment_ != s) {
+        ForwardFromTo(recompute_segments_[s].first,
+            recompute_segments_[s].second);
+      }
+      for (int i = last; i >= first; --i) {
+        if (layer_need_backward_[i]) {
+          TraceScope trace(layer_names_[i], "backward");
+          trace.AddArg("type", layers_[i]->type());
+          layers_[i]->Backward(
+              top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
+          if (debug_info_) { BackwardDebugInfo(i); }
+        }
+        for (int c = 0; c < after_backward_.size(); ++c) {
+          after_backward_[c]->run(i);
+        }
+      }
+    }
+    return;
+  }
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      TraceScope trace(layer_names_[i], "backward");
+      trace.AddArg("type", layers_[i]->type());
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
     }
+    for (int c = 0; c < after_backward_.size(); ++c) {
+      after_backward_[c]->run(i);
+    }
   }
 }
 
@@ -697,6 +1165,10 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
+    CHECK_EQ(0, layers_[target_layer_id]->layer_param().fusion_param()
+        .folded_layer_size()) << "Cannot share weights with layer "
+        << source_layer_name << ", which has layers folded into it; "
+        << "use CopyTrainedLayersFrom instead.";
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
     CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
@@ -726,13 +1198,25 @@ void Net<Dtype>::BackwardTo(int end) {
 template <typename Dtype>
 void Net<Dtype>::Backward() {
   BackwardFromTo(layers_.size() - 1, 0);
-  if (debug_info_) {
+  // The after_backward callbacks may still be reducing the param diffs on
+  // threads of their own (see RingSync), so they cannot be summarized here.
+  if (debug_info_ && after_backward_.empty()) {
     Dtype asum_data = 0, asum_diff = 0, sumsq_data = 0, sumsq_diff = 0;
-    for (int i = 0; i < learnable_params_.size(); ++i) {
-      asum_data += learnable_params_[i]->asum_data();
-      asum_diff += learnable_params_[i]->asum_diff();
-      sumsq_data += learnable_params_[i]->sumsq_data();
-      sumsq_diff += learnable_params_[i]->sumsq_diff();
+    if (flat_params() && Caffe::mode() == Caffe::CPU) {
+      const int count = flat_param_count_;
+      const Dtype* data = flat_param_data();
+      const Dtype* diff = flat_param_diff();
+      asum_data = caffe_cpu_asum(count, data);
+      asum_diff = caffe_cpu_asum(count, diff);
+      sumsq_data = caffe_cpu_dot(count, data, data);
+      sumsq_diff = caffe_cpu_dot(count, diff, diff);
+    } else {
+      for (int i = 0; i < learnable_params_.size(); ++i) {
+        asum_data += learnable_params_[i]->asum_data();
+        asum_diff += learnable_params_[i]->asum_diff();
+        sumsq_data += learnable_params_[i]->sumsq_data();
+        sumsq_diff += learnable_params_[i]->sumsq_diff();
+      }
     }
     const Dtype l2norm_data = std::sqrt(sumsq_data);
     const Dtype l2norm_diff = std::sqrt(sumsq_diff);
@@ -747,10 +1231,12 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  PlanBlobMemory();
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
@@ -761,15 +1247,32 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       ++target_layer_id;
     }
     if (target_layer_id == layer_names_.size()) {
+      if (folded_layer_owners_.count(source_layer_name)) {
+        vector<shared_ptr<Blob<Dtype> > >& blobs =
+            folded_blobs[source_layer_name];
+        for (int j = 0; j < source_layer.blobs_size(); ++j) {
+          blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          blobs.back()->FromProto(source_layer.blobs(j));
+        }
+        continue;
+      }
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+    // A bias added for folding (see FusionParameter) starts from zero.
+    int num_blobs = target_blobs.size();
+    if (layers_[target_layer_id]->layer_param().fusion_param().added_bias()
+        && source_layer.blobs_size() == num_blobs - 1) {
+      --num_blobs;
+      caffe_set(target_blobs[num_blobs]->count(), Dtype(0),
+          target_blobs[num_blobs]->mutable_cpu_data());
+    }
+    CHECK_EQ(num_blobs, source_layer.blobs_size())
         << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
+    for (int j = 0; j < num_blobs; ++j) {
       if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
         Blob<Dtype> source_blob;
         const bool kReshape = true;
@@ -785,6 +1288,54 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
   }
+  FoldTrainedLayers(folded_blobs);
+  ApplyParamStorage();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ApplyParamStorage() {
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
+    vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[layer_id]->blobs();
+    for (int j = 0; j < layer_param.param_size() && j < blobs.size(); ++j) {
+      const BlobProto_Storage storage = layer_param.param(j).storage();
+      if (storage == BlobProto_Storage_FLOAT) {
+        continue;
+      }
+      if (phase_ != TEST) {
+        LOG_FIRST_N(WARNING, 1) << "ParamSpec.storage only applies to TEST "
+            << "nets; ignored.";
+        continue;
+      }
+      // Shared parameters keep a single Dtype copy.
+      if (layer_param.param(j).name().empty()) {
+        blobs[j]->set_storage(storage);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::FoldTrainedLayers(
+    const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs) {
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const FusionParameter& fusion_param =
+        layers_[layer_id]->layer_param().fusion_param();
+    vector<shared_ptr<Blob<Dtype> > >& blobs = layers_[layer_id]->blobs();
+    for (int i = 0; i < fusion_param.folded_layer_size(); ++i) {
+      const LayerParameter& folded_param = fusion_param.folded_layer(i);
+      typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+          it = folded_blobs.find(folded_param.name());
+      // Weights saved from a fused net are already folded.
+      if (it == folded_blobs.end()) {
+        continue;
+      }
+      LOG_IF(INFO, Caffe::root_solver()) << "Folding trained layer "
+          << folded_param.name() << " into " << layer_names_[layer_id];
+      FoldTrainedLayer(folded_param, it->second, blobs[0].get(),
+          blobs[1].get());
+    }
+  }
 }
 
 template <typename Dtype>
@@ -807,14 +1358,34 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
   hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error reading weights from " << trained_filename;
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
+    if (folded_layer_owners_.count(source_layer_name)) {
+      hid_t layer_hid = H5Gopen2(data_hid, source_layer_name.c_str(),
+          H5P_DEFAULT);
+      CHECK_GE(layer_hid, 0)
+          << "Error reading weights from " << trained_filename;
+      vector<shared_ptr<Blob<Dtype> > >& blobs =
+          folded_blobs[source_layer_name];
+      const int num_source_params = hdf5_get_num_links(layer_hid);
+      for (int j = 0; j < num_source_params; ++j) {
+        ostringstream oss;
+        oss << j;
+        blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        hdf5_load_nd_dataset(layer_hid, oss.str().c_str(), 0, kMaxBlobAxes,
+            blobs.back().get());
+      }
+      H5Gclose(layer_hid);
+      continue;
+    }
     if (!layer_names_index_.count(source_layer_name)) {
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
@@ -841,6 +1412,12 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
         if (param_owners_[target_net_param_id] != -1) {
           // ...but it's weight-shared in target, so that's fine.
           continue;
+        } else if (j == 1 && layers_[target_layer_id]->layer_param()
+            .fusion_param().added_bias()) {
+          // ...but it's a bias added for folding, which starts from zero.
+          caffe_set(target_blobs[j]->count(), Dtype(0),
+              target_blobs[j]->mutable_cpu_data());
+          continue;
         } else {
           LOG(FATAL) << "Incompatible number of blobs for layer "
               << source_layer_name;
@@ -853,6 +1430,8 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   }
   H5Gclose(data_hid);
   H5Fclose(file_hid);
+  FoldTrainedLayers(folded_blobs);
+  ApplyParamStorage();
 }
 
 template <typename Dtype>
@@ -869,6 +1448,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  boost::recursive_mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -926,6 +1506,11 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  if (flat_params() && Caffe::mode() == Caffe::CPU) {
+    caffe_axpy<Dtype>(flat_param_count_, Dtype(-1), flat_param_diff(),
+        mutable_flat_param_data());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -933,6 +1518,10 @@ void Net<Dtype>::Update() {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (flat_params() && Caffe::mode() == Caffe::CPU) {
+    caffe_set(flat_param_count_, Dtype(0), mutable_flat_param_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
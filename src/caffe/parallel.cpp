@@ -4,13 +4,17 @@
 #include <glog/logging.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "boost/thread.hpp"
+#include "boost/thread/barrier.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/sgd_solvers.hpp"
+#include "caffe/solver_factory.hpp"
 
 namespace caffe {
 
@@ -436,8 +440,297 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
   }
 }
 
+template<typename Dtype>
+ThreadSync<Dtype>::ThreadSync(shared_ptr<Solver<Dtype> > root_solver,
+    ThreadSync<Dtype>* root, int index, bool hogwild)
+    : root_(root ? root : this), index_(index), hogwild_(hogwild),
+      initial_iter_(root_solver->iter()), solver_() {
+  if (root == NULL) {
+    solver_ = root_solver;
+  } else if (hogwild_) {
+    // A solver of its own, with its own history, updating the shared
+    // weights from its thread as a root solver would. Only the root tests,
+    // displays and snapshots.
+    SolverParameter param(root_solver->param());
+    param.set_display(0);
+    param.set_snapshot(0);
+    param.set_snapshot_after_train(false);
+    param.set_test_interval(0);
+    param.clear_test_iter();
+    param.clear_test_net();
+    param.clear_test_net_param();
+    param.clear_test_state();
+    param.set_random_seed(-1);
+    solver_.reset(SolverRegistry<Dtype>::CreateSolver(param));
+  } else {
+    Caffe::set_root_solver(false);
+    solver_.reset(new WorkerSolver<Dtype>(root_solver->param(),
+        root_solver.get()));
+    Caffe::set_root_solver(true);
+  }
+  if (root) {
+    solver_->net()->ShareTrainedLayersWith(root_solver->net().get());
+  }
+  if (!hogwild_) {
+    // Every replica would update the blobs that Forward writes at the same
+    // time, so each gets memory of its own for them, starting from the
+    // values of the root.
+    const vector<shared_ptr<Layer<Dtype> > >& layers =
+        solver_->net()->layers();
+    for (int i = 0; i < layers.size(); ++i) {
+      if (!layers[i]->ForwardUpdatesBlobs()) {
+        continue;
+      }
+      for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+        Blob<Dtype>* blob = layers[i]->blobs()[j].get();
+        if (root) {
+          const Dtype* data = blob->cpu_data();
+          blob->ShareDataMemory(shared_ptr<SyncedMemory>(
+              new SyncedMemory(blob->count() * sizeof(Dtype))));
+          caffe_copy(blob->count(), data, blob->mutable_cpu_data());
+        }
+        states_.push_back(blob);
+      }
+    }
+    CHECK_EQ(states_.size(), root_->states_.size());
+  }
+  CHECK_EQ(root_->replicas_.size(), index_);
+  root_->replicas_.push_back(this);
+  if (!hogwild_) {
+    solver_->add_callback(this);
+  }
+}
+
+template<typename Dtype>
+ThreadSync<Dtype>::~ThreadSync() {
+  StopInternalThread();
+}
+
+template<typename Dtype>
+void ThreadSync<Dtype>::InternalThreadEntry() {
+  Caffe::set_root_solver(hogwild_);
+  // Seeded apart, so that the replicas drop out different units.
+  const int64_t seed = root_->solver_->param().random_seed();
+  if (seed >= 0) {
+    Caffe::set_random_seed(seed + index_);
+  }
+  solver_->Step(solver_->param().max_iter() - initial_iter_);
+}
+
+template<typename Dtype>
+void ThreadSync<Dtype>::on_start() {
+  root_->barrier_->wait();
+}
+
+template<typename Dtype>
+void ThreadSync<Dtype>::on_gradients_ready() {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  diffs_.resize(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    diffs_[i] = params[i]->mutable_cpu_diff();
+  }
+  state_data_.resize(states_.size());
+  for (int i = 0; i < states_.size(); ++i) {
+    state_data_[i] = states_[i]->mutable_cpu_data();
+  }
+  root_->barrier_->wait();
+  const vector<ThreadSync<Dtype>*>& replicas = root_->replicas_;
+  const int num_replicas = replicas.size();
+  for (int i = 0; i < params.size(); ++i) {
+    const int64_t count = params[i]->count();
+    const int begin = count * index_ / num_replicas;
+    const int end = count * (index_ + 1) / num_replicas;
+    if (begin == end) {
+      continue;
+    }
+    Dtype* sum = replicas[0]->diffs_[i] + begin;
+    for (int r = 1; r < num_replicas; ++r) {
+      caffe_axpy(end - begin, Dtype(1), replicas[r]->diffs_[i] + begin, sum);
+    }
+    // Loss functions divide gradients by the batch size, so to compensate
+    // for split batch, the sum is divided by the number of replicas.
+    caffe_scal(end - begin, Dtype(1.0 / num_replicas), sum);
+  }
+  // The replicas continue from the mean of their states.
+  for (int i = 0; i < states_.size(); ++i) {
+    const int64_t count = states_[i]->count();
+    const int begin = count * index_ / num_replicas;
+    const int end = count * (index_ + 1) / num_replicas;
+    if (begin == end) {
+      continue;
+    }
+    Dtype* mean = replicas[0]->state_data_[i] + begin;
+    for (int r = 1; r < num_replicas; ++r) {
+      caffe_axpy(end - begin, Dtype(1), replicas[r]->state_data_[i] + begin,
+          mean);
+    }
+    caffe_scal(end - begin, Dtype(1.0 / num_replicas), mean);
+    for (int r = 1; r < num_replicas; ++r) {
+      caffe_copy(end - begin, mean, replicas[r]->state_data_[i] + begin);
+    }
+  }
+  // The root updates the weights once every slice is averaged, and the
+  // replicas wait for that in on_start.
+  root_->barrier_->wait();
+}
+
+template<typename Dtype>
+void ThreadSync<Dtype>::Run(int num_threads) {
+  CHECK(root_ == this) << "Run the root ThreadSync.";
+  barrier_.reset(new boost::barrier(num_threads));
+  vector<shared_ptr<ThreadSync<Dtype> > > syncs(num_threads);
+  for (int i = 1; i < num_threads; ++i) {
+    syncs[i].reset(new ThreadSync<Dtype>(solver_, this, i, hogwild_));
+  }
+  LOG(INFO) << "Starting Optimization with " << num_threads
+      << (hogwild_ ? " Hogwild" : " synchronous") << " solver threads";
+  for (int i = 1; i < num_threads; ++i) {
+    syncs[i]->StartInternalThread();
+  }
+  // Run root solver on current thread
+  solver_->Solve();
+  for (int i = 1; i < num_threads; ++i) {
+    syncs[i]->StopInternalThread();
+  }
+}
+
+template<typename Dtype>
+RingSync<Dtype>::RingSync(shared_ptr<Solver<Dtype> > solver,
+    shared_ptr<RingComm> comm, size_t bucket_bytes)
+    : solver_(solver), comm_(comm),
+      bucket_size_(std::max<size_t>(bucket_bytes / sizeof(Dtype), 1)),
+      overlap_(Caffe::mode() == Caffe::CPU), synced_(false), diff_(NULL),
+      backward_passes_(0) {
+  Net<Dtype>& net = *solver_->net();
+  CHECK(net.flat_params())
+      << "RingSync needs the train net to set flat_params.";
+  const size_t count = net.flat_param_count();
+  num_buckets_ = (count + bucket_size_ - 1) / bucket_size_;
+  // The diffs of a learnable param are final once Backward has gone past the
+  // lowest of the layers using it.
+  const vector<Blob<Dtype>*>& learnable_params = net.learnable_params();
+  vector<int> lowest_layer(learnable_params.size(), net.layers().size());
+  for (int i = 0; i < net.params().size(); ++i) {
+    int& lowest = lowest_layer[net.learnable_param_ids()[i]];
+    lowest = std::min(lowest, net.param_layer_indices()[i].first);
+  }
+  vector<int> bucket_layer(num_buckets_, net.layers().size());
+  size_t offset = 0;
+  for (int i = 0; i < learnable_params.size(); ++i) {
+    const size_t end = offset + learnable_params[i]->count();
+    for (size_t b = offset / bucket_size_; b * bucket_size_ < end; ++b) {
+      bucket_layer[b] = std::min(bucket_layer[b], lowest_layer[i]);
+    }
+    offset = end;
+  }
+  layer_buckets_.resize(net.layers().size());
+  for (int b = 0; b < num_buckets_; ++b) {
+    layer_buckets_[bucket_layer[b]].push_back(b);
+  }
+  solver_->add_callback(this);
+  if (overlap_) {
+    net.add_after_backward(this);
+    StartInternalThread();
+  }
+}
+
+template<typename Dtype>
+RingSync<Dtype>::~RingSync() {
+  StopInternalThread();
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_start() {
+  Net<Dtype>& net = *solver_->net();
+  if (!synced_) {
+    comm_->Broadcast(net.mutable_flat_param_data(),
+        net.flat_param_count() * sizeof(Dtype));
+    SGDSolver<Dtype>* sgd = dynamic_cast<SGDSolver<Dtype>*>(solver_.get());
+    if (sgd) {
+      const vector<shared_ptr<Blob<Dtype> > >& history = sgd->history();
+      for (int i = 0; i < history.size(); ++i) {
+        comm_->Broadcast(history[i]->mutable_cpu_data(),
+            history[i]->count() * sizeof(Dtype));
+      }
+    }
+    synced_ = true;
+  }
+  // In CPU mode the layers write their diffs in place in the flat buffer.
+  diff_ = net.mutable_flat_param_diff();
+  backward_passes_ = 0;
+  queued_.assign(num_buckets_, false);
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::run(int layer) {
+  // Gradients accumulate over the iter_size passes of an iteration.
+  if (backward_passes_ == solver_->param().iter_size() - 1) {
+    const vector<int>& buckets = layer_buckets_[layer];
+    for (int i = 0; i < buckets.size(); ++i) {
+      Queue(buckets[i]);
+    }
+  }
+  if (layer == 0) {
+    ++backward_passes_;
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_gradients_ready() {
+  if (!overlap_) {
+    diff_ = solver_->net()->mutable_flat_param_diff();
+    for (int b = num_buckets_ - 1; b >= 0; --b) {
+      Reduce(b);
+    }
+    return;
+  }
+  // All ranks queue the buckets in the same order, as the ring reduces them
+  // one after the other. Those of layers Backward did not reach go last.
+  for (int b = num_buckets_ - 1; b >= 0; --b) {
+    Queue(b);
+  }
+  for (int b = 0; b < num_buckets_; ++b) {
+    reduced_.pop();
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::Queue(int bucket) {
+  if (!queued_[bucket]) {
+    queued_[bucket] = true;
+    ready_.push(bucket);
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::Reduce(int bucket) {
+  const size_t offset = bucket * bucket_size_;
+  const size_t count = std::min(bucket_size_,
+      solver_->net()->flat_param_count() - offset);
+  comm_->Allreduce(diff_ + offset, count);
+  // Loss functions divide gradients by the batch size, so to compensate
+  // for split batch, the sum is divided by the number of ranks.
+  caffe_scal(static_cast<int>(count), Dtype(1.0 / comm_->size()),
+      diff_ + offset);
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const int bucket = ready_.pop();
+      Reduce(bucket);
+      reduced_.push(bucket);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(ThreadSync);
+INSTANTIATE_CLASS(RingSync);
 
 }  // namespace caffe
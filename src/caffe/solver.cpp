@@ -5,8 +5,10 @@
 
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/trace.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -101,8 +103,12 @@ void Solver<Dtype>::InitTrainNet() {
   net_state.MergeFrom(net_param.state());
   net_state.MergeFrom(param_.train_state());
   net_param.mutable_state()->CopyFrom(net_state);
+  // Processes training together reduce their gradients in one buffer.
+  if (Caffe::world_size() > 1) {
+    net_param.set_flat_params(true);
+  }
   if (Caffe::root_solver()) {
-    net_.(new Net<Dtype>(net_param));
+    net_.reset(new Net<Dtype>(net_param));
   } else {
     net_.reset(new Net<Dtype>(net_param, root_solver_->net_.get()));
   }
@@ -199,6 +205,8 @@ void Solver<Dtype>::Step(int iters) {
   smoothed_loss_ = 0;
 
   while (iter_ < stop_iter) {
+    TraceScope trace("iteration", "solver");
+    trace.AddArg("iter", iter_);
     // zero-init the params
     net_->ClearParamDiffs();
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
@@ -250,7 +258,10 @@ void Solver<Dtype>::Step(int iters) {
     for (int i = 0; i < callbacks_.size(); ++i) {
       callbacks_[i]->on_gradients_ready();
     }
-    ApplyUpdate();
+    {
+      TraceScope update_trace("ApplyUpdate", "solver");
+      ApplyUpdate();
+    }
 
     // Increment the internal iter_ counter -- its value should always indicate
     // the number of times the weights have been updated.
@@ -324,6 +335,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  TraceScope trace("TestAll", "solver");
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
@@ -409,6 +421,7 @@ void Solver<Dtype>::Test(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  TraceScope trace("Snapshot", "solver");
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -454,6 +467,15 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
+  if (param_.snapshot_storage() != BlobProto_Storage_FLOAT) {
+    for (int i = 0; i < net_param.layer_size(); ++i) {
+      LayerParameter* layer_param = net_param.mutable_layer(i);
+      for (int j = 0; j < layer_param->blobs_size(); ++j) {
+        CompressBlobProto(param_.snapshot_storage(),
+            layer_param->mutable_blobs(j));
+      }
+    }
+  }
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
@@ -22,6 +22,22 @@ void adadelta_update_gpu(int N, Dtype* g, Dtype* h, Dtype* h2, Dtype momentum,
     Dtype delta, Dtype local_rate);
 #endif
 
+template <typename Dtype>
+void adadelta_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h, Dtype* h2,
+    const DiffRegularizer<Dtype>& regularize, Dtype momentum, Dtype delta,
+    Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = regularize(w[i], g[i]);
+    const Dtype hi = momentum * h[i] + (1 - momentum) * gi * gi;
+    h[i] = hi;
+    // divide history of updates by history of gradients
+    const Dtype ui = gi * std::sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1 - momentum) * ui * ui;
+    g[i] = local_rate * ui;
+    w[i] -= g[i];
+  }
+}
+
 template <typename Dtype>
 void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -106,6 +122,18 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const size_t update_history_offset = this->net_->learnable_params().size();
+  adadelta_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data(),
+      this->Regularizer(param_id), Dtype(this->param_.momentum()),
+      Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
@@ -10,6 +10,19 @@ void adagrad_update_gpu(int N, Dtype* g, Dtype* h, Dtype delta,
     Dtype local_rate);
 #endif
 
+template <typename Dtype>
+void adagrad_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const DiffRegularizer<Dtype>& regularize, Dtype delta, Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = regularize(w[i], g[i]);
+    const Dtype hi = h[i] + gi * gi;
+    h[i] = hi;
+    const Dtype ui = local_rate * gi / (std::sqrt(hi) + delta);
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
 template <typename Dtype>
 void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   CHECK(Caffe::root_solver());
@@ -64,6 +77,15 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  adagrad_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->Regularizer(param_id), Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
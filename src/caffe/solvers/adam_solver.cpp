@@ -22,6 +22,22 @@ void adam_update_gpu(int N, Dtype* g, Dtype* m, Dtype* v, Dtype beta1,
     Dtype beta2, Dtype eps_hat, Dtype corrected_local_rate);
 #endif
 
+template <typename Dtype>
+void adam_update_cpu(int N, Dtype* w, Dtype* g, Dtype* m, Dtype* v,
+    const DiffRegularizer<Dtype>& regularize, Dtype beta1, Dtype beta2,
+    Dtype eps_hat, Dtype corrected_local_rate) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = regularize(w[i], g[i]);
+    const Dtype mi = m[i] * beta1 + gi * (1 - beta1);
+    const Dtype vi = v[i] * beta2 + gi * gi * (1 - beta2);
+    m[i] = mi;
+    v[i] = vi;
+    const Dtype ui = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
 template <typename Dtype>
 void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -88,6 +104,23 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const size_t update_history_offset = this->net_->learnable_params().size();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  adam_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->history_[update_history_offset + param_id]->mutable_cpu_data(),
+      this->Regularizer(param_id), beta1, beta2, Dtype(this->param_.delta()),
+      local_rate * correction);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -10,6 +10,21 @@ void nesterov_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
     Dtype local_rate);
 #endif
 
+template <typename Dtype>
+void nesterov_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const DiffRegularizer<Dtype>& regularize, Dtype momentum,
+    Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = h[i];
+    const Dtype hi_new = momentum * hi + local_rate * regularize(w[i], g[i]);
+    h[i] = hi_new;
+    // step back then over step
+    const Dtype ui = (1 + momentum) * hi_new - momentum * hi;
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
 template <typename Dtype>
 void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   CHECK(Caffe::root_solver());
@@ -56,6 +71,16 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  nesterov_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->Regularizer(param_id), Dtype(this->param_.momentum()),
+      local_rate);
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -10,6 +10,20 @@ void rmsprop_update_gpu(int N, Dtype* g, Dtype* h, Dtype rms_decay,
     Dtype delta, Dtype local_rate);
 #endif
 
+template <typename Dtype>
+void rmsprop_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const DiffRegularizer<Dtype>& regularize, Dtype rms_decay, Dtype delta,
+    Dtype local_rate) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = regularize(w[i], g[i]);
+    const Dtype hi = rms_decay * h[i] + (1 - rms_decay) * gi * gi;
+    h[i] = hi;
+    const Dtype ui = local_rate * gi / (std::sqrt(hi) + delta);
+    g[i] = ui;
+    w[i] -= ui;
+  }
+}
+
 template <typename Dtype>
 void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
@@ -64,6 +78,16 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::FusedUpdate(int param_id, Dtype rate) {
+  Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+  const Dtype local_rate = rate * this->net_->params_lr()[param_id];
+  rmsprop_update_cpu(param->count(), param->mutable_cpu_data(),
+      param->mutable_cpu_diff(), this->history_[param_id]->mutable_cpu_data(),
+      this->Regularizer(param_id), Dtype(this->param_.rms_decay()),
+      Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
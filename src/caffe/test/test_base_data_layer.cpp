@@ -0,0 +1,99 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Loads constant batches, slowly.
+template <typename Dtype>
+class SlowDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit SlowDataLayer(const LayerParameter& param)
+      : BasePrefetchingDataLayer<Dtype>(param) {}
+  virtual ~SlowDataLayer() { this->StopInternalThread(); }
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    top[0]->Reshape(2, 3, 1, 1);
+    top[1]->Reshape(2, 1, 1, 1);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->data_.Reshape(2, 3, 1, 1);
+      this->prefetch_[i]->label_.Reshape(2, 1, 1, 1);
+    }
+  }
+  virtual inline const char* type() const { return "SlowData"; }
+  int prefetch_count() const { return this->prefetch_.size(); }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+    caffe_set(batch->data_.count(), Dtype(1), batch->data_.mutable_cpu_data());
+    caffe_set(batch->label_.count(), Dtype(2),
+        batch->label_.mutable_cpu_data());
+  }
+};
+
+template <typename Dtype>
+class BasePrefetchingDataLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  BasePrefetchingDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    layer_param_.mutable_data_param()->set_prefetch(2);
+  }
+  virtual ~BasePrefetchingDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Runs a layer whose batches take longer to load than the net takes to
+  // use them, and returns the number of batches it prefetches in the end.
+  int RunSlowLayer() {
+    SlowDataLayer<Dtype> layer(layer_param_);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int iter = 0; iter < 100; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      EXPECT_EQ(1, blob_top_data_->cpu_data()[0]);
+      EXPECT_EQ(2, blob_top_label_->cpu_data()[0]);
+    }
+    return layer.prefetch_count();
+  }
+
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+TYPED_TEST_CASE(BasePrefetchingDataLayerTest, TestDtypes);
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestFixedPrefetch) {
+  EXPECT_EQ(2, this->RunSlowLayer());
+}
+
+// The net always waits, so one more batch is tried, and as it does not help
+// the queue stops growing.
+TYPED_TEST(BasePrefetchingDataLayerTest, TestAdaptivePrefetch) {
+  this->layer_param_.mutable_data_param()->set_adaptive_prefetch(true);
+  EXPECT_EQ(3, this->RunSlowLayer());
+}
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestAdaptivePrefetchLimit) {
+  DataParameter* data_param = this->layer_param_.mutable_data_param();
+  data_param->set_adaptive_prefetch(true);
+  data_param->set_max_prefetch(2);
+  EXPECT_EQ(2, this->RunSlowLayer());
+}
+
+}  // namespace caffe
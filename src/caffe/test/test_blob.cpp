@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -112,6 +114,58 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestHalfStorage) {
+  typedef TypeParam Dtype;
+  FillerParameter filler_param;
+  filler_param.set_min(-3);
+  filler_param.set_max(3);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  const int count = this->blob_preshaped_->count();
+  vector<Dtype> values(this->blob_preshaped_->cpu_data(),
+      this->blob_preshaped_->cpu_data() + count);
+  const BlobProto_Storage storages[] = { BlobProto_Storage_FLOAT16,
+      BlobProto_Storage_BFLOAT16 };
+  // Relative precision of the two formats.
+  const Dtype tolerances[] = { 1e-3, 8e-3 };
+  for (int s = 0; s < 2; ++s) {
+    this->blob_preshaped_->set_storage(storages[s]);
+    EXPECT_EQ(this->blob_preshaped_->storage(), storages[s]);
+    // ToProto writes the 16-bit data, and FromProto reads it back.
+    BlobProto proto;
+    this->blob_preshaped_->ToProto(&proto);
+    EXPECT_EQ(proto.storage(), storages[s]);
+    EXPECT_EQ(proto.data_size() + proto.double_data_size(), 0);
+    EXPECT_EQ(proto.half_data().size(), 2 * count);
+    Blob<Dtype> loaded;
+    loaded.FromProto(proto);
+    const Dtype* data = this->blob_preshaped_->cpu_data();
+    EXPECT_EQ(this->blob_preshaped_->storage(), BlobProto_Storage_FLOAT);
+    for (int i = 0; i < count; ++i) {
+      const Dtype tolerance = tolerances[s] * std::abs(values[i]);
+      EXPECT_NEAR(values[i], data[i], tolerance);
+      EXPECT_EQ(data[i], loaded.cpu_data()[i]);
+    }
+  }
+}
+
+TEST(HalfTest, TestConversions) {
+  const float values[] = { 0, -0.f, 1, -2.5, 49152, 6.103515625e-05,
+      5.9604644775390625e-08 };
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(values[i], caffe_fp16_to_float(caffe_float_to_fp16(values[i])));
+    EXPECT_EQ(values[i], caffe_bf16_to_float(caffe_float_to_bf16(values[i])));
+  }
+  // Round to nearest even.
+  EXPECT_EQ(1, caffe_fp16_to_float(caffe_float_to_fp16(1 + 1.f / 2048)));
+  EXPECT_EQ(1 + 1.f / 512,
+      caffe_fp16_to_float(caffe_float_to_fp16(1 + 3.f / 2048)));
+  EXPECT_EQ(1, caffe_bf16_to_float(caffe_float_to_bf16(1 + 1.f / 256)));
+  EXPECT_EQ(65504, caffe_fp16_to_float(caffe_float_to_fp16(65504)));
+  EXPECT_EQ(0x7c00, caffe_float_to_fp16(1e5));
+  EXPECT_EQ(0x8000, caffe_float_to_fp16(-1e-10));
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,7 +7,9 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -264,6 +268,33 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolution) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestBatchParallelConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_cpu_threads(2);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(
+      new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+  Caffe::set_cpu_threads(1);
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestDilatedConvolution) {
   typedef typename TypeParam::Dtype Dtype;
   vector<int> bottom_shape;
@@ -495,6 +526,89 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestQuantizedConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_cpu_threads(2);
+  LayerParameter layer_param;
+  Dtype range = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    range = std::max(range, std::fabs(this->blob_bottom_->cpu_data()[i]));
+  }
+  layer_param.mutable_quantization_param()->set_bottom_range(range);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  // Without and with groups; the 8-bit output is close to the reference.
+  for (int group = 1; group <= 3; group += 2) {
+    convolution_param->set_num_output(6);
+    convolution_param->set_group(group);
+    shared_ptr<Layer<Dtype> > layer(
+        new ConvolutionLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 0.3);
+    }
+  }
+  Caffe::set_cpu_threads(1);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestQuantizedConvolutionNewWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  Dtype range = 0;
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    range = std::max(range, std::fabs(this->blob_bottom_->cpu_data()[i]));
+  }
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_bottom_range(range);
+  quantization_param->set_release_float_weights(true);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<Layer<Dtype> > layer(new ConvolutionLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weights = layer->blobs()[0].get();
+  Blob<Dtype> first_weights, second_weights;
+  first_weights.CopyFrom(*weights, false, true);
+  second_weights.CopyFrom(*weights, false, true);
+  caffe_scal(second_weights.count(), Dtype(-2),
+      second_weights.mutable_cpu_data());
+  // The float filters are released once quantized, and the output is still
+  // that of the first filters. Loading the second filters afterwards
+  // replaces the int8 copy.
+  for (int pass = 0; pass < 2; ++pass) {
+    const Blob<Dtype>& expected_weights = pass ? second_weights : first_weights;
+    weights->CopyFrom(expected_weights);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED, weights->data()->head());
+    vector<shared_ptr<Blob<Dtype> > > reference_blobs(layer->blobs());
+    reference_blobs[0].reset(new Blob<Dtype>());
+    reference_blobs[0]->CopyFrom(expected_weights, false, true);
+    caffe_conv(this->blob_bottom_, convolution_param, reference_blobs,
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 0.3) << "debug: pass " << pass;
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
@@ -724,6 +838,26 @@ TYPED_TEST(ConvolutionLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestBatchParallelGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_cpu_threads(2);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  Caffe::set_cpu_threads(1);
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestDilatedGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -811,6 +945,142 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+template <typename Dtype>
+class WinogradConvolutionLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  WinogradConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 7, 5)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~WinogradConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Runs the WINOGRAD engine and checks it against the reference.
+  void CheckAgainstReference(ConvolutionParameter* convolution_param) {
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    LayerParameter layer_param;
+    layer_param.mutable_convolution_param()->CopyFrom(*convolution_param);
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> ref_top;
+    ref_top.ReshapeLike(*this->blob_top_);
+    caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+        &ref_top);
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = ref_top.cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WinogradConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWinograd) {
+  ConvolutionParameter convolution_param;
+  convolution_param.add_kernel_size(3);
+  convolution_param.set_num_output(3);
+  this->CheckAgainstReference(&convolution_param);
+  EXPECT_EQ(5, this->blob_top_->height());
+  EXPECT_EQ(3, this->blob_top_->width());
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWinogradPadded) {
+  ConvolutionParameter convolution_param;
+  convolution_param.add_kernel_size(3);
+  convolution_param.add_pad(1);
+  convolution_param.set_num_output(5);
+  this->CheckAgainstReference(&convolution_param);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWinogradBatchParallel) {
+  Caffe::set_cpu_threads(2);
+  ConvolutionParameter convolution_param;
+  convolution_param.add_kernel_size(3);
+  convolution_param.add_pad(1);
+  convolution_param.set_num_output(5);
+  this->CheckAgainstReference(&convolution_param);
+  Caffe::set_cpu_threads(1);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestDirectDepthwise) {
+  ConvolutionParameter convolution_param;
+  convolution_param.add_kernel_size(3);
+  convolution_param.add_pad(1);
+  convolution_param.add_stride(2);
+  convolution_param.set_num_output(8);
+  convolution_param.set_group(4);
+  this->CheckAgainstReference(&convolution_param);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestDirectGroupDilated) {
+  ConvolutionParameter convolution_param;
+  convolution_param.add_kernel_size(2);
+  convolution_param.add_dilation(2);
+  convolution_param.set_num_output(4);
+  convolution_param.set_group(2);
+  this->CheckAgainstReference(&convolution_param);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGEMMFallback) {
+  ConvolutionParameter convolution_param;
+  convolution_param.add_kernel_size(3);
+  convolution_param.add_stride(2);
+  convolution_param.set_num_output(3);
+  this->CheckAgainstReference(&convolution_param);
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+#ifndef USE_CUDNN
+TYPED_TEST(WinogradConvolutionLayerTest, TestDefaultEngine) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(2);
+  shared_ptr<Layer<TypeParam> > layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<WinogradConvolutionLayer<TypeParam>*>(
+      layer.get()) != NULL);
+  convolution_param->set_kernel_size(0, 5);
+  layer = LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<WinogradConvolutionLayer<TypeParam>*>(
+      layer.get()) == NULL);
+}
+#endif
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -1,4 +1,4 @@
-#ifdef USE_OPENCV
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -28,6 +28,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
       : backend_(DataParameter_DB_LEVELDB),
         blob_top_data_(new Blob<Dtype>()),
         blob_top_label_(new Blob<Dtype>()),
+        reader_threads_(1),
+        cache_mb_(0),
         seed_(1701) {}
   virtual void SetUp() {
     filename_.reset(new string());
@@ -75,6 +77,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_reader_threads(reader_threads_);
+    data_param->set_cache_mb(cache_mb_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -91,14 +95,28 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     EXPECT_EQ(blob_top_label_->height(), 1);
     EXPECT_EQ(blob_top_label_->width(), 1);
 
+    // The reader threads each read a range of the keys, the first ones one
+    // record longer, and the records are passed on taking the ranges in turn.
+    const int num_shards = std::min(reader_threads_, 5);
+    vector<int> labels;
+    for (int k = 0; labels.size() < 5; ++k) {
+      for (int shard = 0; shard < num_shards; ++shard) {
+        const int begin = shard * (5 / num_shards) +
+            std::min(shard, 5 % num_shards);
+        const int size = 5 / num_shards + (shard < 5 % num_shards ? 1 : 0);
+        if (k < size) {
+          labels.push_back(begin + k);
+        }
+      }
+    }
     for (int iter = 0; iter < 100; ++iter) {
       layer.Forward(blob_bottom_vec_, blob_top_vec_);
       for (int i = 0; i < 5; ++i) {
-        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        EXPECT_EQ(labels[i], blob_top_label_->cpu_data()[i]);
       }
       for (int i = 0; i < 5; ++i) {
         for (int j = 0; j < 24; ++j) {
-          EXPECT_EQ(scale * i, blob_top_data_->cpu_data()[i * 24 + j])
+          EXPECT_EQ(scale * labels[i], blob_top_data_->cpu_data()[i * 24 + j])
               << "debug: iter " << iter << " i " << i << " j " << j;
         }
       }
@@ -279,6 +297,126 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Batches transformed on several threads are in order, and do not depend
+  // on the number of threads.
+  void TestReadCropTrainTransformThreads() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(1);
+    transform_param->set_mirror(true);
+
+    vector<vector<Dtype> > crop_sequences[2];
+    for (int t = 0; t < 2; ++t) {
+      data_param->set_transform_threads(2 + t);
+      Caffe::set_random_seed(seed_);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 2; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < 5; ++i) {
+          EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        }
+        crop_sequences[t].push_back(vector<Dtype>(blob_top_data_->cpu_data(),
+            blob_top_data_->cpu_data() + blob_top_data_->count()));
+      }
+    }
+    for (int iter = 0; iter < 2; ++iter) {
+      for (int i = 0; i < crop_sequences[0][iter].size(); ++i) {
+        EXPECT_EQ(crop_sequences[0][iter][i], crop_sequences[1][iter][i])
+            << "debug: iter " << iter << " i " << i;
+      }
+    }
+  }
+
+  // Raw batches come out the same as transformed ones.
+  void TestReadRawBatch() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(2);
+    transform_param->set_mirror(true);
+    transform_param->set_scale(0.5);
+    transform_param->add_mean_value(3);
+
+    vector<vector<Dtype> > sequences[2];
+    for (int t = 0; t < 2; ++t) {
+      data_param->set_raw_batch(t == 1);
+      Caffe::set_random_seed(seed_);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 3; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < 5; ++i) {
+          EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        }
+        sequences[t].push_back(vector<Dtype>(blob_top_data_->cpu_data(),
+            blob_top_data_->cpu_data() + blob_top_data_->count()));
+      }
+    }
+    for (int iter = 0; iter < 3; ++iter) {
+      for (int i = 0; i < sequences[0][iter].size(); ++i) {
+        EXPECT_EQ(sequences[0][iter][i], sequences[1][iter][i])
+            << "debug: iter " << iter << " i " << i;
+      }
+    }
+  }
+
+  // With shuffle, every batch (which holds the whole source) has every label
+  // once, the order changes between epochs, and a seeded order is the same
+  // every time for a given number of reader threads.
+  void TestReadShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    data_param->set_shuffle_block(2);
+
+    const int reader_threads[] = {1, 3, 3};
+    vector<vector<int> > orders[3];
+    for (int t = 0; t < 3; ++t) {
+      data_param->set_reader_threads(reader_threads[t]);
+      Caffe::set_random_seed(seed_);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        vector<int> order;
+        vector<bool> seen(5, false);
+        for (int i = 0; i < 5; ++i) {
+          const int label = blob_top_label_->cpu_data()[i];
+          EXPECT_FALSE(seen[label]) << "debug: iter " << iter << " i " << i;
+          seen[label] = true;
+          order.push_back(label);
+        }
+        orders[t].push_back(order);
+      }
+    }
+    bool shuffled[2] = {false, false};
+    for (int iter = 0; iter < 10; ++iter) {
+      EXPECT_TRUE(orders[1][iter] == orders[2][iter]) << "debug: iter " << iter;
+      shuffled[0] |= orders[0][iter] != orders[0][0];
+      shuffled[1] |= orders[1][iter] != orders[1][0];
+    }
+    EXPECT_TRUE(shuffled[0]);
+    EXPECT_TRUE(shuffled[1]);
+  }
+
   void TestReadCropTrainSequenceUnseeded() {
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -344,6 +482,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
   Blob<Dtype>* const blob_top_label_;
   vector<Blob<Dtype>*> blob_bottom_vec_;
   vector<Blob<Dtype>*> blob_top_vec_;
+  int reader_threads_;
+  int cache_mb_;
   int seed_;
 };
 
@@ -356,6 +496,14 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+// Test that records read on several threads arrive in order.
+TYPED_TEST(DataLayerTest, TestReadReaderThreadsLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->reader_threads_ = 3;
+  this->TestRead();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -382,6 +530,24 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceUnseededLevelDB) {
   this->TestReadCropTrainSequenceUnseeded();
 }
 
+TYPED_TEST(DataLayerTest, TestReadCropTrainTransformThreadsLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadCropTrainTransformThreads();
+}
+
+TYPED_TEST(DataLayerTest, TestReadRawBatchLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadRawBatch();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
@@ -396,6 +562,14 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+// Test that records read on several threads arrive in order.
+TYPED_TEST(DataLayerTest, TestReadReaderThreadsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->reader_threads_ = 3;
+  this->TestRead();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -422,6 +596,24 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceUnseededLMDB) {
   this->TestReadCropTrainSequenceUnseeded();
 }
 
+TYPED_TEST(DataLayerTest, TestReadCropTrainTransformThreadsLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadCropTrainTransformThreads();
+}
+
+TYPED_TEST(DataLayerTest, TestReadRawBatchLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadRawBatch();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LMDB);
@@ -429,5 +621,31 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
 }
 
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestReadPacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReadReaderThreadsPacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->reader_threads_ = 3;
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShufflePacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestReadShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReadCachedPacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->cache_mb_ = 1;
+  this->reader_threads_ = 2;
+  this->TestRead();
+}
 }  // namespace caffe
-#endif  // USE_OPENCV
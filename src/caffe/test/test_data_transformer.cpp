@@ -1,4 +1,3 @@
-#ifdef USE_OPENCV
 #include <string>
 #include <vector>
 
@@ -69,6 +68,51 @@ class DataTransformTest : public ::testing::Test {
     return num_sequence_matches;
   }
 
+  // Transforms a datum with rows of 19 pixels, which the SIMD row kernels
+  // handle in full blocks and a tail, and checks the result against
+  // (pixel - mean) * scale computed here, where mean holds a value per pixel.
+  void CheckWideRows(const TransformationParameter& transform_param,
+      const vector<Dtype>& mean) {
+    const int channels = 3;
+    const int height = 4;
+    const int width = 19;
+    Datum datum;
+    FillDatum(0, channels, height, width, true, &datum);
+    const Dtype scale = transform_param.scale();
+    vector<Dtype> plain(channels * height * width);
+    vector<Dtype> mirrored(plain.size());
+    for (int row = 0; row < channels * height; ++row) {
+      for (int w = 0; w < width; ++w) {
+        const int index = row * width + w;
+        const Dtype value = (static_cast<Dtype>(
+            static_cast<uint8_t>(datum.data()[index])) - mean[index]) * scale;
+        plain[index] = value;
+        mirrored[row * width + width - 1 - w] = value;
+      }
+    }
+    DataTransformer<Dtype> transformer(transform_param, TRAIN);
+    Caffe::set_random_seed(seed_);
+    transformer.InitRand();
+    Blob<Dtype> blob(1, channels, height, width);
+    int num_mirrored = 0;
+    for (int iter = 0; iter < num_iter_; ++iter) {
+      transformer.Transform(datum, &blob);
+      // Whether a datum is mirrored is random; the first pixel tells.
+      const bool is_mirrored = transform_param.mirror() &&
+          blob.cpu_data()[0] != plain[0];
+      const vector<Dtype>& expected = is_mirrored ? mirrored : plain;
+      num_mirrored += is_mirrored;
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(expected[j], blob.cpu_data()[j]) << "debug: iter " << iter
+            << " j " << j;
+      }
+    }
+    if (transform_param.mirror()) {
+      EXPECT_GT(num_mirrored, 0);
+      EXPECT_LT(num_mirrored, num_iter_);
+    }
+  }
+
   int seed_;
   int num_iter_;
 };
@@ -340,5 +384,58 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestWideRows) {
+  TransformationParameter transform_param;
+  transform_param.set_scale(0.25);
+  this->CheckWideRows(transform_param, vector<TypeParam>(3 * 4 * 19, 0));
+}
+
+TYPED_TEST(DataTransformTest, TestWideRowsMirror) {
+  TransformationParameter transform_param;
+  transform_param.set_scale(0.25);
+  transform_param.set_mirror(true);
+  this->CheckWideRows(transform_param, vector<TypeParam>(3 * 4 * 19, 0));
+}
+
+TYPED_TEST(DataTransformTest, TestWideRowsMeanFile) {
+  const int channels = 3;
+  const int height = 4;
+  const int width = 19;
+  BlobProto blob_mean;
+  blob_mean.set_num(1);
+  blob_mean.set_channels(channels);
+  blob_mean.set_height(height);
+  blob_mean.set_width(width);
+  vector<TypeParam> mean(channels * height * width);
+  for (int j = 0; j < mean.size(); ++j) {
+    mean[j] = j * 0.5;
+    blob_mean.add_data(mean[j]);
+  }
+  string mean_file;
+  MakeTempFilename(&mean_file);
+  WriteProtoToBinaryFile(blob_mean, mean_file);
+  TransformationParameter transform_param;
+  transform_param.set_scale(0.25);
+  transform_param.set_mean_file(mean_file);
+  this->CheckWideRows(transform_param, mean);
+  transform_param.set_mirror(true);
+  this->CheckWideRows(transform_param, mean);
+}
+
+TYPED_TEST(DataTransformTest, TestWideRowsMeanValue) {
+  const int channels = 3;
+  const int size = 4 * 19;
+  const TypeParam mean_values[] = {1, 2.5, 4};
+  TransformationParameter transform_param;
+  transform_param.set_scale(0.25);
+  vector<TypeParam> mean(channels * size);
+  for (int c = 0; c < channels; ++c) {
+    transform_param.add_mean_value(mean_values[c]);
+    for (int j = 0; j < size; ++j) {
+      mean[c * size + j] = mean_values[c];
+    }
+  }
+  this->CheckWideRows(transform_param, mean);
+}
+
 }  // namespace caffe
-#endif  // USE_OPENCV
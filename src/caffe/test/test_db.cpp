@@ -57,8 +57,13 @@ struct TypeLMDB {
 };
 DataParameter_DB TypeLMDB::backend = DataParameter_DB_LMDB;
 
+struct TypePacked {
+  static DataParameter_DB backend;
+};
+DataParameter_DB TypePacked::backend = DataParameter_DB_PACKED;
+
 // typedef ::testing::Types<TypeLmdb> TestTypes;
-typedef ::testing::Types<TypeLevelDB, TypeLMDB> TestTypes;
+typedef ::testing::Types<TypeLevelDB, TypeLMDB, TypePacked> TestTypes;
 
 TYPED_TEST_CASE(DBTest, TestTypes);
 
@@ -93,6 +98,22 @@ TYPED_TEST(DBTest, TestSeekToFirst) {
   EXPECT_EQ(datum.width(), 480);
 }
 
+TYPED_TEST(DBTest, TestSeek) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Seek("fish-bike.jpg");
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  Datum datum;
+  datum.ParseFromString(cursor->value());
+  EXPECT_EQ(datum.label(), 1);
+  cursor->Seek("cat.jpg");
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  cursor->Next();
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+}
+
 TYPED_TEST(DBTest, TestKeyValue) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::READ);
@@ -117,6 +138,23 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueView) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  while (cursor->valid()) {
+    const char* data;
+    size_t size;
+    cursor->value_view(&data, &size);
+    const string value = cursor->value();
+    EXPECT_EQ(value, string(data, size));
+    Datum datum;
+    EXPECT_TRUE(datum.ParseFromArray(data, size));
+    EXPECT_EQ(datum.channels(), 3);
+    cursor->Next();
+  }
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
@@ -0,0 +1,126 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+class PackedDBTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    MakeTempDir(&root_);
+  }
+
+  // Writes records first, first + 1, ... to source, committing every
+  // commit_every records.
+  void Write(const string& source, db::Mode mode, int first, int count,
+      int commit_every) {
+    scoped_ptr<db::DB> db(db::GetDB("packed"));
+    db->Open(source, mode);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = first; i < first + count; ++i) {
+      txn->Put(Key(i), Value(i));
+      if ((i - first + 1) % commit_every == 0) {
+        txn->Commit();
+      }
+    }
+    txn->Commit();
+  }
+
+  // Checks that source holds records 0 to count - 1, in order.
+  void CheckRecords(const string& source, int count) {
+    scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_PACKED));
+    db->Open(source, db::READ);
+    scoped_ptr<db::Cursor> cursor(db->NewCursor());
+    for (int i = 0; i < count; ++i) {
+      ASSERT_TRUE(cursor->valid()) << "debug: i " << i;
+      EXPECT_EQ(Key(i), cursor->key());
+      EXPECT_EQ(Value(i), cursor->value());
+      const char* data;
+      size_t size;
+      cursor->value_view(&data, &size);
+      EXPECT_EQ(Value(i), string(data, size));
+      cursor->Next();
+    }
+    EXPECT_FALSE(cursor->valid());
+  }
+
+  static string Key(int i) {
+    return format_int(i, 5);
+  }
+  // Values of varying length, including empty ones.
+  static string Value(int i) {
+    return string(i % 7, 'a' + i % 26);
+  }
+
+  string root_;
+};
+
+TEST_F(PackedDBTest, TestChunks) {
+  const string source = root_ + "/db";
+  Write(source, db::NEW, 0, 100, 7);
+  CheckRecords(source, 100);
+}
+
+TEST_F(PackedDBTest, TestEmpty) {
+  const string source = root_ + "/db";
+  Write(source, db::NEW, 0, 0, 1);
+  CheckRecords(source, 0);
+}
+
+TEST_F(PackedDBTest, TestAppend) {
+  const string source = root_ + "/db";
+  Write(source, db::NEW, 0, 30, 10);
+  Write(source, db::WRITE, 30, 25, 10);
+  CheckRecords(source, 55);
+}
+
+TEST_F(PackedDBTest, TestConcatenate) {
+  const string first = root_ + "/first";
+  const string second = root_ + "/second";
+  const string both = root_ + "/both";
+  Write(first, db::NEW, 0, 20, 6);
+  Write(second, db::NEW, 20, 13, 100);
+  {
+    std::ofstream out(both.c_str(), std::ios::binary);
+    std::ifstream in_first(first.c_str(), std::ios::binary);
+    std::ifstream in_second(second.c_str(), std::ios::binary);
+    out << in_first.rdbuf() << in_second.rdbuf();
+  }
+  CheckRecords(both, 33);
+}
+
+TEST_F(PackedDBTest, TestSeek) {
+  const string source = root_ + "/db";
+  Write(source, db::NEW, 0, 30, 4);
+  scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_PACKED));
+  db->Open(source, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  const int keys[] = {17, 3, 29, 0, 11};
+  for (int k = 0; k < 5; ++k) {
+    cursor->Seek(Key(keys[k]));
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(Key(keys[k]), cursor->key());
+    EXPECT_EQ(Value(keys[k]), cursor->value());
+  }
+  // Reading goes on from the record sought, across chunks.
+  cursor->Seek(Key(26));
+  for (int i = 26; i < 30; ++i) {
+    EXPECT_EQ(Key(i), cursor->key());
+    cursor->Next();
+  }
+  EXPECT_FALSE(cursor->valid());
+}
+
+}  // namespace caffe
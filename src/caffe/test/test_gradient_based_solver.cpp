@@ -26,7 +26,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), regularization_type_("L2") {
         input_file_ = new string(
         CMAKE_SOURCE_DIR "caffe/test/test_data/solver_data_list.txt" CMAKE_EXT);
       }
@@ -42,6 +42,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  string regularization_type_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -171,7 +172,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
        "  } "
        "} ";
     if (weight_decay != 0) {
-      proto << "weight_decay: " << weight_decay << " ";
+      proto << "weight_decay: " << weight_decay << " "
+            << "regularization_type: '" << regularization_type_ << "' ";
     }
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
@@ -283,8 +285,10 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       // Scale the gradient over the N samples.
       grad /= N;
       // Add the weight decay to the gradient.
+      const Dtype weight =
+          (i == D) ? bias.cpu_data()[0] : weights.cpu_data()[i];
       grad += weight_decay *
-          ((i == D) ? bias.cpu_data()[0] : weights.cpu_data()[i]);
+          (regularization_type_ == "L1" ? caffe_sign(weight) : weight);
       // Finally, compute update.
       const vector<shared_ptr<Blob<Dtype> > >& history = solver_->history();
       if (solver_->type() != string("AdaDelta")
@@ -603,6 +607,18 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithWeightDecayMultiIter) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithL1WeightDecay) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->regularization_type_ = "L1";
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithMomentum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -694,6 +710,60 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+// An SGD solver that only overrides ComputeUpdateValue, the extension point
+// of the solvers, here to leave the parameters as they are.
+template <typename Dtype>
+class FrozenSGDSolver : public SGDSolver<Dtype> {
+ public:
+  explicit FrozenSGDSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param) {}
+
+ protected:
+  virtual void ComputeUpdateValue(int param_id, Dtype rate) {
+    Blob<Dtype>* param = this->net_->learnable_params()[param_id];
+    caffe_set(param->count(), Dtype(0), param->mutable_cpu_diff());
+  }
+};
+
+template <typename TypeParam>
+class FrozenSGDSolverTest : public GradientBasedSolverTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void InitSolver(const SolverParameter& param) {
+    this->solver_.reset(new FrozenSGDSolver<Dtype>(param));
+  }
+};
+
+TYPED_TEST_CASE(FrozenSGDSolverTest, TestDtypesAndDevices);
+
+TYPED_TEST(FrozenSGDSolverTest, TestComputeUpdateValueOverride) {
+  // The overridden ComputeUpdateValue is used in every mode, rather than
+  // the fused SGD update of the base class on the CPU.
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 0);
+  vector<shared_ptr<Blob<Dtype> > > initial_params;
+  const vector<Blob<Dtype>*>& params = this->solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    initial_params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    initial_params[i]->CopyFrom(*params[i], false, true);
+  }
+  this->RunLeastSquaresSolver(kLearningRate, kWeightDecay, kMomentum, 3);
+  const vector<Blob<Dtype>*>& trained_params =
+      this->solver_->net()->learnable_params();
+  ASSERT_EQ(initial_params.size(), trained_params.size());
+  for (int i = 0; i < trained_params.size(); ++i) {
+    for (int j = 0; j < trained_params[i]->count(); ++j) {
+      EXPECT_EQ(initial_params[i]->cpu_data()[j],
+          trained_params[i]->cpu_data()[j]) << "debug: param " << i
+          << " j " << j;
+    }
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -1101,6 +1171,18 @@ TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverything) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithL1WeightDecay) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->regularization_type_ = "L1";
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingShare) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -0,0 +1,81 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  // An image of size bytes, all of value.
+  static shared_ptr<const Datum> Image(int size, char value) {
+    Datum* datum = new Datum();
+    datum->set_channels(1);
+    datum->set_height(1);
+    datum->set_width(size);
+    datum->set_data(string(size, value));
+    return shared_ptr<const Datum>(datum);
+  }
+};
+
+TEST_F(ImageCacheTest, TestHitsAndMisses) {
+  ImageCache cache(1000);
+  EXPECT_FALSE(cache.Get("a").get());
+  cache.Put("a", Image(100, 'a'));
+  shared_ptr<const Datum> datum = cache.Get("a");
+  ASSERT_TRUE(datum.get());
+  EXPECT_EQ(string(100, 'a'), datum->data());
+  EXPECT_FALSE(cache.Get("b").get());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(2, cache.misses());
+  EXPECT_EQ(1, cache.size());
+  // The key counts too.
+  EXPECT_EQ(101, cache.size_bytes());
+}
+
+TEST_F(ImageCacheTest, TestEvictLeastRecentlyUsed) {
+  ImageCache cache(400);
+  cache.Put("a", Image(99, 'a'));
+  cache.Put("b", Image(99, 'b'));
+  cache.Put("c", Image(99, 'c'));
+  cache.Put("d", Image(99, 'd'));
+  EXPECT_EQ(4, cache.size());
+  // Using a makes b the least recently used.
+  EXPECT_TRUE(cache.Get("a").get());
+  cache.Put("e", Image(99, 'e'));
+  EXPECT_EQ(4, cache.size());
+  EXPECT_EQ(400, cache.size_bytes());
+  EXPECT_FALSE(cache.Get("b").get());
+  EXPECT_TRUE(cache.Get("a").get());
+  EXPECT_TRUE(cache.Get("c").get());
+  EXPECT_TRUE(cache.Get("e").get());
+  // A large image evicts as many as needed.
+  cache.Put("f", Image(299, 'f'));
+  EXPECT_EQ(2, cache.size());
+  EXPECT_TRUE(cache.Get("e").get());
+  EXPECT_TRUE(cache.Get("f").get());
+}
+
+TEST_F(ImageCacheTest, TestTooLarge) {
+  ImageCache cache(100);
+  cache.Put("a", Image(50, 'a'));
+  cache.Put("b", Image(100, 'b'));
+  EXPECT_FALSE(cache.Get("b").get());
+  EXPECT_TRUE(cache.Get("a").get());
+  EXPECT_EQ(51, cache.size_bytes());
+}
+
+TEST_F(ImageCacheTest, TestPutTwice) {
+  ImageCache cache(1000);
+  cache.Put("a", Image(10, 'a'));
+  cache.Put("a", Image(10, 'b'));
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(11, cache.size_bytes());
+  EXPECT_EQ(string(10, 'a'), cache.Get("a")->data());
+}
+
+}  // namespace caffe
@@ -125,6 +125,36 @@ TYPED_TEST(ImageDataLayerTest, TestResize) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReadCached) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_new_height(64);
+  image_data_param->set_new_width(64);
+  image_data_param->set_shuffle(false);
+  vector<vector<Dtype> > batches[2];
+  for (int t = 0; t < 2; ++t) {
+    image_data_param->set_cache_mb(t);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ((iter * 5 + i) % 2, this->blob_top_label_->cpu_data()[i]);
+      }
+      batches[t].push_back(vector<Dtype>(this->blob_top_data_->cpu_data(),
+          this->blob_top_data_->cpu_data() + this->blob_top_data_->count()));
+    }
+  }
+  // The cached images come out the same as the decoded ones.
+  for (int iter = 0; iter < 2; ++iter) {
+    EXPECT_TRUE(batches[0][iter] == batches[1][iter]) << "debug: iter "
+        << iter;
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestReshape) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -208,6 +208,121 @@ TYPED_TEST(InnerProductLayerTest, TestForwardTranspose) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardQuantized) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("constant");
+  inner_product_param->mutable_bias_filler()->set_value(0.1);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    inner_product_param->set_transpose(transpose);
+    layer_param.clear_quantization_param();
+    shared_ptr<InnerProductLayer<Dtype> > layer(
+        new InnerProductLayer<Dtype>(layer_param));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> ref_top;
+    ref_top.CopyFrom(*this->blob_top_, false, true);
+    // The bottom is uniform in [0, 1].
+    layer_param.mutable_quantization_param()->set_bottom_range(1);
+    shared_ptr<InnerProductLayer<Dtype> > quantized_layer(
+        new InnerProductLayer<Dtype>(layer_param));
+    quantized_layer->blobs() = layer->blobs();
+    quantized_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    quantized_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < ref_top.count(); ++i) {
+      EXPECT_NEAR(ref_top.cpu_data()[i], this->blob_top_->cpu_data()[i], 0.2);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardQuantizedNewWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("constant");
+  inner_product_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<InnerProductLayer<Dtype> > layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The bottom is uniform in [0, 1].
+  QuantizationParameter* quantization_param =
+      layer_param.mutable_quantization_param();
+  quantization_param->set_bottom_range(1);
+  quantization_param->set_release_float_weights(true);
+  shared_ptr<InnerProductLayer<Dtype> > quantized_layer(
+      new InnerProductLayer<Dtype>(layer_param));
+  quantized_layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weights = quantized_layer->blobs()[0].get();
+  quantized_layer->blobs()[1]->CopyFrom(*layer->blobs()[1]);
+  // The float weights are released once quantized, and the output is still
+  // that of the first weights. Loading new weights afterwards replaces the
+  // int8 copy.
+  for (int pass = 0; pass < 2; ++pass) {
+    if (pass) {
+      caffe_scal(layer->blobs()[0]->count(), Dtype(-2),
+          layer->blobs()[0]->mutable_cpu_data());
+    }
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> ref_top;
+    ref_top.CopyFrom(*this->blob_top_, false, true);
+    weights->CopyFrom(*layer->blobs()[0]);
+    quantized_layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(SyncedMemory::UNINITIALIZED, weights->data()->head());
+    for (int i = 0; i < ref_top.count(); ++i) {
+      EXPECT_NEAR(ref_top.cpu_data()[i], this->blob_top_->cpu_data()[i], 0.2)
+          << "debug: pass " << pass;
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalfStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("constant");
+  inner_product_param->mutable_bias_filler()->set_value(0.1);
+  const BlobProto_Storage storages[] = { BlobProto_Storage_FLOAT16,
+      BlobProto_Storage_BFLOAT16 };
+  // Check the batched (gemm) and single example (gemv) paths.
+  Blob<Dtype>* bottoms[] = { this->blob_bottom_, this->blob_bottom_nobatch_ };
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_nobatch_);
+  for (int b = 0; b < 2; ++b) {
+    this->blob_bottom_vec_.clear();
+    this->blob_bottom_vec_.push_back(bottoms[b]);
+    for (int transpose = 0; transpose < 2; ++transpose) {
+      inner_product_param->set_transpose(transpose);
+      shared_ptr<InnerProductLayer<Dtype> > layer(
+          new InnerProductLayer<Dtype>(layer_param));
+      layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      Blob<Dtype> ref_top;
+      ref_top.CopyFrom(*this->blob_top_, false, true);
+      for (int s = 0; s < 2; ++s) {
+        layer->blobs()[0]->set_storage(storages[s]);
+        layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        for (int i = 0; i < ref_top.count(); ++i) {
+          EXPECT_NEAR(ref_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+              0.05);
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_nobatch_);
@@ -1,6 +1,7 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +120,41 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestGemmS8) {
+  // Odd sizes, with more rows and depth than a block of the kernels, so that
+  // every edge and the accumulation across depth blocks are exercised.
+  const int M = 103;
+  const int N = 37;
+  const int K = 531;
+  vector<int8_t> A(M * K);
+  vector<int8_t> B(K * N);
+  for (int i = 0; i < A.size(); ++i) {
+    A[i] = static_cast<int>(caffe_rng_rand() % 255) - 127;
+  }
+  for (int i = 0; i < B.size(); ++i) {
+    B[i] = static_cast<int>(caffe_rng_rand() % 255) - 127;
+  }
+  vector<int16_t> packed_B(caffe_cpu_gemm_s8_packed_size(K, N));
+  vector<int32_t> C(M * N);
+  for (int trans = 0; trans < 2; ++trans) {
+    // The transposed case multiplies A^T and B^T stored as K x M and N x K.
+    const CBLAS_TRANSPOSE Trans = trans ? CblasTrans : CblasNoTrans;
+    caffe_cpu_gemm_s8_pack(Trans, K, N, &B[0], &packed_B[0]);
+    caffe_cpu_gemm_s8(Trans, M, N, K, &A[0], &packed_B[0], &C[0]);
+    for (int i = 0; i < M; ++i) {
+      for (int j = 0; j < N; ++j) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += (trans ? A[k * M + i] : A[i * K + k]) *
+              (trans ? B[j * K + k] : B[k * N + j]);
+        }
+        ASSERT_EQ(expected, C[i * N + j]) << "debug: trans " << trans
+            << " i " << i << " j " << j;
+      }
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -144,6 +144,408 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  // A small convolutional net covering every layer that supports the
+  // channel-blocked layout: conv1 runs plain (its input has 3 channels), the
+  // rest up to pool2 can run blocked.
+  virtual void InitChannelBlockNet(const int channel_block) {
+    ostringstream proto;
+    proto <<
+        "name: 'ChannelBlockTestNetwork' "
+        "channel_block: " << channel_block << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "    shape { dim: 2 } "
+        "    data_filler { type: 'gaussian' std: 1 } "
+        "    data_filler { type: 'constant' value: 1 } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'label' "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 8 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  convolution_param { "
+        "    num_output: 8 kernel_size: 3 pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'relu2' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv2' "
+        "  bottom: 'relu2' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'pool2' "
+        "  type: 'Pooling' "
+        "  pooling_param { pool: AVE kernel_size: 2 stride: 2 } "
+        "  bottom: 'sum' "
+        "  top: 'pool2' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "  bottom: 'pool2' "
+        "  top: 'ip' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'SoftmaxWithLoss' "
+        "  bottom: 'ip' "
+        "  bottom: 'label' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitReuseBlobsNet(const bool reuse_blobs,
+      const string& keep_blob) {
+    ostringstream proto;
+    proto <<
+        "name: 'ReuseBlobsTestNetwork' "
+        "state { phase: TEST } "
+        "reuse_blobs: " << (reuse_blobs ? "true" : "false") << " ";
+    if (!keep_blob.empty()) {
+      proto << "keep_blob: '" << keep_blob << "' ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 6 } } "
+        "} ";
+    // ip1 -> relu1 (in place) -> ip2 -> tanh2 -> ip3 -> out
+    const char* layers[][3] = {
+        {"ip1", "data", "InnerProduct"}, {"relu1", "ip1", "ReLU"},
+        {"ip2", "ip1", "InnerProduct"}, {"tanh2", "ip2", "TanH"},
+        {"ip3", "tanh2", "InnerProduct"}, {"out", "ip3", "InnerProduct"}};
+    for (int i = 0; i < 6; ++i) {
+      const string type = layers[i][2];
+      const string top = type == "ReLU" ? layers[i][1] : layers[i][0];
+      proto <<
+          "layer { "
+          "  name: '" << layers[i][0] << "' "
+          "  type: '" << type << "' "
+          "  bottom: '" << layers[i][1] << "' "
+          "  top: '" << top << "' ";
+      if (type == "InnerProduct") {
+        proto <<
+            "  inner_product_param { "
+            "    num_output: " << (i == 5 ? 3 : 8) << " "
+            "    weight_filler { type: 'gaussian' std: 0.5 } "
+            "    bias_filler { type: 'gaussian' std: 0.5 } "
+            "  } ";
+      }
+      proto << "} ";
+    }
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitBranchingReuseNet(const bool reuse_blobs) {
+    ostringstream proto;
+    proto <<
+        "name: 'BranchingReuseTestNetwork' "
+        "state { phase: TEST } "
+        "reuse_blobs: " << (reuse_blobs ? "true" : "false") << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 6 } } "
+        "} ";
+    // ip0 -> ipA1 -> tanhA1 -> ipA2 -> sum -> out, with a shortcut from ip0
+    // through flat (a Flatten) to sum. Split tops share the data of ip0 and
+    // flat that of its Split top only once Forward runs.
+    const char* layers[][3] = {
+        {"ip0", "data", "InnerProduct"}, {"ipA1", "ip0", "InnerProduct"},
+        {"tanhA1", "ipA1", "TanH"}, {"ipA2", "tanhA1", "InnerProduct"},
+        {"flat", "ip0", "Flatten"}};
+    for (int i = 0; i < 5; ++i) {
+      const string type = layers[i][2];
+      proto <<
+          "layer { "
+          "  name: '" << layers[i][0] << "' "
+          "  type: '" << type << "' "
+          "  bottom: '" << layers[i][1] << "' "
+          "  top: '" << layers[i][0] << "' ";
+      if (type == "InnerProduct") {
+        proto <<
+            "  inner_product_param { "
+            "    num_output: 8 "
+            "    weight_filler { type: 'gaussian' std: 0.5 } "
+            "    bias_filler { type: 'gaussian' std: 0.5 } "
+            "  } ";
+      }
+      proto << "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ipA2' "
+        "  bottom: 'flat' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'out' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sum' "
+        "  top: 'out' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitFuseNet(const bool fuse_layers) {
+    ostringstream proto;
+    proto <<
+        "name: 'FuseTestNetwork' "
+        "state { phase: TEST } "
+        "force_backward: true "
+        "fuse_layers: " << (fuse_layers ? "true" : "false") << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv' "
+        "  top: 'bn' "
+        "} "
+        "layer { "
+        "  name: 'scale' "
+        "  type: 'Scale' "
+        "  bottom: 'bn' "
+        "  top: 'bn' "
+        "  scale_param { bias_term: true } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'bn' "
+        "  top: 'bn' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'bn' "
+        "  top: 'out' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitRecomputeNet(const int recompute_segments) {
+    ostringstream proto;
+    proto <<
+        "name: 'RecomputeTestNetwork' "
+        "state { phase: TRAIN } "
+        "recompute_segments: " << recompute_segments << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  input_param { shape { dim: 2 dim: 6 } shape { dim: 2 dim: 3 } } "
+        "} ";
+    // ip1 -> relu1 (in place) -> ip2 -> tanh2 -> ip3 -> out -> loss
+    const char* layers[][3] = {
+        {"ip1", "data", "InnerProduct"}, {"relu1", "ip1", "ReLU"},
+        {"ip2", "ip1", "InnerProduct"}, {"tanh2", "ip2", "TanH"},
+        {"ip3", "tanh2", "InnerProduct"}, {"out", "ip3", "InnerProduct"}};
+    for (int i = 0; i < 6; ++i) {
+      const string type = layers[i][2];
+      const string top = type == "ReLU" ? layers[i][1] : layers[i][0];
+      proto <<
+          "layer { "
+          "  name: '" << layers[i][0] << "' "
+          "  type: '" << type << "' "
+          "  bottom: '" << layers[i][1] << "' "
+          "  top: '" << top << "' ";
+      if (type == "InnerProduct") {
+        proto <<
+            "  inner_product_param { "
+            "    num_output: " << (i == 5 ? 3 : 8) << " "
+            "    weight_filler { type: 'gaussian' std: 0.5 } "
+            "    bias_filler { type: 'gaussian' std: 0.5 } "
+            "  } ";
+      }
+      proto << "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'out' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitBranchingRecomputeNet(const int recompute_segments) {
+    ostringstream proto;
+    proto <<
+        "name: 'BranchingRecomputeTestNetwork' "
+        "state { phase: TRAIN } "
+        "recompute_segments: " << recompute_segments << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  input_param { shape { dim: 2 dim: 6 } shape { dim: 2 dim: 3 } } "
+        "} ";
+    // ip1 -> tanh1 -> ip2 -> tanh2 -> ip3 -> sum (+ tanh1) -> out -> loss
+    const char* layers[][3] = {
+        {"ip1", "data", "InnerProduct"}, {"tanh1", "ip1", "TanH"},
+        {"ip2", "tanh1", "InnerProduct"}, {"tanh2", "ip2", "TanH"},
+        {"ip3", "tanh2", "InnerProduct"}, {"sum", "ip3", "Eltwise"},
+        {"out", "sum", "InnerProduct"}};
+    for (int i = 0; i < 7; ++i) {
+      const string type = layers[i][2];
+      proto <<
+          "layer { "
+          "  name: '" << layers[i][0] << "' "
+          "  type: '" << type << "' "
+          "  bottom: '" << layers[i][1] << "' "
+          "  top: '" << layers[i][0] << "' ";
+      if (type == "Eltwise") {
+        proto << "  bottom: 'tanh1' ";
+      } else if (type == "InnerProduct") {
+        proto <<
+            "  inner_product_param { "
+            "    num_output: " << (i == 6 ? 3 : 8) << " "
+            "    weight_filler { type: 'gaussian' std: 0.5 } "
+            "    bias_filler { type: 'gaussian' std: 0.5 } "
+            "  } ";
+      }
+      proto << "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'out' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitFlatParamsNet(const bool flat_params) {
+    ostringstream proto;
+    proto <<
+        "name: 'FlatParamsTestNetwork' "
+        "state { phase: TRAIN } "
+        "flat_params: " << (flat_params ? "true" : "false") << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 6 } "
+        "    shape { dim: 4 dim: 3 } "
+        "    data_filler { type: 'gaussian' } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'targets' "
+        "} ";
+    // ip1 and ip2 share their weights.
+    const char* layers[][3] = {
+        {"ip1", "data", "6"}, {"ip2", "ip1", "6"}, {"ip3", "ip2", "3"}};
+    for (int i = 0; i < 3; ++i) {
+      proto <<
+          "layer { "
+          "  name: '" << layers[i][0] << "' "
+          "  type: 'InnerProduct' "
+          "  bottom: '" << layers[i][1] << "' "
+          "  top: '" << layers[i][0] << "' "
+          "  inner_product_param { "
+          "    num_output: " << layers[i][2] << " "
+          "    weight_filler { type: 'gaussian' std: 0.5 } "
+          "    bias_filler { type: 'gaussian' std: 0.5 } "
+          "  } ";
+      if (i < 2) {
+        proto << "  param { name: 'shared' } ";
+      }
+      proto << "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'ip3' "
+        "  bottom: 'targets' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
   virtual void InitTinyNetEuclidean(const bool force_backward = false) {
     string proto =
         "name: 'TinyTestEuclidLossNetwork' "
@@ -1457,6 +1859,361 @@ TYPED_TEST(NetTest, TestFromTo) {
   }
 }
 
+TYPED_TEST(NetTest, TestChannelBlock) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<shared_ptr<Blob<Dtype> > > plain_params;
+  Dtype plain_loss = 0;
+  for (int channel_block = 1; channel_block <= 4; channel_block *= 4) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitChannelBlockNet(channel_block);
+    const Dtype loss = this->net_->ForwardBackward();
+    EXPECT_TRUE(this->net_->has_blob("loss"));
+    EXPECT_TRUE(this->net_->has_blob("pool2"));
+    if (channel_block == 1) {
+      plain_loss = loss;
+      for (int i = 0; i < this->net_->params().size(); ++i) {
+        plain_params.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+        plain_params.back()->CopyFrom(*this->net_->params()[i], true, true);
+      }
+      continue;
+    }
+    if (Caffe::mode() == Caffe::CPU) {
+      int num_reorders = 0;
+      for (int i = 0; i < this->net_->layers().size(); ++i) {
+        num_reorders += string(this->net_->layers()[i]->type()) == "Reorder";
+      }
+      // Into the blocked layout after conv1, out of it before ip.
+      EXPECT_EQ(2, num_reorders);
+      EXPECT_TRUE(this->net_->has_blob("conv2_nchw4c"));
+    }
+    EXPECT_NEAR(plain_loss, loss, 1e-4);
+    ASSERT_EQ(plain_params.size(), this->net_->params().size());
+    for (int i = 0; i < plain_params.size(); ++i) {
+      const Blob<Dtype>& param = *this->net_->params()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_NEAR(plain_params[i]->cpu_diff()[j], param.cpu_diff()[j],
+            1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestReuseBlobs) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitReuseBlobsNet(false, "");
+  shared_ptr<Net<Dtype> > plain_net = this->net_;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int num = 2; num <= 4; num += 2) {
+    for (int keep = 0; keep <= 1; ++keep) {
+      this->InitReuseBlobsNet(true, keep ? "ip1" : "");
+      this->net_->ShareTrainedLayersWith(plain_net.get());
+      const Net<Dtype>& net = *this->net_;
+      if (num != 2) {
+        net.input_blobs()[0]->Reshape(num, 6, 1, 1);
+        this->net_->Reshape();
+      }
+      if (plain_net->input_blobs()[0]->num() != num) {
+        plain_net->input_blobs()[0]->Reshape(num, 6, 1, 1);
+        plain_net->Reshape();
+      }
+      filler.Fill(plain_net->input_blobs()[0]);
+      net.input_blobs()[0]->CopyFrom(*plain_net->input_blobs()[0]);
+      plain_net->Forward();
+      this->net_->Forward();
+      // ip1 is last used by ip2 and tanh2 first used after it, so the two can
+      // share memory unless ip1 is kept; likewise ip2 and ip3.
+      EXPECT_EQ(!keep, net.blob_by_name("ip1")->data() ==
+          net.blob_by_name("tanh2")->data());
+      EXPECT_EQ(net.blob_by_name("ip2")->data(),
+          net.blob_by_name("ip3")->data());
+      const char* intact[] = {"data", "out", "ip1"};
+      for (int i = 0; i < 2 + keep; ++i) {
+        const Blob<Dtype>& plain_blob = *plain_net->blob_by_name(intact[i]);
+        const Blob<Dtype>& blob = *net.blob_by_name(intact[i]);
+        ASSERT_EQ(plain_blob.count(), blob.count());
+        for (int j = 0; j < blob.count(); ++j) {
+          EXPECT_EQ(plain_blob.cpu_data()[j], blob.cpu_data()[j]);
+        }
+        for (int k = 0; k < net.blobs().size(); ++k) {
+          if (net.blob_names()[k] != intact[i]) {
+            EXPECT_NE(blob.data(), net.blobs()[k]->data());
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestReuseBlobsBranching) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitBranchingReuseNet(false);
+  shared_ptr<Net<Dtype> > plain_net = this->net_;
+  this->InitBranchingReuseNet(true);
+  this->net_->ShareTrainedLayersWith(plain_net.get());
+  const Net<Dtype>& net = *this->net_;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(plain_net->input_blobs()[0]);
+  net.input_blobs()[0]->CopyFrom(*plain_net->input_blobs()[0]);
+  // ip0, its Split tops and flat are read until sum, so they must not share
+  // memory with the blobs of the other branch.
+  const char* shortcut[] = {"ip0", "ip0_ip0_0_split_0", "ip0_ip0_0_split_1",
+      "flat"};
+  const char* branch[] = {"ipA1", "tanhA1", "ipA2"};
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      EXPECT_NE(net.blob_by_name(shortcut[i])->data(),
+          net.blob_by_name(branch[j])->data())
+          << "debug: " << shortcut[i] << " " << branch[j];
+    }
+  }
+  // The branch is done with ipA1 once tanhA1 is computed.
+  EXPECT_EQ(net.blob_by_name("ipA1")->data(),
+      net.blob_by_name("ipA2")->data());
+  for (int iter = 0; iter < 2; ++iter) {
+    plain_net->Forward();
+    this->net_->Forward();
+    const Blob<Dtype>& plain_out = *plain_net->blob_by_name("out");
+    const Blob<Dtype>& out = *net.blob_by_name("out");
+    ASSERT_EQ(plain_out.count(), out.count());
+    for (int i = 0; i < out.count(); ++i) {
+      EXPECT_EQ(plain_out.cpu_data()[i], out.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFlatParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitFlatParamsNet(false);
+  shared_ptr<Net<Dtype> > plain_net = this->net_;
+  EXPECT_FALSE(plain_net->flat_params());
+  Caffe::set_random_seed(this->seed_);
+  this->InitFlatParamsNet(true);
+  Net<Dtype>& net = *this->net_;
+  ASSERT_TRUE(net.flat_params());
+  // The shared weights of ip1 and ip2 are learned once, their biases apart.
+  const vector<Blob<Dtype>*>& params = net.learnable_params();
+  ASSERT_EQ(5, params.size());
+  EXPECT_EQ(6 * 6 + 6 + 6 + 3 * 6 + 3, net.flat_param_count());
+  EXPECT_EQ(net.layer_by_name("ip1")->blobs()[0]->cpu_data(),
+      net.layer_by_name("ip2")->blobs()[0]->cpu_data());
+  // The params alias consecutive slices of the buffers, and kept their
+  // initial values.
+  const Dtype* data = net.flat_param_data();
+  const Dtype* diff = net.flat_param_diff();
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(data, params[i]->cpu_data());
+    EXPECT_EQ(diff, params[i]->cpu_diff());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(plain_net->learnable_params()[i]->cpu_data()[j], data[j]);
+    }
+    data += params[i]->count();
+    diff += params[i]->count();
+  }
+  for (int iter = 0; iter < 2; ++iter) {
+    Caffe::set_random_seed(this->seed_ + iter);
+    plain_net->ClearParamDiffs();
+    plain_net->ForwardBackward();
+    plain_net->Update();
+    Caffe::set_random_seed(this->seed_ + iter);
+    net.ClearParamDiffs();
+    net.ForwardBackward();
+    net.Update();
+    data = net.flat_param_data();
+    diff = net.flat_param_diff();
+    for (int i = 0; i < params.size(); ++i) {
+      const Blob<Dtype>& plain_param = *plain_net->learnable_params()[i];
+      for (int j = 0; j < plain_param.count(); ++j) {
+        EXPECT_EQ(plain_param.cpu_diff()[j], *diff++);
+        EXPECT_FLOAT_EQ(plain_param.cpu_data()[j], *data++);
+      }
+    }
+  }
+  net.ClearParamDiffs();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+// Records the layers Backward has gone past.
+template <typename Dtype>
+class BackwardRecorder : public Net<Dtype>::Callback {
+ public:
+  vector<int> layers_;
+
+ protected:
+  virtual void run(int layer) { layers_.push_back(layer); }
+};
+
+TYPED_TEST(NetTest, TestAfterBackward) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFlatParamsNet(false);
+  Net<Dtype>& net = *this->net_;
+  BackwardRecorder<Dtype> recorder;
+  net.add_after_backward(&recorder);
+  // Every layer is reported from the top down, even the data layer, which
+  // needs no backward.
+  const int num_layers = net.layers().size();
+  EXPECT_FALSE(net.layer_need_backward()[0]);
+  net.ForwardBackward();
+  ASSERT_EQ(num_layers, recorder.layers_.size());
+  for (int i = 0; i < num_layers; ++i) {
+    EXPECT_EQ(num_layers - 1 - i, recorder.layers_[i]);
+  }
+  recorder.layers_.clear();
+  net.BackwardFromTo(2, 1);
+  ASSERT_EQ(2, recorder.layers_.size());
+  EXPECT_EQ(2, recorder.layers_[0]);
+  EXPECT_EQ(1, recorder.layers_[1]);
+}
+
+TYPED_TEST(NetTest, TestRecompute) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitRecomputeNet(0);
+  shared_ptr<Net<Dtype> > plain_net = this->net_;
+  this->InitRecomputeNet(3);
+  this->net_->ShareTrainedLayersWith(plain_net.get());
+  const Net<Dtype>& net = *this->net_;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < 2; ++i) {
+    filler.Fill(plain_net->input_blobs()[i]);
+    net.input_blobs()[i]->CopyFrom(*plain_net->input_blobs()[i]);
+  }
+  // The segments are [data], [ip1, relu1, ip2], [tanh2, ip3, out] and
+  // [loss]. ip1 lives in the second segment and tanh2 in the third, so they
+  // share memory; ip2 and out are passed between segments and are kept.
+  EXPECT_EQ(net.blob_by_name("ip1")->data(),
+      net.blob_by_name("tanh2")->data());
+  EXPECT_EQ(net.blob_by_name("ip1")->diff(),
+      net.blob_by_name("tanh2")->diff());
+  const char* kept[] = {"ip2", "out"};
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* blob = net.blob_by_name(kept[i]).get();
+    for (int k = 0; k < net.blobs().size(); ++k) {
+      if (net.blobs()[k].get() != blob) {
+        EXPECT_NE(blob->data(), net.blobs()[k]->data());
+        EXPECT_NE(blob->diff(), net.blobs()[k]->diff());
+      }
+    }
+  }
+  for (int iter = 0; iter < 2; ++iter) {
+    plain_net->ClearParamDiffs();
+    this->net_->ClearParamDiffs();
+    const Dtype plain_loss = plain_net->ForwardBackward();
+    const Dtype loss = this->net_->ForwardBackward();
+    EXPECT_EQ(plain_loss, loss);
+    ASSERT_EQ(plain_net->learnable_params().size(),
+        net.learnable_params().size());
+    for (int i = 0; i < net.learnable_params().size(); ++i) {
+      const Blob<Dtype>& plain_param = *plain_net->learnable_params()[i];
+      const Blob<Dtype>& param = *net.learnable_params()[i];
+      ASSERT_EQ(plain_param.count(), param.count());
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(plain_param.cpu_diff()[j], param.cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestRecomputeBranching) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitBranchingRecomputeNet(0);
+  shared_ptr<Net<Dtype> > plain_net = this->net_;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < 2; ++i) {
+    filler.Fill(plain_net->input_blobs()[i]);
+  }
+  plain_net->ClearParamDiffs();
+  const Dtype plain_loss = plain_net->ForwardBackward();
+  // tanh1 is split between ip2 and sum, which land in different segments
+  // for some of these segment counts.
+  for (int segments = 2; segments <= 5; ++segments) {
+    this->InitBranchingRecomputeNet(segments);
+    const Net<Dtype>& net = *this->net_;
+    this->net_->ShareTrainedLayersWith(plain_net.get());
+    for (int i = 0; i < 2; ++i) {
+      net.input_blobs()[i]->CopyFrom(*plain_net->input_blobs()[i]);
+    }
+    this->net_->ClearParamDiffs();
+    const Dtype loss = this->net_->ForwardBackward();
+    EXPECT_EQ(plain_loss, loss) << "debug: segments " << segments;
+    ASSERT_EQ(plain_net->learnable_params().size(),
+        net.learnable_params().size());
+    for (int i = 0; i < net.learnable_params().size(); ++i) {
+      const Blob<Dtype>& plain_param = *plain_net->learnable_params()[i];
+      const Blob<Dtype>& param = *net.learnable_params()[i];
+      ASSERT_EQ(plain_param.count(), param.count());
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(plain_param.cpu_diff()[j], param.cpu_diff()[j])
+            << "debug: segments " << segments << " param " << i;
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFuseNet(false);
+  shared_ptr<Net<Dtype> > plain_net = this->net_;
+  // Give the BatchNorm and Scale layers non-trivial trained values.
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < 2; ++i) {
+    const string name = i == 0 ? "bn" : "scale";
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        plain_net->layer_by_name(name)->blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      filler.Fill(blobs[j].get());
+    }
+  }
+  NetParameter trained;
+  plain_net->ToProto(&trained);
+  this->InitFuseNet(true);
+  const Net<Dtype>& net = *this->net_;
+  this->net_->CopyTrainedLayersFrom(trained);
+  EXPECT_EQ(3, net.layers().size());
+  EXPECT_FALSE(net.has_layer("bn"));
+  EXPECT_FALSE(net.has_layer("relu"));
+  // The folded weights and bias compute the same outputs.
+  FillerParameter data_filler_param;
+  GaussianFiller<Dtype> data_filler(data_filler_param);
+  data_filler.Fill(plain_net->input_blobs()[0]);
+  net.input_blobs()[0]->CopyFrom(*plain_net->input_blobs()[0]);
+  plain_net->Forward();
+  this->net_->Forward();
+  const Blob<Dtype>& plain_out = *plain_net->blob_by_name("out");
+  const Blob<Dtype>& out = *net.blob_by_name("out");
+  ASSERT_EQ(plain_out.count(), out.count());
+  for (int i = 0; i < out.count(); ++i) {
+    EXPECT_NEAR(plain_out.cpu_data()[i], out.cpu_data()[i], 1e-4);
+  }
+  const Blob<Dtype>& fused = *net.blob_by_name("bn");
+  const Blob<Dtype>& plain_fused = *plain_net->blob_by_name("bn");
+  for (int i = 0; i < fused.count(); ++i) {
+    EXPECT_NEAR(plain_fused.cpu_data()[i], fused.cpu_data()[i], 1e-4);
+  }
+  // The fused ReLU also gates the gradient the same way.
+  caffe_set(out.count(), Dtype(1),
+      plain_net->blob_by_name("out")->mutable_cpu_diff());
+  caffe_set(out.count(), Dtype(1),
+      this->net_->blob_by_name("out")->mutable_cpu_diff());
+  plain_net->Backward();
+  this->net_->Backward();
+  const Blob<Dtype>& plain_data = *plain_net->input_blobs()[0];
+  const Blob<Dtype>& data = *net.input_blobs()[0];
+  for (int i = 0; i < data.count(); ++i) {
+    EXPECT_NEAR(plain_data.cpu_diff()[i], data.cpu_diff()[i], 1e-3);
+  }
+}
+
 class FilterNetTest : public ::testing::Test {
  protected:
   void RunFilterNetTest(
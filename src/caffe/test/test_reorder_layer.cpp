@@ -0,0 +1,241 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/reorder_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ReorderLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ReorderLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 8, 3, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ReorderLayerTest() { delete blob_bottom_; delete blob_top_; }
+
+  // Runs the layer described by layer_param on plain input, and on the same
+  // input blocked by channel_block, and checks that the outputs and all
+  // gradients agree.
+  void CheckBlockedMatchesPlain(const LayerParameter& layer_param,
+      int channel_block) {
+    // Plain.
+    shared_ptr<Layer<Dtype> > plain_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    plain_layer->SetUp(blob_bottom_vec_, blob_top_vec_);
+    plain_layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*blob_top_);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    plain_layer->Backward(blob_top_vec_, propagate_down, blob_bottom_vec_);
+    // Blocked.
+    Blob<Dtype> blocked_bottom, blocked_top;
+    vector<Blob<Dtype>*> blocked_bottom_vec(1, &blocked_bottom);
+    vector<Blob<Dtype>*> blocked_top_vec(1, &blocked_top);
+    LayerParameter block_param;
+    block_param.mutable_reorder_param()->set_channel_block(channel_block);
+    ReorderLayer<Dtype> block_layer(block_param);
+    block_layer.SetUp(blob_bottom_vec_, blocked_bottom_vec);
+    block_layer.Forward(blob_bottom_vec_, blocked_bottom_vec);
+    shared_ptr<Layer<Dtype> > blocked_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    blocked_layer->SetUp(blocked_bottom_vec, blocked_top_vec);
+    EXPECT_EQ(channel_block, blocked_top.channel_block());
+    for (int i = 0; i < plain_layer->blobs().size(); ++i) {
+      blocked_layer->blobs()[i]->CopyFrom(*plain_layer->blobs()[i]);
+    }
+    blocked_layer->Forward(blocked_bottom_vec, blocked_top_vec);
+    caffe_cpu_block_channels(blob_top_->num(), blob_top_->channels(),
+        blob_top_->count(2), channel_block, top_diff.cpu_data(),
+        blocked_top.mutable_cpu_diff());
+    blocked_layer->Backward(blocked_top_vec, propagate_down,
+        blocked_bottom_vec);
+    // Compare.
+    Blob<Dtype> unblocked;
+    unblocked.ReshapeLike(*blob_top_);
+    caffe_cpu_unblock_channels(blob_top_->num(), blob_top_->channels(),
+        blob_top_->count(2), channel_block, blocked_top.cpu_data(),
+        unblocked.mutable_cpu_data());
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      EXPECT_NEAR(blob_top_->cpu_data()[i], unblocked.cpu_data()[i], 1e-4);
+    }
+    unblocked.ReshapeLike(*blob_bottom_);
+    caffe_cpu_unblock_channels(blob_bottom_->num(), blob_bottom_->channels(),
+        blob_bottom_->count(2), channel_block, blocked_bottom.cpu_diff(),
+        unblocked.mutable_cpu_data());
+    for (int i = 0; i < blob_bottom_->count(); ++i) {
+      EXPECT_NEAR(blob_bottom_->cpu_diff()[i], unblocked.cpu_data()[i], 1e-4);
+    }
+    for (int i = 0; i < plain_layer->blobs().size(); ++i) {
+      const Blob<Dtype>& plain_param = *plain_layer->blobs()[i];
+      const Blob<Dtype>& blocked_param = *blocked_layer->blobs()[i];
+      for (int j = 0; j < plain_param.count(); ++j) {
+        EXPECT_NEAR(plain_param.cpu_diff()[j], blocked_param.cpu_diff()[j],
+            1e-4);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ReorderLayerTest, TestDtypes);
+
+TYPED_TEST(ReorderLayerTest, TestSetup) {
+  LayerParameter layer_param;
+  layer_param.mutable_reorder_param()->set_channel_block(4);
+  ReorderLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(5, this->blob_top_->num_axes());
+  EXPECT_EQ(2, this->blob_top_->shape(0));
+  EXPECT_EQ(2, this->blob_top_->shape(1));
+  EXPECT_EQ(3, this->blob_top_->shape(2));
+  EXPECT_EQ(5, this->blob_top_->shape(3));
+  EXPECT_EQ(4, this->blob_top_->shape(4));
+  EXPECT_EQ(4, this->blob_top_->channel_block());
+}
+
+TYPED_TEST(ReorderLayerTest, TestForward) {
+  LayerParameter layer_param;
+  layer_param.mutable_reorder_param()->set_channel_block(4);
+  ReorderLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 8; ++c) {
+      for (int h = 0; h < 3; ++h) {
+        for (int w = 0; w < 5; ++w) {
+          EXPECT_EQ(this->blob_bottom_->data_at(n, c, h, w),
+              this->blob_top_->cpu_data()[
+              (((n * 2 + c / 4) * 3 + h) * 5 + w) * 4 + c % 4]);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestRoundTrip) {
+  LayerParameter block_param;
+  block_param.mutable_reorder_param()->set_channel_block(8);
+  ReorderLayer<TypeParam> block_layer(block_param);
+  block_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  block_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<TypeParam> plain;
+  vector<Blob<TypeParam>*> plain_vec(1, &plain);
+  LayerParameter unblock_param;
+  ReorderLayer<TypeParam> unblock_layer(unblock_param);
+  unblock_layer.SetUp(this->blob_top_vec_, plain_vec);
+  unblock_layer.Forward(this->blob_top_vec_, plain_vec);
+  EXPECT_EQ(this->blob_bottom_->shape(), plain.shape());
+  EXPECT_EQ(1, plain.channel_block());
+  for (int i = 0; i < plain.count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i], plain.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(ReorderLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  layer_param.mutable_reorder_param()->set_channel_block(2);
+  ReorderLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ReorderLayerTest, TestBlockedMaxPooling) {
+  LayerParameter layer_param;
+  layer_param.set_type("Pooling");
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(2);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  this->CheckBlockedMatchesPlain(layer_param, 4);
+}
+
+TYPED_TEST(ReorderLayerTest, TestBlockedAvePooling) {
+  LayerParameter layer_param;
+  layer_param.set_type("Pooling");
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+  this->CheckBlockedMatchesPlain(layer_param, 8);
+}
+
+TYPED_TEST(ReorderLayerTest, TestBlockedConvolution) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(12);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckBlockedMatchesPlain(layer_param, 4);
+}
+
+TYPED_TEST(ReorderLayerTest, TestBlockedStridedConvolution) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(2);
+  convolution_param->set_kernel_w(3);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckBlockedMatchesPlain(layer_param, 2);
+}
+
+TYPED_TEST(ReorderLayerTest, TestBlockedConvolutionWide) {
+  // Rows wide enough for the vector micro-kernels of blocks of 8 and 16
+  // channels, with a partial tile of pixels at the end.
+  this->blob_bottom_->Reshape(2, 16, 4, 19);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(16);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckBlockedMatchesPlain(layer_param, 8);
+  this->CheckBlockedMatchesPlain(layer_param, 16);
+  // Input pixels more than one block apart.
+  convolution_param->add_stride(2);
+  this->CheckBlockedMatchesPlain(layer_param, 8);
+  this->CheckBlockedMatchesPlain(layer_param, 16);
+}
+
+}  // namespace caffe
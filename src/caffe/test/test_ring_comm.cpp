@@ -0,0 +1,221 @@
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/solver.hpp"
+#include "caffe/solver_factory.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/ring_comm.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_data_parallel_util.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+// The ranks of a test are threads of the test binary. Their ports are picked
+// by the kernel as free ones: each is bound with port 0 and read back, with
+// all of them bound at once so that they differ.
+static vector<string> LocalPeers(int world_size) {
+  vector<int> fds;
+  vector<string> peers;
+  for (int i = 0; i < world_size; ++i) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    socklen_t length = sizeof(addr);
+    CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length), 0);
+    peers.push_back("127.0.0.1:" + format_int(ntohs(addr.sin_port)));
+    fds.push_back(fd);
+  }
+  for (int i = 0; i < fds.size(); ++i) {
+    close(fds[i]);
+  }
+  return peers;
+}
+
+template <typename Dtype>
+class RingCommTest : public ::testing::Test {
+ protected:
+  static void AllreduceEntry(int rank, const vector<string>* peers,
+      vector<Dtype>* data) {
+    RingComm comm(rank, *peers);
+    comm.Allreduce(data->empty() ? NULL : &(*data)[0], data->size());
+  }
+
+  static void BroadcastEntry(int rank, const vector<string>* peers,
+      vector<Dtype>* data) {
+    RingComm comm(rank, *peers);
+    comm.Broadcast(&(*data)[0], data->size() * sizeof(Dtype));
+  }
+
+  void TestAllreduce(int world_size, int count) {
+    const vector<string> peers = LocalPeers(world_size);
+    vector<vector<Dtype> > data(world_size, vector<Dtype>(count));
+    for (int r = 0; r < world_size; ++r) {
+      for (int i = 0; i < count; ++i) {
+        data[r][i] = r * 100 + i;
+      }
+    }
+    boost::thread_group ranks;
+    for (int r = 0; r < world_size; ++r) {
+      ranks.create_thread(boost::bind(&RingCommTest::AllreduceEntry, r,
+          &peers, &data[r]));
+    }
+    ranks.join_all();
+    for (int r = 0; r < world_size; ++r) {
+      for (int i = 0; i < count; ++i) {
+        EXPECT_EQ(50 * world_size * (world_size - 1) + world_size * i,
+            data[r][i]) << "debug: rank " << r << " i " << i;
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(RingCommTest, TestDtypes);
+
+TYPED_TEST(RingCommTest, TestAllreduce) {
+  this->TestAllreduce(2, 100);
+  this->TestAllreduce(3, 99);
+}
+
+TYPED_TEST(RingCommTest, TestAllreduceUneven) {
+  // Segments of different sizes, and empty ones.
+  this->TestAllreduce(3, 10);
+  this->TestAllreduce(4, 2);
+}
+
+TYPED_TEST(RingCommTest, TestAllreduceOneRank) {
+  this->TestAllreduce(1, 5);
+}
+
+TYPED_TEST(RingCommTest, TestBroadcast) {
+  typedef TypeParam Dtype;
+  const int world_size = 3;
+  // A few broadcast chunks and a partial one.
+  const int count = (5 << 20) / sizeof(Dtype) / 2 + 3;
+  const vector<string> peers = LocalPeers(world_size);
+  vector<vector<Dtype> > data(world_size, vector<Dtype>(count));
+  for (int i = 0; i < count; ++i) {
+    data[0][i] = i % 1000;
+  }
+  boost::thread_group ranks;
+  for (int r = 0; r < world_size; ++r) {
+    ranks.create_thread(boost::bind(&TestFixture::BroadcastEntry, r, &peers,
+        &data[r]));
+  }
+  ranks.join_all();
+  for (int r = 1; r < world_size; ++r) {
+    for (int i = 0; i < count; ++i) {
+      ASSERT_EQ(i % 1000, data[r][i]) << "debug: rank " << r << " i " << i;
+    }
+  }
+}
+
+class RingSyncTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    source_ = MakeDataParallelSource();
+  }
+
+  // Trains for three iterations as rank of world_size, with iter_size
+  // batches of batch_size records per iteration, reducing the gradients in
+  // buckets of bucket_bytes, and returns the learned weights in weights.
+  static void Train(const string& source, int batch_size, int iter_size,
+      size_t bucket_bytes, int rank, const vector<string>* peers,
+      vector<float>* weights) {
+    const int world_size = peers->size();
+    Caffe::set_world_size(world_size);
+    Caffe::set_world_rank(rank);
+    const string proto =
+        "base_lr: 0.1 lr_policy: 'fixed' momentum: 0.9 weight_decay: 0.01 "
+        "random_seed: 1701 iter_size: " + format_int(iter_size) + " " +
+        DataParallelNetProto(source, batch_size);
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    shared_ptr<Solver<float> > solver(
+        SolverRegistry<float>::CreateSolver(param));
+    scoped_ptr<RingSync<float> > sync;
+    if (world_size > 1) {
+      shared_ptr<RingComm> comm(new RingComm(rank, *peers));
+      sync.reset(new RingSync<float>(solver, comm, bucket_bytes));
+    }
+    solver->Step(3);
+    const vector<Blob<float>*>& params = solver->net()->learnable_params();
+    weights->clear();
+    for (int i = 0; i < params.size(); ++i) {
+      weights->insert(weights->end(), params[i]->cpu_data(),
+          params[i]->cpu_data() + params[i]->count());
+    }
+    Caffe::set_world_size(1);
+    Caffe::set_world_rank(0);
+  }
+
+  // Checks that world_size ranks on batches of batch_size train like one
+  // process on batches of world_size * batch_size, as rank r reads records
+  // r, r + world_size, ...
+  void TestMatchesLargerBatch(int world_size, int batch_size, int iter_size,
+      size_t bucket_bytes) {
+    vector<float> expected;
+    const vector<string> single = LocalPeers(1);
+    Train(source_, world_size * batch_size * iter_size, 1, bucket_bytes, 0,
+        &single, &expected);
+    const vector<string> peers = LocalPeers(world_size);
+    vector<vector<float> > weights(world_size);
+    boost::thread_group ranks;
+    for (int r = 0; r < world_size; ++r) {
+      ranks.create_thread(boost::bind(&RingSyncTest::Train, source_,
+          batch_size, iter_size, bucket_bytes, r, &peers, &weights[r]));
+    }
+    ranks.join_all();
+    ASSERT_EQ(4 * 3 + 3 + 3 * 2 + 2, expected.size());
+    for (int r = 0; r < world_size; ++r) {
+      ASSERT_EQ(expected.size(), weights[r].size());
+      for (int i = 0; i < expected.size(); ++i) {
+        EXPECT_NEAR(expected[i], weights[r][i], 1e-6) << "debug: i " << i;
+        // The ranks stay in step bit for bit.
+        EXPECT_EQ(weights[0][i], weights[r][i]) << "debug: i " << i;
+      }
+    }
+  }
+
+  string source_;
+};
+
+TEST_F(RingSyncTest, TestMatchesLargerBatch) {
+  Caffe::set_mode(Caffe::CPU);
+  this->TestMatchesLargerBatch(2, 2, 1, 4 << 20);
+}
+
+TEST_F(RingSyncTest, TestSmallBuckets) {
+  Caffe::set_mode(Caffe::CPU);
+  // Buckets of 4 elements, one of them across ip1 and ip2, and those of
+  // ip2 reduced while ip1 backpropagates.
+  this->TestMatchesLargerBatch(2, 2, 1, 4 * sizeof(float));
+  this->TestMatchesLargerBatch(4, 1, 1, 4 * sizeof(float));
+}
+
+TEST_F(RingSyncTest, TestIterSize) {
+  Caffe::set_mode(Caffe::CPU);
+  this->TestMatchesLargerBatch(2, 1, 2, 4 * sizeof(float));
+}
+
+}  // namespace caffe
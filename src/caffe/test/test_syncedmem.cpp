@@ -67,6 +67,20 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const size_t initial = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(initial, mem.version());
+  mem.mutable_cpu_data();
+  EXPECT_EQ(initial + 1, mem.version());
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_EQ(initial + 2, mem.version());
+  mem.cpu_data();
+  EXPECT_EQ(initial + 2, mem.version());
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
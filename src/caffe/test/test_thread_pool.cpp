@@ -0,0 +1,206 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/batch_norm_layer.hpp"
+#include "caffe/layers/eltwise_layer.hpp"
+#include "caffe/layers/lrn_layer.hpp"
+#include "caffe/layers/pooling_layer.hpp"
+#include "caffe/layers/relu_layer.hpp"
+#include "caffe/layers/softmax_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Counts how often each index is visited, and marks the start of each chunk.
+void MarkRange(vector<int>* visits, vector<int>* chunk_starts, int begin,
+    int end) {
+  (*chunk_starts)[begin] += 1;
+  for (int i = begin; i < end; ++i) {
+    (*visits)[i] += 1;
+  }
+}
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    Caffe::set_cpu_threads(1);
+  }
+
+  int CountChunks(const vector<int>& chunk_starts) {
+    int chunks = 0;
+    for (int i = 0; i < chunk_starts.size(); ++i) {
+      chunks += chunk_starts[i];
+    }
+    return chunks;
+  }
+};
+
+TEST_F(ThreadPoolTest, TestRunVisitsEachIndexOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(4, pool.num_threads());
+  for (int n = 1; n < 100; n += 7) {
+    vector<int> visits(n, 0);
+    vector<int> chunk_starts(n, 0);
+    pool.Run(n, boost::bind(&MarkRange, &visits, &chunk_starts, _1, _2));
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(1, visits[i]);
+    }
+    EXPECT_EQ(std::min(n, 4), CountChunks(chunk_starts));
+  }
+}
+
+TEST_F(ThreadPoolTest, TestRunRespectsGrain) {
+  ThreadPool pool(4);
+  vector<int> visits(100, 0);
+  vector<int> chunk_starts(100, 0);
+  pool.Run(100, boost::bind(&MarkRange, &visits, &chunk_starts, _1, _2), 40);
+  EXPECT_EQ(2, CountChunks(chunk_starts));
+  for (int i = 0; i < visits.size(); ++i) {
+    EXPECT_EQ(1, visits[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestParallelForSerialByDefault) {
+  EXPECT_EQ(1, Caffe::cpu_threads());
+  vector<int> visits(100, 0);
+  vector<int> chunk_starts(100, 0);
+  caffe_parallel_for(100,
+      boost::bind(&MarkRange, &visits, &chunk_starts, _1, _2));
+  EXPECT_EQ(1, CountChunks(chunk_starts));
+  EXPECT_EQ(1, chunk_starts[0]);
+}
+
+TEST_F(ThreadPoolTest, TestParallelForUsesCaffeThreads) {
+  Caffe::set_cpu_threads(3);
+  EXPECT_EQ(3, Caffe::cpu_threads());
+  EXPECT_EQ(3, Caffe::thread_pool().num_threads());
+  vector<int> visits(100, 0);
+  vector<int> chunk_starts(100, 0);
+  caffe_parallel_for(100,
+      boost::bind(&MarkRange, &visits, &chunk_starts, _1, _2));
+  EXPECT_EQ(3, CountChunks(chunk_starts));
+  for (int i = 0; i < visits.size(); ++i) {
+    EXPECT_EQ(1, visits[i]);
+  }
+  Caffe::set_cpu_threads(0);
+  EXPECT_GE(Caffe::cpu_threads(), 1);
+}
+
+// Runs a layer forward and backward on one and on four threads and checks
+// that the results agree. The bottoms hold four times
+// kParallelElementwiseGrain elements, in planes of 32 x 32, so that both the
+// elementwise and the per-plane loops are split across the threads.
+template <typename Dtype>
+void CheckLayerMatchesSerial(Layer<Dtype>* layer, int num_bottoms = 1) {
+  const int num = 4;
+  const int channels = 4 * kParallelElementwiseGrain / (num * 32 * 32);
+  vector<shared_ptr<Blob<Dtype> > > bottoms(num_bottoms);
+  vector<Blob<Dtype>*> bottom_vec;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < num_bottoms; ++i) {
+    bottoms[i].reset(new Blob<Dtype>(num, channels, 32, 32));
+    filler.Fill(bottoms[i].get());
+    bottom_vec.push_back(bottoms[i].get());
+  }
+  ASSERT_GT(bottom_vec[0]->count(), kParallelElementwiseGrain);
+  Blob<Dtype> top;
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  layer->SetUp(bottom_vec, top_vec);
+  Blob<Dtype> serial_top;
+  vector<shared_ptr<Blob<Dtype> > > serial_bottoms(num_bottoms);
+  vector<bool> propagate_down(num_bottoms, true);
+  for (int threads = 1; threads <= 4; threads += 3) {
+    Caffe::set_cpu_threads(threads);
+    layer->Forward(bottom_vec, top_vec);
+    caffe_copy(top.count(), top.cpu_data(), top.mutable_cpu_diff());
+    layer->Backward(top_vec, propagate_down, bottom_vec);
+    if (threads == 1) {
+      serial_top.CopyFrom(top, false, true);
+      for (int i = 0; i < num_bottoms; ++i) {
+        serial_bottoms[i].reset(new Blob<Dtype>());
+        serial_bottoms[i]->CopyFrom(*bottoms[i], true, true);
+      }
+      continue;
+    }
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_NEAR(serial_top.cpu_data()[i], top.cpu_data()[i], 1e-5);
+    }
+    for (int b = 0; b < num_bottoms; ++b) {
+      for (int i = 0; i < bottoms[b]->count(); ++i) {
+        EXPECT_NEAR(serial_bottoms[b]->cpu_diff()[i],
+            bottoms[b]->cpu_diff()[i], 1e-5);
+      }
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestPoolingMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  layer_param.mutable_pooling_param()->set_kernel_size(3);
+  layer_param.mutable_pooling_param()->set_stride(2);
+  PoolingLayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer);
+}
+
+TEST_F(ThreadPoolTest, TestLRNMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  LRNLayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer);
+}
+
+TEST_F(ThreadPoolTest, TestSoftmaxMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  SoftmaxLayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer);
+}
+
+TEST_F(ThreadPoolTest, TestReLUMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  layer_param.mutable_relu_param()->set_negative_slope(0.1);
+  ReLULayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer);
+}
+
+TEST_F(ThreadPoolTest, TestEltwiseSumMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  layer_param.mutable_eltwise_param()->set_operation(
+      EltwiseParameter_EltwiseOp_SUM);
+  layer_param.mutable_eltwise_param()->add_coeff(1);
+  layer_param.mutable_eltwise_param()->add_coeff(-2);
+  EltwiseLayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer, 2);
+}
+
+TEST_F(ThreadPoolTest, TestEltwiseMaxMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  layer_param.mutable_eltwise_param()->set_operation(
+      EltwiseParameter_EltwiseOp_MAX);
+  EltwiseLayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer, 2);
+}
+
+TEST_F(ThreadPoolTest, TestBatchNormMatchesSerial) {
+  Caffe::set_mode(Caffe::CPU);
+  LayerParameter layer_param;
+  BatchNormLayer<float> layer(layer_param);
+  CheckLayerMatchesSerial(&layer);
+}
+
+}  // namespace caffe
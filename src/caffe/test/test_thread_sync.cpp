@@ -0,0 +1,160 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/parallel.hpp"
+#include "caffe/solver.hpp"
+#include "caffe/solver_factory.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_data_parallel_util.hpp"
+
+namespace caffe {
+
+class ThreadSyncTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    Caffe::set_mode(Caffe::CPU);
+    source_ = MakeDataParallelSource();
+  }
+
+  virtual void TearDown() {
+    Caffe::set_solver_count(1);
+  }
+
+  shared_ptr<Solver<float> > CreateSolver(int batch_size, int max_iter,
+      const string& base_lr = "0.1", const string& extra_layers = "") {
+    const string proto =
+        "base_lr: " + base_lr + " lr_policy: 'fixed' momentum: 0.9 "
+        "weight_decay: 0.01 "
+        "random_seed: 1701 snapshot_after_train: false "
+        "max_iter: " + format_int(max_iter) + " " +
+        DataParallelNetProto(source_, batch_size, extra_layers);
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    return shared_ptr<Solver<float> >(
+        SolverRegistry<float>::CreateSolver(param));
+  }
+
+  static vector<float> Weights(Solver<float>* solver) {
+    const vector<Blob<float>*>& params = solver->net()->learnable_params();
+    vector<float> weights;
+    for (int i = 0; i < params.size(); ++i) {
+      weights.insert(weights.end(), params[i]->cpu_data(),
+          params[i]->cpu_data() + params[i]->count());
+    }
+    return weights;
+  }
+
+  // The blobs of the BatchNorm layer 'bn' of the net of solver.
+  static vector<vector<float> > Statistics(Solver<float>* solver) {
+    const vector<shared_ptr<Blob<float> > >& blobs =
+        solver->net()->layer_by_name("bn")->blobs();
+    vector<vector<float> > statistics;
+    for (int i = 0; i < blobs.size(); ++i) {
+      statistics.push_back(vector<float>(blobs[i]->cpu_data(),
+          blobs[i]->cpu_data() + blobs[i]->count()));
+    }
+    return statistics;
+  }
+
+  // The loss of the net of solver on its next batch, with weights as its
+  // learnable params.
+  static float Loss(Solver<float>* solver, const vector<float>& weights) {
+    const vector<Blob<float>*>& params = solver->net()->learnable_params();
+    const float* data = &weights[0];
+    for (int i = 0; i < params.size(); ++i) {
+      caffe_copy(params[i]->count(), data, params[i]->mutable_cpu_data());
+      data += params[i]->count();
+    }
+    float loss;
+    solver->net()->Forward(&loss);
+    return loss;
+  }
+
+  string source_;
+};
+
+TEST_F(ThreadSyncTest, TestMatchesLargerBatch) {
+  // Two threads on batches of two train like one solver on batches of
+  // four, as each thread reads every other record.
+  vector<float> expected;
+  {
+    shared_ptr<Solver<float> > solver = CreateSolver(4, 3);
+    solver->Solve();
+    expected = Weights(solver.get());
+  }
+  Caffe::set_solver_count(2);
+  shared_ptr<Solver<float> > solver = CreateSolver(2, 3);
+  ThreadSync<float> sync(solver, NULL, 0, false);
+  sync.Run(2);
+  const vector<float> weights = Weights(solver.get());
+  ASSERT_EQ(4 * 3 + 3 + 3 * 2 + 2, expected.size());
+  ASSERT_EQ(expected.size(), weights.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], weights[i], 1e-6) << "debug: i " << i;
+  }
+}
+
+TEST_F(ThreadSyncTest, TestBatchNormStatistics) {
+  // The running mean of a BatchNorm on the data is the same when two
+  // threads see batches of two as when one solver sees batches of four, as
+  // the replicas average their statistics each iteration.
+  const string batch_norm =
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'data' top: 'bn' } ";
+  vector<vector<float> > expected;
+  {
+    shared_ptr<Solver<float> > solver = CreateSolver(4, 3, "0.1", batch_norm);
+    solver->Solve();
+    expected = Statistics(solver.get());
+  }
+  Caffe::set_solver_count(2);
+  shared_ptr<Solver<float> > solver = CreateSolver(2, 3, "0.1", batch_norm);
+  ThreadSync<float> sync(solver, NULL, 0, false);
+  sync.Run(2);
+  const vector<vector<float> > statistics = Statistics(solver.get());
+  // The variance differs, as it is taken over the batch of each thread.
+  const int kCompared[] = {0, 2};
+  for (int k = 0; k < 2; ++k) {
+    const int i = kCompared[k];
+    ASSERT_EQ(expected[i].size(), statistics[i].size());
+    for (int j = 0; j < expected[i].size(); ++j) {
+      EXPECT_NEAR(expected[i][j], statistics[i][j], 1e-5)
+          << "debug: blob " << i << " j " << j;
+    }
+  }
+}
+
+TEST_F(ThreadSyncTest, TestHogwild) {
+  vector<float> initial;
+  vector<float> weights;
+  {
+    Caffe::set_solver_count(2);
+    shared_ptr<Solver<float> > solver = CreateSolver(2, 50, "0.01");
+    initial = Weights(solver.get());
+    ThreadSync<float> sync(solver, NULL, 0, true);
+    sync.Run(2);
+    weights = Weights(solver.get());
+  }
+  ASSERT_EQ(initial.size(), weights.size());
+  bool changed = false;
+  for (int i = 0; i < weights.size(); ++i) {
+    ASSERT_TRUE(std::isfinite(weights[i])) << "debug: i " << i;
+    changed |= weights[i] != initial[i];
+  }
+  EXPECT_TRUE(changed);
+  // The loss over all the records, measured by a solver of its own as the
+  // data layers of the threads read records for each other.
+  Caffe::set_solver_count(1);
+  shared_ptr<Solver<float> > check = CreateSolver(8, 1);
+  const float initial_loss = Loss(check.get(), initial);
+  EXPECT_LT(Loss(check.get(), weights), initial_loss);
+}
+
+}  // namespace caffe
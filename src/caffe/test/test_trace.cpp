@@ -0,0 +1,89 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/trace.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TraceTest : public ::testing::Test {
+ protected:
+  TraceTest() {
+    MakeTempFilename(&filename_);
+  }
+
+  string ReadTrace() {
+    std::ifstream in(filename_.c_str());
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+  }
+
+  string filename_;
+};
+
+TEST_F(TraceTest, TestNetEvents) {
+  Caffe::set_mode(Caffe::CPU);
+  const string proto =
+      "name: 'TraceNet' "
+      "layer { name: 'data' type: 'DummyData' top: 'data' top: 'label' "
+      "  dummy_data_param { shape { dim: 2 dim: 3 } shape { dim: 2 } "
+      "    data_filler { type: 'gaussian' } "
+      "    data_filler { type: 'constant' value: 1 } } } "
+      "layer { name: 'ip\"1' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+      "  inner_product_param { num_output: 4 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'loss' type: 'SoftmaxWithLoss' bottom: 'ip' "
+      "  bottom: 'label' top: 'loss' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<float> net(param);
+  // Nothing is recorded before Start().
+  net.ForwardBackward();
+  Trace::Start(filename_);
+  EXPECT_TRUE(Trace::enabled());
+  net.ForwardBackward();
+  Trace::Stop();
+  EXPECT_FALSE(Trace::enabled());
+  const string trace = ReadTrace();
+  EXPECT_EQ(0, trace.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["));
+  EXPECT_NE(string::npos, trace.find(
+      "{\"name\": \"ip\\\"1\", \"cat\": \"forward\", \"ph\": \"X\""));
+  EXPECT_NE(string::npos, trace.find(
+      "{\"name\": \"ip\\\"1\", \"cat\": \"backward\", \"ph\": \"X\""));
+  EXPECT_NE(string::npos, trace.find("\"type\": \"SoftmaxWithLoss\""));
+  // Three forward and two backward passes.
+  int events = 0;
+  for (size_t pos = trace.find("\"ph\""); pos != string::npos;
+       pos = trace.find("\"ph\"", pos + 1)) {
+    ++events;
+  }
+  EXPECT_EQ(5, events);
+}
+
+TEST_F(TraceTest, TestAllocations) {
+  Caffe::set_mode(Caffe::CPU);
+  Trace::Start(filename_);
+  {
+    TraceScope trace("allocate", "test");
+    trace.AddArg("count", 256);
+    SyncedMemory memory(256 * sizeof(float));
+    memory.mutable_cpu_data();
+  }
+  EXPECT_EQ(1024, Trace::bytes_allocated());
+  Trace::Stop();
+  const string trace = ReadTrace();
+  EXPECT_NE(string::npos, trace.find(
+      "\"args\": {\"count\": 256, \"bytes_allocated\": 1024}"));
+}
+
+}  // namespace caffe
@@ -0,0 +1,234 @@
+#include "caffe/util/db_packed.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace caffe { namespace db {
+
+namespace {
+
+// "CAFFPCK1" read as a little-endian uint64.
+const uint64_t kPackedMagic = 0x314b435046464143ULL;
+// The number of chunks, the size of the segment and the magic number.
+const uint64_t kTrailerSize = 3 * sizeof(uint64_t);
+
+template <typename T>
+inline T Load(const char* p) {
+  T value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// Tells the kernel that [begin, begin + size) of a mapping will be needed,
+// rounding begin down to a page as madvise requires.
+void WillNeed(const char* begin, uint64_t size, const char* base) {
+  static const uintptr_t page = sysconf(_SC_PAGESIZE);
+  const uintptr_t offset = (begin - base) % page;
+  madvise(const_cast<char*>(begin - offset), size + offset, MADV_WILLNEED);
+}
+
+}  // namespace
+
+void PackedCursor::EnterChunk(int chunk) {
+  const vector<PackedChunk>& chunks = db_->chunks_;
+  while (chunk < chunks.size() && chunks[chunk].num_records == 0) {
+    ++chunk;
+  }
+  chunk_ = chunk;
+  index_ = 0;
+  if (chunk_ < chunks.size()) {
+    offset_ = chunks[chunk_].offset;
+    if (chunk_ + 1 < chunks.size()) {
+      WillNeed(db_->data_ + chunks[chunk_ + 1].offset,
+          chunks[chunk_ + 1].size, db_->data_);
+    }
+  }
+}
+
+void PackedCursor::Seek(const string& key) {
+  CHECK(db_->Find(key, this)) << "Key " << key << " not found";
+}
+
+void PackedCursor::Next() {
+  offset_ += kHeaderSize + key_size() + value_size();
+  if (++index_ == db_->chunks_[chunk_].num_records) {
+    EnterChunk(chunk_ + 1);
+  }
+}
+
+bool PackedCursor::valid() {
+  return chunk_ < db_->chunks_.size();
+}
+
+const char* PackedCursor::record() const {
+  return db_->data_ + offset_;
+}
+
+uint32_t PackedCursor::key_size() const {
+  return Load<uint32_t>(record());
+}
+
+uint32_t PackedCursor::value_size() const {
+  return Load<uint32_t>(record() + sizeof(uint32_t));
+}
+
+void PackedTransaction::Put(const string& key, const string& value) {
+  const uint32_t sizes[2] = {static_cast<uint32_t>(key.size()),
+                             static_cast<uint32_t>(value.size())};
+  CHECK_EQ(sizes[1], value.size()) << "Record too large for a packed db";
+  chunk_.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  chunk_ += key;
+  chunk_ += value;
+  ++num_records_;
+}
+
+void PackedTransaction::Commit() {
+  if (num_records_ > 0) {
+    db_->AppendChunk(chunk_, num_records_);
+  }
+  chunk_.clear();
+  num_records_ = 0;
+}
+
+void PackedDB::Open(const string& source, Mode mode) {
+  source_ = source;
+  if (mode == READ) {
+    OpenRead(source);
+    return;
+  }
+  // NEW fails if the file exists; WRITE appends a segment to it.
+  const int flags = O_WRONLY | O_CREAT |
+      (mode == NEW ? O_EXCL : O_APPEND);
+  const int fd = open(source.c_str(), flags, 0664);
+  CHECK_GE(fd, 0) << "Failed to open packed db " << source << ": "
+      << strerror(errno);
+  file_ = fdopen(fd, "a");
+  CHECK(file_) << "Failed to open packed db " << source;
+  segment_size_ = 0;
+  written_.clear();
+  LOG(INFO) << "Opened packed db " << source;
+}
+
+void PackedDB::OpenRead(const string& source) {
+  const int fd = open(source.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open packed db " << source << ": "
+      << strerror(errno);
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat packed db " << source;
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* data = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    CHECK(data != MAP_FAILED) << "Failed to map packed db " << source << ": "
+        << strerror(errno);
+    data_ = static_cast<const char*>(data);
+    madvise(data, size_, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  // Walk the segments back from the end of the file.
+  vector<vector<PackedChunk> > segments;
+  uint64_t end = size_;
+  while (end > 0) {
+    CHECK_GE(end, kTrailerSize) << "Truncated packed db " << source;
+    const char* trailer = data_ + end - kTrailerSize;
+    CHECK_EQ(Load<uint64_t>(trailer + 2 * sizeof(uint64_t)), kPackedMagic)
+        << source << " is not a packed db, or is truncated";
+    const uint64_t num_chunks = Load<uint64_t>(trailer);
+    const uint64_t segment_size = Load<uint64_t>(trailer + sizeof(uint64_t));
+    const uint64_t index_size = num_chunks * sizeof(PackedChunk);
+    CHECK_LE(segment_size, end) << "Corrupt packed db " << source;
+    CHECK_GE(segment_size, index_size + kTrailerSize)
+        << "Corrupt packed db " << source;
+    const uint64_t start = end - segment_size;
+    const uint64_t index = end - kTrailerSize - index_size;
+    segments.push_back(vector<PackedChunk>(num_chunks));
+    for (int i = 0; i < num_chunks; ++i) {
+      PackedChunk& chunk = segments.back()[i];
+      chunk = Load<PackedChunk>(data_ + index + i * sizeof(PackedChunk));
+      chunk.offset += start;
+      CHECK_LE(chunk.offset + chunk.size, index)
+          << "Corrupt packed db " << source;
+    }
+    end = start;
+  }
+  chunks_.clear();
+  for (int i = segments.size() - 1; i >= 0; --i) {
+    chunks_.insert(chunks_.end(), segments[i].begin(), segments[i].end());
+  }
+  keys_.clear();
+  LOG(INFO) << "Opened packed db " << source << " with " << chunks_.size()
+      << " chunks in " << segments.size() << " segments";
+}
+
+void PackedDB::Close() {
+  if (file_ != NULL) {
+    const uint64_t trailer[3] = {written_.size(),
+        segment_size_ + written_.size() * sizeof(PackedChunk) + kTrailerSize,
+        kPackedMagic};
+    if (!written_.empty()) {
+      CHECK_EQ(fwrite(&written_[0], sizeof(PackedChunk), written_.size(),
+          file_), written_.size()) << "Failed to write packed db " << source_;
+    }
+    CHECK_EQ(fwrite(trailer, sizeof(trailer), 1, file_), 1)
+        << "Failed to write packed db " << source_;
+    CHECK_EQ(fclose(file_), 0) << "Failed to write packed db " << source_;
+    file_ = NULL;
+  }
+  if (data_ != NULL) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = NULL;
+    size_ = 0;
+  }
+}
+
+PackedCursor* PackedDB::NewCursor() {
+  CHECK(file_ == NULL) << "Packed db " << source_ << " is open for writing";
+  return new PackedCursor(this);
+}
+
+PackedTransaction* PackedDB::NewTransaction() {
+  CHECK(file_ != NULL) << "Packed db " << source_ << " is open for reading";
+  return new PackedTransaction(this);
+}
+
+void PackedDB::AppendChunk(const string& chunk, uint64_t num_records) {
+  PackedChunk entry;
+  entry.offset = segment_size_;
+  entry.size = chunk.size();
+  entry.num_records = num_records;
+  CHECK_EQ(fwrite(chunk.data(), 1, chunk.size(), file_), chunk.size())
+      << "Failed to write packed db " << source_;
+  written_.push_back(entry);
+  segment_size_ += chunk.size();
+}
+
+bool PackedDB::Find(const string& key, PackedCursor* cursor) const {
+  {
+    boost::mutex::scoped_lock lock(keys_mutex_);
+    if (keys_.empty() && !chunks_.empty()) {
+      PackedCursor scan(this);
+      for (; scan.valid(); scan.Next()) {
+        const Position position = {scan.chunk_, scan.index_, scan.offset_};
+        keys_.insert(std::make_pair(scan.key(), position));
+      }
+    }
+  }
+  std::map<string, Position>::const_iterator it = keys_.find(key);
+  if (it == keys_.end()) {
+    return false;
+  }
+  cursor->chunk_ = it->second.chunk;
+  cursor->index_ = it->second.index;
+  cursor->offset_ = it->second.offset;
+  return true;
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,177 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fuse_layers.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Whether the engine the layer will run on applies a fused ReLU.
+bool SupportsFusedReLU(const LayerParameter& layer_param) {
+#ifdef USE_CUDNN
+  if (layer_param.type() == "Convolution") {
+    return layer_param.convolution_param().engine() ==
+        ConvolutionParameter_Engine_CAFFE;
+  }
+#endif
+  return true;
+}
+
+}  // namespace
+
+void FuseLayers(const NetParameter& param, NetParameter* param_fused) {
+  // Initialize by copying from the input NetParameter.
+  param_fused->CopyFrom(param);
+  param_fused->clear_layer();
+  int i = 0;
+  while (i < param.layer_size()) {
+    const LayerParameter& layer_param = param.layer(i);
+    LayerParameter* fused = param_fused->add_layer();
+    fused->CopyFrom(layer_param);
+    ++i;
+    if (!SupportsFolding(layer_param)) {
+      continue;
+    }
+    // After InsertSplits, a layer reading the top is its only consumer.
+    FusionParameter* fusion_param = fused->mutable_fusion_param();
+    while (i < param.layer_size()) {
+      const LayerParameter& next_param = param.layer(i);
+      if (next_param.bottom_size() != 1 || next_param.top_size() != 1 ||
+          next_param.bottom(0) != fused->top(0) ||
+          next_param.loss_weight_size() > 0) {
+        break;
+      }
+      if (IsFoldable(next_param)) {
+        fusion_param->add_folded_layer()->CopyFrom(next_param);
+      } else if (next_param.type() == "ReLU" && SupportsFusedReLU(*fused)) {
+        fusion_param->mutable_relu_param()->CopyFrom(next_param.relu_param());
+      } else {
+        break;
+      }
+      LOG_IF(INFO, Caffe::root_solver()) << "Fusing layer "
+          << next_param.name() << " into " << fused->name();
+      fused->set_top(0, next_param.top(0));
+      ++i;
+      if (fusion_param->has_relu_param()) {
+        break;
+      }
+    }
+    if (fusion_param->folded_layer_size() == 0) {
+      if (!fusion_param->has_relu_param()) {
+        fused->clear_fusion_param();
+      }
+      continue;
+    }
+    // The folded transforms need a bias to shift.
+    if (fused->type() == "Convolution") {
+      if (!fused->convolution_param().bias_term()) {
+        fused->mutable_convolution_param()->set_bias_term(true);
+        fusion_param->set_added_bias(true);
+      }
+    } else if (!fused->inner_product_param().bias_term()) {
+      fused->mutable_inner_product_param()->set_bias_term(true);
+      fusion_param->set_added_bias(true);
+    }
+  }
+}
+
+bool SupportsFolding(const LayerParameter& layer_param) {
+  if (layer_param.top_size() != 1 || layer_param.has_fusion_param()) {
+    return false;
+  }
+  // Folding rewrites the weights, which must not be shared.
+  for (int i = 0; i < layer_param.param_size(); ++i) {
+    if (!layer_param.param(i).name().empty()) {
+      return false;
+    }
+  }
+  if (layer_param.type() == "Convolution") {
+    return layer_param.convolution_param().axis() == 1;
+  }
+  if (layer_param.type() == "InnerProduct") {
+    return layer_param.inner_product_param().axis() == 1 &&
+        !layer_param.inner_product_param().transpose();
+  }
+  return false;
+}
+
+bool IsFoldable(const LayerParameter& layer_param) {
+  const string& type = layer_param.type();
+  if (type == "BatchNorm") {
+    return !layer_param.batch_norm_param().has_use_global_stats() ||
+        layer_param.batch_norm_param().use_global_stats();
+  }
+  if (type == "Scale") {
+    return layer_param.scale_param().axis() == 1 &&
+        layer_param.scale_param().num_axes() == 1;
+  }
+  if (type == "Bias") {
+    return layer_param.bias_param().axis() == 1 &&
+        layer_param.bias_param().num_axes() == 1;
+  }
+  return false;
+}
+
+template <typename Dtype>
+void FoldTrainedLayer(const LayerParameter& folded_param,
+    const vector<shared_ptr<Blob<Dtype> > >& folded_blobs,
+    Blob<Dtype>* weight, Blob<Dtype>* bias) {
+  const int num_output = weight->shape(0);
+  const int dim = weight->count() / num_output;
+  CHECK_EQ(num_output, bias->count());
+  CHECK(!folded_blobs.empty())
+      << "No trained blobs for layer " << folded_param.name();
+  CHECK_EQ(num_output, folded_blobs[0]->count())
+      << "Cannot fold layer " << folded_param.name() << "; expected "
+      << num_output << " channels";
+  // Each transform maps an output y of channel c to scale[c] * y + shift[c].
+  vector<Dtype> scale(num_output, Dtype(1));
+  vector<Dtype> shift(num_output, Dtype(0));
+  const string& type = folded_param.type();
+  if (type == "BatchNorm") {
+    CHECK_EQ(3, folded_blobs.size());
+    // The stored statistics are sums, scaled by the factor in blob 2.
+    const Dtype factor = folded_blobs[2]->cpu_data()[0];
+    const Dtype norm = factor == 0 ? Dtype(0) : Dtype(1) / factor;
+    const Dtype eps = folded_param.batch_norm_param().eps();
+    const Dtype* mean = folded_blobs[0]->cpu_data();
+    const Dtype* variance = folded_blobs[1]->cpu_data();
+    for (int c = 0; c < num_output; ++c) {
+      scale[c] = Dtype(1) / std::sqrt(variance[c] * norm + eps);
+      shift[c] = -mean[c] * norm * scale[c];
+    }
+  } else if (type == "Scale") {
+    const Dtype* gamma = folded_blobs[0]->cpu_data();
+    for (int c = 0; c < num_output; ++c) {
+      scale[c] = gamma[c];
+      shift[c] = folded_blobs.size() > 1 ? folded_blobs[1]->cpu_data()[c] :
+          Dtype(0);
+    }
+  } else if (type == "Bias") {
+    const Dtype* beta = folded_blobs[0]->cpu_data();
+    for (int c = 0; c < num_output; ++c) {
+      shift[c] = beta[c];
+    }
+  } else {
+    LOG(FATAL) << "Cannot fold layer type " << type;
+  }
+  Dtype* weight_data = weight->mutable_cpu_data();
+  Dtype* bias_data = bias->mutable_cpu_data();
+  for (int c = 0; c < num_output; ++c) {
+    caffe_scal(dim, scale[c], weight_data + c * dim);
+    bias_data[c] = bias_data[c] * scale[c] + shift[c];
+  }
+}
+
+template void FoldTrainedLayer<float>(const LayerParameter& folded_param,
+    const vector<shared_ptr<Blob<float> > >& folded_blobs,
+    Blob<float>* weight, Blob<float>* bias);
+template void FoldTrainedLayer<double>(const LayerParameter& folded_param,
+    const vector<shared_ptr<Blob<double> > >& folded_blobs,
+    Blob<double>* weight, Blob<double>* bias);
+
+}  // namespace caffe
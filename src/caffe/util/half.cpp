@@ -0,0 +1,70 @@
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, BlobProto_Storage storage, const Dtype* x,
+    uint16_t* y) {
+  CHECK_NE(storage, BlobProto_Storage_FLOAT);
+  if (storage == BlobProto_Storage_BFLOAT16) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = caffe_float_to_bf16(x[i]);
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = caffe_float_to_fp16(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_to_half<float>(const int n, BlobProto_Storage storage,
+    const float* x, uint16_t* y);
+template void caffe_cpu_to_half<double>(const int n,
+    BlobProto_Storage storage, const double* x, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, BlobProto_Storage storage,
+    const uint16_t* x, Dtype* y) {
+  CHECK_NE(storage, BlobProto_Storage_FLOAT);
+  if (storage == BlobProto_Storage_BFLOAT16) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = caffe_bf16_to_float(x[i]);
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = caffe_fp16_to_float(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_from_half<float>(const int n,
+    BlobProto_Storage storage, const uint16_t* x, float* y);
+template void caffe_cpu_from_half<double>(const int n,
+    BlobProto_Storage storage, const uint16_t* x, double* y);
+
+void CompressBlobProto(BlobProto_Storage storage, BlobProto* proto) {
+  if (storage == BlobProto_Storage_FLOAT ||
+      proto->storage() != BlobProto_Storage_FLOAT) {
+    return;
+  }
+  const bool is_double = proto->double_data_size() > 0;
+  const int count = is_double ? proto->double_data_size() : proto->data_size();
+  // The values are stored little-endian, two bytes each.
+  string half_data(2 * count, '\0');
+  for (int i = 0; i < count; ++i) {
+    const float value = is_double ? proto->double_data(i) : proto->data(i);
+    const uint16_t h = storage == BlobProto_Storage_BFLOAT16 ?
+        caffe_float_to_bf16(value) : caffe_float_to_fp16(value);
+    half_data[2 * i] = static_cast<char>(h & 0xff);
+    half_data[2 * i + 1] = static_cast<char>(h >> 8);
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->set_storage(storage);
+  proto->set_half_data(half_data);
+}
+
+}  // namespace caffe
@@ -0,0 +1,87 @@
+#include <boost/thread.hpp>
+
+#include <sstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+ImageCache::ImageCache(uint64_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes), mutex_(new boost::mutex()),
+      size_bytes_(0), hits_(0), misses_(0) {
+}
+
+ImageCache::~ImageCache() {
+}
+
+uint64_t ImageCache::EntryBytes(const string& key, const Datum& datum) {
+  return key.size() + datum.data().size() +
+      datum.float_data_size() * sizeof(float);
+}
+
+shared_ptr<const Datum> ImageCache::Get(const string& key) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::map<string, LRUList::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return shared_ptr<const Datum>();
+  }
+  ++hits_;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->second;
+}
+
+void ImageCache::Put(const string& key, const shared_ptr<const Datum>& datum) {
+  const uint64_t bytes = EntryBytes(key, *datum);
+  if (bytes > capacity_bytes_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::map<string, LRUList::iterator>::iterator it = index_.find(key);
+  if (it != index_.end()) {
+    // Another thread decoded the same image first.
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return;
+  }
+  while (size_bytes_ + bytes > capacity_bytes_) {
+    const LRUList::value_type& last = entries_.back();
+    size_bytes_ -= EntryBytes(last.first, *last.second);
+    index_.erase(last.first);
+    entries_.pop_back();
+  }
+  entries_.push_front(std::make_pair(key, datum));
+  index_[key] = entries_.begin();
+  size_bytes_ += bytes;
+}
+
+uint64_t ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return hits_;
+}
+
+uint64_t ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return misses_;
+}
+
+uint64_t ImageCache::size_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return size_bytes_;
+}
+
+int ImageCache::size() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return index_.size();
+}
+
+string ImageCache::stats() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::ostringstream stream;
+  stream << hits_ << " hits, " << misses_ << " misses, " << index_.size()
+      << " images in " << size_bytes_ / (1024 * 1024) << " of "
+      << capacity_bytes_ / (1024 * 1024) << " MB";
+  return stream.str();
+}
+
+}  // namespace caffe
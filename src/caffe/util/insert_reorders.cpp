@@ -0,0 +1,183 @@
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/insert_reorders.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Tracks, for every blob name of the original net, the names of the blobs
+// holding its current value in the plain and in the blocked layout ("" if
+// none is up to date).
+class BlobVersions {
+ public:
+  BlobVersions(const NetParameter& param, int channel_block)
+      : channel_block_(channel_block) {
+    for (int i = 0; i < param.layer_size(); ++i) {
+      const LayerParameter& layer_param = param.layer(i);
+      for (int j = 0; j < layer_param.top_size(); ++j) {
+        original_names_.insert(layer_param.top(j));
+      }
+    }
+  }
+
+  // Returns an unused name for a version of blob_name in the given layout.
+  string NewName(const string& blob_name, bool blocked) {
+    string base = blob_name;
+    if (blocked) {
+      ostringstream stream;
+      stream << blob_name << "_nchw" << channel_block_ << "c";
+      base = stream.str();
+    }
+    string name = base;
+    for (int k = 1; used_names_.count(name) ||
+         (name != blob_name && original_names_.count(name)); ++k) {
+      ostringstream stream;
+      stream << base << "_" << k;
+      name = stream.str();
+    }
+    used_names_.insert(name);
+    return name;
+  }
+
+  // Records that name now holds the value of blob_name in one layout, and
+  // that any copy in the other layout is stale.
+  void Produce(const string& blob_name, const string& name, bool blocked) {
+    used_names_.insert(name);
+    plain_[blob_name] = blocked ? "" : name;
+    blocked_[blob_name] = blocked ? name : "";
+  }
+
+  // Returns the blob holding blob_name in the requested layout, adding a
+  // ReorderLayer to param if no up to date copy exists.
+  string Get(const string& blob_name, bool blocked, NetParameter* param) {
+    map<string, string>& wanted = blocked ? blocked_ : plain_;
+    map<string, string>& other = blocked ? plain_ : blocked_;
+    if (!wanted.count(blob_name)) {
+      // Not produced by any layer (e.g. a deprecated net input): plain.
+      plain_[blob_name] = blob_name;
+      blocked_[blob_name] = "";
+    }
+    if (wanted[blob_name].empty()) {
+      const string name = NewName(blob_name, blocked);
+      ConfigureReorderLayer(other[blob_name], name,
+          blocked ? channel_block_ : 1, param->add_layer());
+      wanted[blob_name] = name;
+    }
+    return wanted[blob_name];
+  }
+
+ private:
+  const int channel_block_;
+  set<string> original_names_;
+  set<string> used_names_;
+  map<string, string> plain_;
+  map<string, string> blocked_;
+};
+
+}  // namespace
+
+void InsertReorders(const NetParameter& param, NetParameter* param_reordered) {
+  const int channel_block = param.channel_block();
+  // Initialize by copying from the input NetParameter.
+  param_reordered->CopyFrom(param);
+  if (channel_block <= 1) {
+    return;
+  }
+  param_reordered->clear_layer();
+  BlobVersions versions(param, channel_block);
+  // Blobs whose channel count is known to be a multiple of channel_block.
+  set<string> blockable;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    // A layer runs blocked if it can, if its inputs can be blocked, and if
+    // all of its tops feed later layers, so that net outputs stay plain.
+    bool blocked = SupportsChannelBlock(layer_param, channel_block)
+        && layer_param.loss_weight_size() == 0;
+    for (int j = 0; blocked && j < layer_param.bottom_size(); ++j) {
+      blocked = blockable.count(layer_param.bottom(j)) > 0;
+    }
+    for (int j = 0; blocked && j < layer_param.top_size(); ++j) {
+      bool consumed = false;
+      for (int k = i + 1; !consumed && k < param.layer_size(); ++k) {
+        for (int b = 0; b < param.layer(k).bottom_size(); ++b) {
+          consumed |= param.layer(k).bottom(b) == layer_param.top(j);
+        }
+      }
+      blocked = consumed;
+    }
+    // Fetch the bottoms in the layer's layout first, as this may add
+    // ReorderLayers that have to come before the layer itself.
+    vector<string> bottoms(layer_param.bottom_size());
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      bottoms[j] = versions.Get(layer_param.bottom(j), blocked,
+          param_reordered);
+    }
+    LayerParameter* reordered = param_reordered->add_layer();
+    reordered->CopyFrom(layer_param);
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      reordered->set_bottom(j, bottoms[j]);
+    }
+    for (int j = 0; j < layer_param.top_size(); ++j) {
+      const string& blob_name = layer_param.top(j);
+      string name;
+      if (j < layer_param.bottom_size() &&
+          layer_param.bottom(j) == blob_name) {
+        // In-place computation keeps the renamed bottom.
+        name = bottoms[j];
+      } else {
+        name = versions.NewName(blob_name, blocked);
+      }
+      reordered->set_top(j, name);
+      versions.Produce(blob_name, name, blocked);
+      if (blocked || (layer_param.type() == "Convolution" &&
+          layer_param.convolution_param().num_output() % channel_block == 0)) {
+        blockable.insert(blob_name);
+      } else {
+        blockable.erase(blob_name);
+      }
+    }
+  }
+}
+
+bool SupportsChannelBlock(const LayerParameter& layer_param,
+    const int channel_block) {
+  const string& type = layer_param.type();
+  if (type == "ReLU" || type == "Split" || type == "Eltwise") {
+    return true;
+  }
+  if (type == "Pooling") {
+    return layer_param.top_size() == 1 &&
+        layer_param.pooling_param().pool() !=
+        PoolingParameter_PoolMethod_STOCHASTIC;
+  }
+  if (type == "Convolution") {
+    const ConvolutionParameter& conv_param = layer_param.convolution_param();
+    return !layer_param.has_quantization_param() &&
+        conv_param.group() == 1 && conv_param.axis() == 1 &&
+        !conv_param.force_nd_im2col() &&
+        conv_param.engine() != ConvolutionParameter_Engine_CUDNN &&
+        conv_param.kernel_size_size() <= 2 &&
+        conv_param.num_output() % channel_block == 0;
+  }
+  return false;
+}
+
+void ConfigureReorderLayer(const string& blob_name,
+    const string& reordered_blob_name, const int channel_block,
+    LayerParameter* reorder_layer_param) {
+  reorder_layer_param->Clear();
+  reorder_layer_param->add_bottom(blob_name);
+  reorder_layer_param->set_name(reordered_blob_name + "_reorder");
+  reorder_layer_param->set_type("Reorder");
+  reorder_layer_param->add_top(reordered_blob_name);
+  reorder_layer_param->mutable_reorder_param()->set_channel_block(
+      channel_block);
+}
+
+}  // namespace caffe
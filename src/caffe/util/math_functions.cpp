@@ -1,9 +1,17 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_GEMM_S8_AVX2
+#endif
 
 #include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
@@ -45,6 +53,99 @@ void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA, const int M,
   cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
 }
 
+namespace {
+
+// The number of elements of a 16-bit matrix converted at a time.
+const int kHalfPanelSize = 32768;
+
+// Row-major gemm of a panel, with explicit leading dimensions.
+void GemmPanel(const CBLAS_TRANSPOSE TransB, const int M, const int N,
+    const int K, const float alpha, const float* A, const int lda,
+    const float* B, const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, CblasNoTrans, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+void GemmPanel(const CBLAS_TRANSPOSE TransB, const int M, const int N,
+    const int K, const double alpha, const double* A, const int lda,
+    const double* B, const int ldb, const double beta, double* C,
+    const int ldc) {
+  cblas_dgemm(CblasRowMajor, CblasNoTrans, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+}  // namespace
+
+template <typename Dtype>
+void caffe_cpu_gemm_half(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype alpha, const Dtype* A,
+    const uint16_t* B, const BlobProto_Storage storage, const Dtype beta,
+    Dtype* C) {
+  // B is stored as N x K with TransB, as K x N otherwise.
+  const int rows = (TransB == CblasNoTrans) ? K : N;
+  const int cols = (TransB == CblasNoTrans) ? N : K;
+  const int panel_rows =
+      std::max(1, std::min(rows, kHalfPanelSize / std::max(cols, 1)));
+  std::vector<Dtype> panel(panel_rows * cols);
+  for (int r = 0; r < rows; r += panel_rows) {
+    const int n = std::min(panel_rows, rows - r);
+    caffe_cpu_from_half(n * cols, storage, B + r * cols, &panel[0]);
+    if (TransB == CblasNoTrans) {
+      // The rows [r, r + n) of B add the columns [r, r + n) of A into C.
+      GemmPanel(CblasNoTrans, M, N, n, alpha, A + r, K, &panel[0], N,
+          r == 0 ? beta : Dtype(1), C, N);
+    } else {
+      // The rows [r, r + n) of B give the columns [r, r + n) of C.
+      GemmPanel(CblasTrans, M, n, K, alpha, A, K, &panel[0], K, beta, C + r,
+          N);
+    }
+  }
+}
+
+template void caffe_cpu_gemm_half<float>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const float alpha, const float* A,
+    const uint16_t* B, const BlobProto_Storage storage, const float beta,
+    float* C);
+template void caffe_cpu_gemm_half<double>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const double alpha,
+    const double* A, const uint16_t* B, const BlobProto_Storage storage,
+    const double beta, double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemv_half(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const Dtype alpha, const uint16_t* A,
+    const BlobProto_Storage storage, const Dtype* x, const Dtype beta,
+    Dtype* y) {
+  std::vector<Dtype> row(N);
+  if (TransA == CblasNoTrans) {
+    for (int i = 0; i < M; ++i) {
+      caffe_cpu_from_half(N, storage, A + i * N, &row[0]);
+      const Dtype dot = caffe_cpu_dot(N, &row[0], x);
+      // As in BLAS, y is not read when beta is zero.
+      y[i] = alpha * dot + (beta == 0 ? Dtype(0) : beta * y[i]);
+    }
+  } else {
+    if (beta == 0) {
+      caffe_set(N, Dtype(0), y);
+    } else {
+      caffe_scal(N, beta, y);
+    }
+    for (int i = 0; i < M; ++i) {
+      caffe_cpu_from_half(N, storage, A + i * N, &row[0]);
+      caffe_axpy(N, alpha * x[i], &row[0], y);
+    }
+  }
+}
+
+template void caffe_cpu_gemv_half<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const float alpha, const uint16_t* A,
+    const BlobProto_Storage storage, const float* x, const float beta,
+    float* y);
+template void caffe_cpu_gemv_half<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const double alpha, const uint16_t* A,
+    const BlobProto_Storage storage, const double* x, const double beta,
+    double* y);
+
 template <>
 void caffe_axpy<float>(const int N, const float alpha, const float* X,
     float* Y) { cblas_saxpy(N, alpha, X, 1, Y, 1); }
@@ -372,4 +473,304 @@ void caffe_cpu_scale<double>(const int n, const double alpha, const double *x,
   cblas_dscal(n, alpha, y, 1);
 }
 
+template <typename Dtype>
+void caffe_cpu_block_channels(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* plain,
+    Dtype* blocked) {
+  CHECK_EQ(channels % block, 0) << "channels must be a multiple of block";
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      Dtype* blocked_plane = blocked + (n * channels + c - c % block)
+          * spatial_dim + c % block;
+      for (int s = 0; s < spatial_dim; ++s) {
+        blocked_plane[s * block] = plain[s];
+      }
+      plain += spatial_dim;
+    }
+  }
+}
+
+template void caffe_cpu_block_channels<float>(const int num,
+    const int channels, const int spatial_dim, const int block,
+    const float* plain, float* blocked);
+template void caffe_cpu_block_channels<double>(const int num,
+    const int channels, const int spatial_dim, const int block,
+    const double* plain, double* blocked);
+
+template <typename Dtype>
+void caffe_cpu_unblock_channels(const int num, const int channels,
+    const int spatial_dim, const int block, const Dtype* blocked,
+    Dtype* plain) {
+  CHECK_EQ(channels % block, 0) << "channels must be a multiple of block";
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* blocked_plane = blocked + (n * channels + c - c % block)
+          * spatial_dim + c % block;
+      for (int s = 0; s < spatial_dim; ++s) {
+        plain[s] = blocked_plane[s * block];
+      }
+      plain += spatial_dim;
+    }
+  }
+}
+
+template void caffe_cpu_unblock_channels<float>(const int num,
+    const int channels, const int spatial_dim, const int block,
+    const float* blocked, float* plain);
+template void caffe_cpu_unblock_channels<double>(const int num,
+    const int channels, const int spatial_dim, const int block,
+    const double* blocked, double* plain);
+
+template <typename Dtype>
+void caffe_cpu_relu(const int n, const Dtype negative_slope, Dtype* x) {
+  for (int i = 0; i < n; ++i) {
+    x[i] = std::max(x[i], Dtype(0)) + negative_slope * std::min(x[i], Dtype(0));
+  }
+}
+
+template void caffe_cpu_relu<float>(const int n, const float negative_slope,
+    float* x);
+template void caffe_cpu_relu<double>(const int n, const double negative_slope,
+    double* x);
+
+template <typename Dtype>
+void caffe_cpu_relu_backward(const int n, const Dtype negative_slope,
+    const Dtype* y, Dtype* dy) {
+  for (int i = 0; i < n; ++i) {
+    dy[i] *= (y[i] > 0) + negative_slope * (y[i] <= 0);
+  }
+}
+
+template void caffe_cpu_relu_backward<float>(const int n,
+    const float negative_slope, const float* y, float* dy);
+template void caffe_cpu_relu_backward<double>(const int n,
+    const double negative_slope, const double* y, double* dy);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype q = std::floor(x[i] * scale + Dtype(0.5));
+    y[i] = static_cast<int8_t>(std::max(Dtype(-127), std::min(q, Dtype(127))));
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int n, const float scale,
+    const float* x, int8_t* y);
+template void caffe_cpu_quantize<double>(const int n, const double scale,
+    const double* x, int8_t* y);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int M, const int K, const Dtype* A,
+    int8_t* y, Dtype* scales) {
+  for (int i = 0; i < M; ++i) {
+    Dtype range = 0;
+    for (int k = 0; k < K; ++k) {
+      range = std::max(range, std::fabs(A[i * K + k]));
+    }
+    scales[i] = range / 127;
+    caffe_cpu_quantize(K, range > 0 ? 127 / range : Dtype(0), A + i * K,
+        y + i * K);
+  }
+}
+
+template void caffe_cpu_quantize_rows<float>(const int M, const int K,
+    const float* A, int8_t* y, float* scales);
+template void caffe_cpu_quantize_rows<double>(const int M, const int K,
+    const double* A, int8_t* y, double* scales);
+
+namespace {
+
+// caffe_cpu_gemm_s8 computes C in tiles of kGemmS8Rows x kGemmS8Cols. Each
+// step multiplies two entries of a row of A with two rows of B and adds the
+// products, as _mm256_madd_epi16 does, so A is packed as int16 pairs and B
+// as panels of kGemmS8Cols columns with the rows interleaved in pairs. K is
+// walked in blocks of kGemmS8Depth pairs so that the part of a panel being
+// read stays in the L1 cache.
+const int kGemmS8Rows = 6;
+const int kGemmS8Cols = 16;
+const int kGemmS8Depth = 256;
+const int kGemmS8Tiles = 16;
+
+inline int GemmS8Pairs(int K) { return (K + 1) / 2; }
+
+// Packs the rows [i0, i0 + kGemmS8Rows) of op(A) into tile, the pair of
+// entries 2p and 2p + 1 of row i0 + r as the int32 tile[p * kGemmS8Rows + r],
+// with zeros past M and K.
+void PackGemmS8Rows(const CBLAS_TRANSPOSE TransA, const int M, const int K,
+    const int8_t* A, int i0, int32_t* tile) {
+  const int pairs = GemmS8Pairs(K);
+  for (int r = 0; r < kGemmS8Rows; ++r) {
+    const int i = i0 + r;
+    for (int p = 0; p < pairs; ++p) {
+      int16_t entries[2] = {0, 0};
+      for (int e = 0; e < 2; ++e) {
+        const int k = 2 * p + e;
+        if (i < M && k < K) {
+          entries[e] = TransA == CblasNoTrans ? A[i * K + k] : A[k * M + i];
+        }
+      }
+      tile[p * kGemmS8Rows + r] = static_cast<uint16_t>(entries[0]) |
+          (static_cast<uint32_t>(static_cast<uint16_t>(entries[1])) << 16);
+    }
+  }
+}
+
+typedef void (*GemmS8TileFunc)(const int32_t* a, const int16_t* b, int depth,
+    bool accumulate, int32_t* c, int ldc, int rows, int cols);
+
+// Multiplies depth pairs of the packed rows a with the panel b into the
+// rows x cols tile at c, adding to it if accumulate.
+void GemmS8Tile(const int32_t* a, const int16_t* b, int depth,
+    bool accumulate, int32_t* c, int ldc, int rows, int cols) {
+  int32_t sums[kGemmS8Rows][kGemmS8Cols] = {};
+  for (int p = 0; p < depth; ++p) {
+    const int16_t* b_pair = b + p * 2 * kGemmS8Cols;
+    for (int r = 0; r < rows; ++r) {
+      const uint32_t word = a[p * kGemmS8Rows + r];
+      const int32_t a0 = static_cast<int16_t>(word & 0xffff);
+      const int32_t a1 = static_cast<int16_t>(word >> 16);
+      for (int j = 0; j < kGemmS8Cols; ++j) {
+        sums[r][j] += a0 * b_pair[2 * j] + a1 * b_pair[2 * j + 1];
+      }
+    }
+  }
+  for (int r = 0; r < rows; ++r) {
+    for (int j = 0; j < cols; ++j) {
+      c[r * ldc + j] = (accumulate ? c[r * ldc + j] : 0) + sums[r][j];
+    }
+  }
+}
+
+#ifdef CAFFE_GEMM_S8_AVX2
+template <int kRows>
+__attribute__((target("avx2")))
+void GemmS8TileAvx2(const int32_t* a, const int16_t* b, int depth,
+    bool accumulate, int32_t* c, int ldc, int rows, int cols) {
+  __m256i sums[kRows][2];
+#pragma GCC unroll 6
+  for (int r = 0; r < kRows; ++r) {
+    sums[r][0] = _mm256_setzero_si256();
+    sums[r][1] = _mm256_setzero_si256();
+  }
+  for (int p = 0; p < depth; ++p) {
+    const __m256i b0 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(b + p * 2 * kGemmS8Cols));
+    const __m256i b1 = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(b + p * 2 * kGemmS8Cols + 16));
+#pragma GCC unroll 6
+    for (int r = 0; r < kRows; ++r) {
+      const __m256i a_pair = _mm256_set1_epi32(a[p * kGemmS8Rows + r]);
+      sums[r][0] = _mm256_add_epi32(sums[r][0], _mm256_madd_epi16(a_pair, b0));
+      sums[r][1] = _mm256_add_epi32(sums[r][1], _mm256_madd_epi16(a_pair, b1));
+    }
+  }
+  if (cols == kGemmS8Cols) {
+#pragma GCC unroll 6
+    for (int r = 0; r < kRows; ++r) {
+      __m256i* row = reinterpret_cast<__m256i*>(c + r * ldc);
+      if (accumulate) {
+        sums[r][0] = _mm256_add_epi32(sums[r][0], _mm256_loadu_si256(row));
+        sums[r][1] = _mm256_add_epi32(sums[r][1],
+            _mm256_loadu_si256(row + 1));
+      }
+      _mm256_storeu_si256(row, sums[r][0]);
+      _mm256_storeu_si256(row + 1, sums[r][1]);
+    }
+    return;
+  }
+  int32_t tile[kRows][kGemmS8Cols];
+#pragma GCC unroll 6
+  for (int r = 0; r < kRows; ++r) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile[r]), sums[r][0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(tile[r] + 8), sums[r][1]);
+    for (int j = 0; j < cols; ++j) {
+      c[r * ldc + j] = (accumulate ? c[r * ldc + j] : 0) + tile[r][j];
+    }
+  }
+}
+#endif  // CAFFE_GEMM_S8_AVX2
+
+// The kernel for tiles of the given number of rows.
+GemmS8TileFunc SelectGemmS8Tile(int rows) {
+#ifdef CAFFE_GEMM_S8_AVX2
+  if (caffe_cpu_has_avx2()) {
+    static const GemmS8TileFunc kernels[kGemmS8Rows] = {
+        &GemmS8TileAvx2<1>, &GemmS8TileAvx2<2>, &GemmS8TileAvx2<3>,
+        &GemmS8TileAvx2<4>, &GemmS8TileAvx2<5>, &GemmS8TileAvx2<6>};
+    return kernels[rows - 1];
+  }
+#endif  // CAFFE_GEMM_S8_AVX2
+  return &GemmS8Tile;
+}
+
+}  // namespace
+
+bool caffe_cpu_has_avx2() {
+#ifdef CAFFE_GEMM_S8_AVX2
+  static const bool has_avx2 = __builtin_cpu_supports("avx2")
+      && __builtin_cpu_supports("fma");
+  return has_avx2;
+#else
+  return false;
+#endif  // CAFFE_GEMM_S8_AVX2
+}
+
+int caffe_cpu_gemm_s8_packed_size(const int K, const int N) {
+  return (N + kGemmS8Cols - 1) / kGemmS8Cols * GemmS8Pairs(K) * 2 *
+      kGemmS8Cols;
+}
+
+void caffe_cpu_gemm_s8_pack(const CBLAS_TRANSPOSE TransB, const int K,
+    const int N, const int8_t* B, int16_t* packed_B) {
+  const int pairs = GemmS8Pairs(K);
+  for (int j0 = 0; j0 < N; j0 += kGemmS8Cols) {
+    for (int k = 0; k < 2 * pairs; ++k) {
+      int16_t* row = packed_B + (k / 2) * 2 * kGemmS8Cols + k % 2;
+      for (int j = 0; j < kGemmS8Cols; ++j) {
+        int16_t value = 0;
+        if (k < K && j0 + j < N) {
+          value = TransB == CblasNoTrans ? B[k * N + j0 + j] :
+              B[(j0 + j) * K + k];
+        }
+        row[2 * j] = value;
+      }
+    }
+    packed_B += pairs * 2 * kGemmS8Cols;
+  }
+}
+
+void caffe_cpu_gemm_s8(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const int K, const int8_t* A, const int16_t* packed_B,
+    int32_t* C) {
+  const int pairs = GemmS8Pairs(K);
+  const int num_tiles = (M + kGemmS8Rows - 1) / kGemmS8Rows;
+  vector<int32_t> packed_A(num_tiles * pairs * kGemmS8Rows);
+  for (int t = 0; t < num_tiles; ++t) {
+    PackGemmS8Rows(TransA, M, K, A, t * kGemmS8Rows,
+        &packed_A[t * pairs * kGemmS8Rows]);
+  }
+  const GemmS8TileFunc full_tile = SelectGemmS8Tile(kGemmS8Rows);
+  const int last_rows = M - (num_tiles - 1) * kGemmS8Rows;
+  const GemmS8TileFunc last_tile = SelectGemmS8Tile(last_rows);
+  for (int p0 = 0; p0 < pairs; p0 += kGemmS8Depth) {
+    const int depth = std::min(kGemmS8Depth, pairs - p0);
+    for (int t0 = 0; t0 < num_tiles; t0 += kGemmS8Tiles) {
+      const int t1 = std::min(num_tiles, t0 + kGemmS8Tiles);
+      for (int j0 = 0; j0 < N; j0 += kGemmS8Cols) {
+        const int16_t* panel = packed_B +
+            (j0 / kGemmS8Cols * pairs + p0) * 2 * kGemmS8Cols;
+        const int cols = std::min(kGemmS8Cols, N - j0);
+        for (int t = t0; t < t1; ++t) {
+          const bool last = t == num_tiles - 1;
+          (last ? last_tile : full_tile)(
+              &packed_A[(t * pairs + p0) * kGemmS8Rows], panel, depth,
+              p0 > 0, C + t * kGemmS8Rows * N + j0, N,
+              last ? last_rows : kGemmS8Rows, cols);
+        }
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,262 @@
+#include "caffe/util/ring_comm.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace caffe {
+
+namespace {
+
+// Broadcast passes the data on in chunks of this size, so that all the
+// links of the ring are busy at once.
+const size_t kBroadcastChunk = 1 << 20;
+
+void SplitAddress(const string& address, string* host, string* port) {
+  const size_t colon = address.rfind(':');
+  CHECK(colon != string::npos && colon + 1 < address.size())
+      << "Expected host:port, got " << address;
+  *host = address.substr(0, colon);
+  *port = address.substr(colon + 1);
+}
+
+void SetSocketOptions(int fd) {
+  const int one = 1;
+  CHECK_EQ(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)), 0)
+      << "setsockopt failed: " << strerror(errno);
+  const int flags = fcntl(fd, F_GETFL, 0);
+  CHECK_EQ(fcntl(fd, F_SETFL, flags | O_NONBLOCK), 0)
+      << "fcntl failed: " << strerror(errno);
+}
+
+// Resolves address, given as host:port, to an IPv4 TCP address; free it with
+// freeaddrinfo.
+addrinfo* Resolve(const string& address, int flags) {
+  string host, port;
+  SplitAddress(address, &host, &port);
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = flags;
+  addrinfo* info = NULL;
+  const int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+  CHECK_EQ(error, 0) << "Failed to resolve " << address << ": "
+      << gai_strerror(error);
+  return info;
+}
+
+// Listens at the host and port of address, so that a rank given a private
+// interface in peers is not reachable on the others.
+int Listen(const string& address) {
+  addrinfo* info = Resolve(address, AI_PASSIVE);
+  const int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+  CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  CHECK_EQ(bind(fd, info->ai_addr, info->ai_addrlen), 0)
+      << "Failed to listen at " << address << ": " << strerror(errno);
+  freeaddrinfo(info);
+  CHECK_EQ(listen(fd, 1), 0)
+      << "Failed to listen at " << address << ": " << strerror(errno);
+  return fd;
+}
+
+// Connects to address, retrying while it is not listening yet.
+int Connect(const string& address, int timeout_sec) {
+  addrinfo* info = Resolve(address, 0);
+  const time_t deadline = time(NULL) + timeout_sec;
+  int fd = -1;
+  while (true) {
+    fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    CHECK_GE(fd, 0) << "socket failed: " << strerror(errno);
+    if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) {
+      break;
+    }
+    const int connect_errno = errno;
+    close(fd);
+    CHECK_LT(time(NULL), deadline) << "Failed to connect to " << address
+        << ": " << strerror(connect_errno);
+    usleep(100 * 1000);
+  }
+  freeaddrinfo(info);
+  return fd;
+}
+
+}  // namespace
+
+RingComm::RingComm(int rank, const vector<string>& peers, int timeout_sec)
+    : rank_(rank), size_(peers.size()), next_fd_(-1), prev_fd_(-1) {
+  CHECK_GE(rank_, 0);
+  CHECK_LT(rank_, size_) << "Rank " << rank_ << " has no address in peers.";
+  if (size_ == 1) {
+    return;
+  }
+  // Listening first lets the connection to the next rank be accepted by its
+  // kernel even while that rank is still connecting to its own next rank.
+  const int listen_fd = Listen(peers[rank_]);
+  const int next = (rank_ + 1) % size_;
+  const int prev = (rank_ + size_ - 1) % size_;
+  next_fd_ = Connect(peers[next], timeout_sec);
+  prev_fd_ = accept(listen_fd, NULL, NULL);
+  CHECK_GE(prev_fd_, 0) << "Failed to accept rank " << prev << ": "
+      << strerror(errno);
+  close(listen_fd);
+  SetSocketOptions(next_fd_);
+  SetSocketOptions(prev_fd_);
+  // Make sure the ring is wired as every rank expects.
+  const int32_t me = rank_;
+  int32_t sender = -1;
+  SendRecv(&me, sizeof(me), &sender, sizeof(sender));
+  CHECK_EQ(sender, prev) << "Rank " << rank_ << " expected rank " << prev
+      << " to connect to " << peers[rank_];
+  LOG(INFO) << "Rank " << rank_ << " of " << size_ << " connected to "
+      << peers[next];
+}
+
+RingComm::~RingComm() {
+  if (next_fd_ >= 0) {
+    close(next_fd_);
+  }
+  if (prev_fd_ >= 0) {
+    close(prev_fd_);
+  }
+}
+
+void RingComm::SendRecv(const void* send, size_t send_size, void* recv,
+    size_t recv_size) {
+  const char* out = static_cast<const char*>(send);
+  char* in = static_cast<char*>(recv);
+  size_t sent = 0;
+  size_t received = 0;
+  while (sent < send_size || received < recv_size) {
+    pollfd fds[2];
+    int num_fds = 0;
+    int send_index = -1;
+    int recv_index = -1;
+    if (sent < send_size) {
+      fds[num_fds].fd = next_fd_;
+      fds[num_fds].events = POLLOUT;
+      send_index = num_fds++;
+    }
+    if (received < recv_size) {
+      fds[num_fds].fd = prev_fd_;
+      fds[num_fds].events = POLLIN;
+      recv_index = num_fds++;
+    }
+    if (poll(fds, num_fds, -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "poll failed: " << strerror(errno);
+      continue;
+    }
+    if (send_index >= 0 && fds[send_index].revents) {
+      const ssize_t n = ::send(next_fd_, out + sent, send_size - sent,
+          MSG_NOSIGNAL);
+      if (n >= 0) {
+        sent += n;
+      } else {
+        CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            << "Failed to send to rank " << (rank_ + 1) % size_ << ": "
+            << strerror(errno);
+      }
+    }
+    if (recv_index >= 0 && fds[recv_index].revents) {
+      const ssize_t n = ::recv(prev_fd_, in + received, recv_size - received,
+          0);
+      CHECK_NE(n, 0) << "Rank " << (rank_ + size_ - 1) % size_
+          << " closed the connection";
+      if (n > 0) {
+        received += n;
+      } else {
+        CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            << "Failed to receive from rank " << (rank_ + size_ - 1) % size_
+            << ": " << strerror(errno);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void RingComm::Allreduce(Dtype* data, size_t count) {
+  if (size_ == 1) {
+    return;
+  }
+  // Segment i is [begin[i], begin[i + 1]); the first count % size_ segments
+  // take one element more.
+  const size_t base = count / size_;
+  const size_t extra = count % size_;
+  vector<size_t> begin(size_ + 1);
+  for (int i = 0; i <= size_; ++i) {
+    begin[i] = base * i + std::min<size_t>(i, extra);
+  }
+  buffer_.resize((base + 1) * sizeof(Dtype));
+  Dtype* received = reinterpret_cast<Dtype*>(&buffer_[0]);
+  // Reduce-scatter: at step s, every rank adds the partial sum of one
+  // segment from the previous rank to its own and passes it on. Rank r ends
+  // with the sum over all ranks of segment (r + 1) % size_.
+  for (int s = 0; s < size_ - 1; ++s) {
+    const int send_segment = (rank_ - s + size_) % size_;
+    const int recv_segment = (rank_ - s - 1 + 2 * size_) % size_;
+    const size_t recv_count = begin[recv_segment + 1] - begin[recv_segment];
+    SendRecv(data + begin[send_segment],
+        (begin[send_segment + 1] - begin[send_segment]) * sizeof(Dtype),
+        received, recv_count * sizeof(Dtype));
+    Dtype* sum = data + begin[recv_segment];
+    for (size_t j = 0; j < recv_count; ++j) {
+      sum[j] += received[j];
+    }
+  }
+  // Allgather: pass the summed segments around the ring.
+  for (int s = 0; s < size_ - 1; ++s) {
+    const int send_segment = (rank_ + 1 - s + size_) % size_;
+    const int recv_segment = (rank_ - s + size_) % size_;
+    SendRecv(data + begin[send_segment],
+        (begin[send_segment + 1] - begin[send_segment]) * sizeof(Dtype),
+        data + begin[recv_segment],
+        (begin[recv_segment + 1] - begin[recv_segment]) * sizeof(Dtype));
+  }
+}
+
+template void RingComm::Allreduce<float>(float* data, size_t count);
+template void RingComm::Allreduce<double>(double* data, size_t count);
+
+void RingComm::Broadcast(void* data, size_t size) {
+  if (size_ == 1) {
+    return;
+  }
+  char* bytes = static_cast<char*>(data);
+  const size_t num_chunks = (size + kBroadcastChunk - 1) / kBroadcastChunk;
+  // The last rank passes nothing on, as rank 0 has the data.
+  const bool receives = rank_ != 0;
+  const bool sends = rank_ != size_ - 1;
+  // At step c, rank 0 sends chunk c, and the other ranks receive chunk c
+  // while passing chunk c - 1 on.
+  for (size_t c = 0; c <= num_chunks; ++c) {
+    const size_t send_chunk = receives ? c - 1 : c;
+    const bool send_now = sends && (c > 0 || !receives) &&
+        send_chunk < num_chunks;
+    const bool recv_now = receives && c < num_chunks;
+    const size_t send_offset = send_chunk * kBroadcastChunk;
+    const size_t recv_offset = c * kBroadcastChunk;
+    SendRecv(bytes + (send_now ? send_offset : 0),
+        send_now ? std::min(kBroadcastChunk, size - send_offset) : 0,
+        bytes + (recv_now ? recv_offset : 0),
+        recv_now ? std::min(kBroadcastChunk, size - recv_offset) : 0);
+  }
+}
+
+}  // namespace caffe
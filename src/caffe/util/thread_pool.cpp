@@ -0,0 +1,131 @@
+#include <boost/thread.hpp>
+#include <stdint.h>
+
+#include <algorithm>
+#include <exception>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::sync {
+ public:
+  boost::mutex mutex_;
+  // Signaled when a new job is posted or the pool is stopped.
+  boost::condition_variable work_condition_;
+  // Signaled when the last chunk of the current job completes.
+  boost::condition_variable done_condition_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : sync_(new sync()), num_threads_(num_threads), func_(NULL), n_(0),
+      num_chunks_(0), next_chunk_(0), pending_chunks_(0), generation_(0),
+      stop_(false) {
+  CHECK_GE(num_threads_, 1) << "A thread pool needs at least one thread.";
+  try {
+    for (int i = 1; i < num_threads_; ++i) {
+      workers_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ThreadPool::WorkerEntry, this)));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->work_condition_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+void ThreadPool::Run(int n, const RangeFunc& func, int grain) {
+  if (n <= 0) {
+    return;
+  }
+  const int num_chunks = std::max(1, std::min(num_threads_,
+      n / std::max(grain, 1)));
+  if (num_chunks == 1) {
+    func(0, n);
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    func_ = &func;
+    n_ = n;
+    num_chunks_ = num_chunks;
+    next_chunk_ = 0;
+    pending_chunks_ = num_chunks;
+    ++generation_;
+  }
+  sync_->work_condition_.notify_all();
+  RunChunks();
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (pending_chunks_ > 0) {
+    sync_->done_condition_.wait(lock);
+  }
+  func_ = NULL;
+}
+
+void ThreadPool::RunChunks() {
+  while (true) {
+    const RangeFunc* func;
+    int begin, end;
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      if (func_ == NULL || next_chunk_ >= num_chunks_) {
+        return;
+      }
+      const int chunk = next_chunk_++;
+      func = func_;
+      begin = static_cast<int>(static_cast<int64_t>(n_) * chunk
+          / num_chunks_);
+      end = static_cast<int>(static_cast<int64_t>(n_) * (chunk + 1)
+          / num_chunks_);
+    }
+    (*func)(begin, end);
+    bool done;
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      done = (--pending_chunks_ == 0);
+    }
+    if (done) {
+      sync_->done_condition_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::WorkerEntry() {
+  unsigned int seen_generation = 0;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!stop_ && generation_ == seen_generation) {
+        sync_->work_condition_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
+    RunChunks();
+  }
+}
+
+void caffe_parallel_for(int n, const ThreadPool::RangeFunc& func,
+    int grain) {
+  if (n <= 0) {
+    return;
+  }
+  if (Caffe::cpu_threads() <= 1 || n <= grain) {
+    func(0, n);
+    return;
+  }
+  Caffe::thread_pool().Run(n, func, grain);
+}
+
+}  // namespace caffe
@@ -0,0 +1,192 @@
+#include <boost/thread.hpp>
+#include <time.h>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <sstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/trace.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Events past this many are dropped, which bounds the memory of long runs
+// to a few hundred MB.
+const size_t kMaxTraceEvents = 1 << 22;
+
+struct TraceEvent {
+  string name;
+  const char* category;
+  int64_t start;
+  int64_t duration;
+  int tid;
+  string args;
+};
+
+struct TraceState {
+  boost::mutex mutex;
+  string filename;
+  int64_t start_micros;
+  int64_t bytes_allocated;
+  vector<TraceEvent> events;
+  std::map<boost::thread::id, int> tids;
+  bool dropped;
+};
+
+TraceState& state() {
+  static TraceState state_;
+  return state_;
+}
+
+string JsonEscape(const string& s) {
+  std::ostringstream out;
+  for (int i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      out << "\\u00" << "0123456789abcdef"[c >> 4]
+          << "0123456789abcdef"[c & 0xf];
+    } else {
+      out << c;
+    }
+  }
+  return out.str();
+}
+
+// Durations are measured on the monotonic clock, which unlike the wall
+// clock does not jump when the system time is set.
+int64_t MonotonicMicros() {
+  timespec now;
+  CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &now), 0);
+  return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+}  // namespace
+
+boost::atomic<bool> Trace::enabled_(false);
+
+void Trace::Start(const string& filename) {
+  CHECK(!enabled()) << "Trace already started.";
+  TraceState& s = state();
+  boost::mutex::scoped_lock lock(s.mutex);
+  s.filename = filename;
+  s.start_micros = MonotonicMicros();
+  s.bytes_allocated = 0;
+  s.events.clear();
+  s.tids.clear();
+  s.dropped = false;
+  enabled_.store(true, boost::memory_order_release);
+  LOG(INFO) << "Recording a trace to " << filename;
+}
+
+void Trace::Stop() {
+  CHECK(enabled()) << "Trace not started.";
+  enabled_.store(false, boost::memory_order_release);
+  TraceState& s = state();
+  boost::mutex::scoped_lock lock(s.mutex);
+  std::ofstream out(s.filename.c_str());
+  CHECK(out) << "Failed to open trace file " << s.filename;
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (int i = 0; i < s.events.size(); ++i) {
+    const TraceEvent& event = s.events[i];
+    out << (i ? ",\n" : "\n") << "{\"name\": \"" << JsonEscape(event.name)
+        << "\", \"cat\": \"" << event.category
+        << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << event.tid
+        << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+        << ", \"args\": {" << event.args << "}}";
+  }
+  out << "\n]}\n";
+  CHECK(out) << "Failed to write trace file " << s.filename;
+  LOG(INFO) << "Wrote " << s.events.size() << " trace events to "
+      << s.filename;
+  s.events.clear();
+}
+
+int64_t Trace::NowMicros() {
+  return MonotonicMicros() - state().start_micros;
+}
+
+int64_t Trace::bytes_allocated() {
+  TraceState& s = state();
+  boost::mutex::scoped_lock lock(s.mutex);
+  return s.bytes_allocated;
+}
+
+void Trace::AddAllocation(size_t bytes) {
+  if (!enabled()) {
+    return;
+  }
+  TraceState& s = state();
+  boost::mutex::scoped_lock lock(s.mutex);
+  s.bytes_allocated += bytes;
+}
+
+void Trace::AddEvent(const string& name, const char* category,
+    int64_t start, int64_t duration, const string& args) {
+  TraceState& s = state();
+  boost::mutex::scoped_lock lock(s.mutex);
+  if (!enabled()) {
+    return;
+  }
+  if (s.events.size() >= kMaxTraceEvents) {
+    LOG_IF(WARNING, !s.dropped) << "Trace full; dropping further events.";
+    s.dropped = true;
+    return;
+  }
+  // Number the threads in the order they first record an event.
+  std::map<boost::thread::id, int>::iterator it =
+      s.tids.insert(std::make_pair(boost::this_thread::get_id(),
+          static_cast<int>(s.tids.size()))).first;
+  TraceEvent event;
+  event.name = name;
+  event.category = category;
+  event.start = start;
+  event.duration = duration;
+  event.tid = it->second;
+  event.args = args;
+  s.events.push_back(event);
+}
+
+TraceScope::TraceScope(const string& name, const char* category)
+    : enabled_(Trace::enabled()), category_(category) {
+  if (enabled_) {
+    name_ = name;
+    start_bytes_ = Trace::bytes_allocated();
+    start_ = Trace::NowMicros();
+  }
+}
+
+TraceScope::~TraceScope() {
+  if (!enabled_) {
+    return;
+  }
+#ifndef CPU_ONLY
+  if (Caffe::mode() == Caffe::GPU) {
+    CUDA_CHECK(cudaDeviceSynchronize());
+  }
+#endif
+  const int64_t end = Trace::NowMicros();
+  AddArg("bytes_allocated", Trace::bytes_allocated() - start_bytes_);
+  Trace::AddEvent(name_, category_, start_, end - start_, args_);
+}
+
+void TraceScope::AddArg(const char* key, const char* value) {
+  if (enabled_) {
+    args_ += (args_.empty() ? "\"" : ", \"") + string(key) + "\": \"" +
+        JsonEscape(value) + "\"";
+  }
+}
+
+void TraceScope::AddArg(const char* key, int64_t value) {
+  if (enabled_) {
+    std::ostringstream out;
+    out << (args_.empty() ? "\"" : ", \"") << key << "\": " << value;
+    args_ += out.str();
+  }
+}
+
+}  // namespace caffe
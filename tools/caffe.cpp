@@ -6,6 +6,8 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <map>
 #include <string>
@@ -13,6 +15,8 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/ring_comm.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -48,6 +52,34 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(quantized_model, "",
+    "The file to write the calibrated model definition to. "
+    "Only used for 'quantize'.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads CPU layers split their work across. "
+    "Use 0 for one thread per physical core.");
+DEFINE_int32(threads, 1,
+    "Optional; the number of solver threads training together in CPU mode, "
+    "each on its share of the training data. The effective training batch "
+    "size is multiplied by the number of threads. Only used for 'train'.");
+DEFINE_bool(hogwild, false,
+    "Optional; with -threads, let every thread update the shared weights "
+    "as it goes, without locks, instead of averaging the gradients.");
+DEFINE_string(trace, "",
+    "Optional; record per-layer forward and backward times, data layer "
+    "waits and solver steps, and write them to this file as a Chrome "
+    "trace (chrome://tracing or Perfetto).");
+DEFINE_int32(world_size, 1,
+    "Optional; the number of processes training together, each on its "
+    "share of the training data. The effective training batch size is "
+    "multiplied by the number of processes. Only used for 'train'.");
+DEFINE_int32(rank, 0,
+    "Optional; the index of this process among the world_size ones. Rank 0 "
+    "tests and snapshots the model.");
+DEFINE_string(peers, "",
+    "Optional; the host:port addresses the world_size processes listen at, "
+    "by rank, separated by ','. Defaults to 127.0.0.1:29500, "
+    "127.0.0.1:29501, ...");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -127,6 +159,21 @@ vector<string> get_stages_from_flags() {
   return stages;
 }
 
+// Parse the addresses of the training processes, by rank
+vector<string> get_peers_from_flags() {
+  vector<string> peers;
+  if (FLAGS_peers.size()) {
+    boost::split(peers, FLAGS_peers, boost::is_any_of(","));
+  } else {
+    for (int i = 0; i < FLAGS_world_size; ++i) {
+      peers.push_back("127.0.0.1:" + boost::lexical_cast<string>(29500 + i));
+    }
+  }
+  CHECK_EQ(peers.size(), FLAGS_world_size)
+      << "peers must give one address per process.";
+  return peers;
+}
+
 // caffe commands to call by
 //     caffe <command> <args>
 //
@@ -228,12 +275,49 @@ int train() {
     Caffe::set_solver_count(gpus.size());
   }
 
+  shared_ptr<caffe::RingComm> comm;
+  if (FLAGS_world_size > 1) {
+    CHECK_LE(gpus.size(), 1)
+        << "Multi-process training uses one device per process.";
+    LOG(INFO) << "Training as rank " << FLAGS_rank << " of "
+        << FLAGS_world_size;
+    comm.reset(new caffe::RingComm(FLAGS_rank, get_peers_from_flags()));
+    Caffe::set_world_size(FLAGS_world_size);
+    Caffe::set_world_rank(FLAGS_rank);
+    // The ranks must shuffle the data alike to read disjoint shards of it.
+    int64_t seed = solver_param.random_seed();
+    if (seed < 0) {
+      seed = caffe::caffe_rng_rand();
+    }
+    comm->Broadcast(&seed, sizeof(seed));
+    solver_param.set_random_seed(seed);
+    if (FLAGS_rank > 0) {
+      solver_param.set_snapshot(0);
+      solver_param.set_snapshot_after_train(false);
+      solver_param.clear_test_iter();
+      solver_param.clear_test_net();
+      solver_param.clear_test_net_param();
+      solver_param.clear_test_state();
+    }
+  }
+
+  if (FLAGS_threads > 1) {
+    CHECK_EQ(gpus.size(), 0) << "Solver threads train in CPU mode.";
+    CHECK_EQ(FLAGS_world_size, 1)
+        << "Solver threads and multiple processes cannot be combined.";
+    Caffe::set_solver_count(FLAGS_threads);
+  }
+
   caffe::SignalHandler signal_handler(
         GetRequestedAction(FLAGS_sigint_effect),
         GetRequestedAction(FLAGS_sighup_effect));
 
   shared_ptr<caffe::Solver<float> >
       solver(caffe::SolverRegistry<float>::CreateSolver(solver_param));
+  if (comm) {
+    // Seeded apart from here on, so that the ranks drop out different units.
+    Caffe::set_random_seed(solver_param.random_seed() + FLAGS_rank);
+  }
 
   solver->SetActionFunction(signal_handler.GetActionFunction());
 
@@ -247,6 +331,13 @@ int train() {
   if (gpus.size() > 1) {
     caffe::P2PSync<float> sync(solver, NULL, solver->param());
     sync.Run(gpus);
+  } else if (FLAGS_threads > 1) {
+    caffe::ThreadSync<float> sync(solver, NULL, 0, FLAGS_hogwild);
+    sync.Run(FLAGS_threads);
+  } else if (comm) {
+    caffe::RingSync<float> sync(solver, comm);
+    LOG(INFO) << "Starting Optimization";
+    solver->Solve();
   } else {
     LOG(INFO) << "Starting Optimization";
     solver->Solve();
@@ -344,7 +435,7 @@ int time() {
     Caffe::SetDevice(gpus[0]);
     Caffe::set_mode(Caffe::GPU);
   } else {
-    LOG(INFO) << "Use CPU.";
+    LOG(INFO) << "Use CPU with " << Caffe::cpu_threads() << " threads.";
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
@@ -416,11 +507,92 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  if (Caffe::mode() == Caffe::CPU && Caffe::cpu_threads() > 1) {
+    // Rerun on a single thread to report the intra-op speedup.
+    const int cpu_threads = Caffe::cpu_threads();
+    Caffe::set_cpu_threads(1);
+    Timer serial_timer;
+    serial_timer.Start();
+    for (int j = 0; j < FLAGS_iterations; ++j) {
+      caffe_net.ForwardBackward();
+    }
+    serial_timer.Stop();
+    Caffe::set_cpu_threads(cpu_threads);
+    LOG(INFO) << "Average Forward-Backward on 1 CPU thread: "
+      << serial_timer.MilliSeconds() / FLAGS_iterations << " ms.";
+    LOG(INFO) << "Speedup on " << cpu_threads << " CPU threads: "
+      << serial_timer.MilliSeconds() / total_timer.MilliSeconds() << "x";
+  }
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
 RegisterBrewFunction(time);
 
+
+// Quantize: calibrate a model for 8-bit inference.
+int quantize() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to quantize.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to quantize.";
+  CHECK_GT(FLAGS_quantized_model.size(), 0)
+      << "Need a file to write the quantized model definition to.";
+  vector<string> stages = get_stages_from_flags();
+  Caffe::set_mode(Caffe::CPU);
+  // Calibrate in floating point, even if the model is quantized already.
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  caffe::NetParameter float_param(param);
+  for (int i = 0; i < float_param.layer_size(); ++i) {
+    float_param.mutable_layer(i)->clear_quantization_param();
+  }
+  float_param.mutable_state()->set_phase(caffe::TEST);
+  float_param.mutable_state()->set_level(FLAGS_level);
+  for (int i = 0; i < stages.size(); ++i) {
+    float_param.mutable_state()->add_stage(stages[i]);
+  }
+  Net<float> caffe_net(float_param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  // Measure the largest input magnitude of each quantizable layer. The net
+  // is run one layer at a time and the inputs are read just before the
+  // layer runs, as with reuse_blobs later layers may overwrite them.
+  std::map<string, float> ranges;
+  LOG(INFO) << "Calibrating for " << FLAGS_iterations << " iterations.";
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    for (int j = 0; j < caffe_net.layers().size(); ++j) {
+      const string type = caffe_net.layers()[j]->type();
+      if (type == "Convolution" || type == "InnerProduct") {
+        float& range = ranges[caffe_net.layer_names()[j]];
+        const vector<Blob<float>*>& bottom = caffe_net.bottom_vecs()[j];
+        for (int k = 0; k < bottom.size(); ++k) {
+          const float* data = bottom[k]->cpu_data();
+          for (int n = 0; n < bottom[k]->count(); ++n) {
+            range = std::max(range, std::fabs(data[n]));
+          }
+        }
+      }
+      caffe_net.ForwardFromTo(j, j);
+    }
+  }
+  for (int i = 0; i < param.layer_size(); ++i) {
+    caffe::LayerParameter* layer_param = param.mutable_layer(i);
+    if (!ranges.count(layer_param->name())) {
+      continue;
+    }
+    const float range = ranges[layer_param->name()];
+    if (range == 0) {
+      LOG(WARNING) << "Layer " << layer_param->name()
+                   << " only saw zero inputs; leaving it in floating point.";
+      layer_param->clear_quantization_param();
+      continue;
+    }
+    LOG(INFO) << "Layer " << layer_param->name() << " input range " << range;
+    layer_param->mutable_quantization_param()->set_bottom_range(range);
+  }
+  caffe::WriteProtoToTextFile(param, FLAGS_quantized_model);
+  LOG(INFO) << "Wrote the quantized model to " << FLAGS_quantized_model;
+  return 0;
+}
+RegisterBrewFunction(quantize);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -433,14 +605,24 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  quantize        calibrate a model for 8-bit CPU inference");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  Caffe::set_cpu_threads(FLAGS_cpu_threads);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
 #endif
-      return GetBrewFunction(caffe::string(argv[1]))();
+      BrewFunction brew = GetBrewFunction(caffe::string(argv[1]));
+      if (FLAGS_trace.size()) {
+        caffe::Trace::Start(FLAGS_trace);
+      }
+      const int result = brew();
+      if (FLAGS_trace.size()) {
+        caffe::Trace::Stop();
+      }
+      return result;
 #ifdef WITH_PYTHON_LAYER
     } catch (bp::error_already_set) {
       PyErr_Print();